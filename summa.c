@@ -6,9 +6,17 @@
 #include <unistd.h>
 #include <time.h>
 #include <limits.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
 #include "summa.h"
 #include "summa_scan.h"
 #include "summa_db.h"
+#include "summa_io.h"
+#include "summa_serve.h"
+#include "summa_federate.h"
+#include "summa_cooccur.h"
+#include "summa_minutes.h"
 
 /* Version information */
 #ifndef VERSION
@@ -17,20 +25,6 @@
 
 /* Type definitions are now in summa.h */
 
-/* Tag aggregation structure */
-typedef struct {
-    char *tag;
-    int total_minutes;
-    int entry_count;
-} tag_summary_t;
-
-/* Daily summary structure */
-typedef struct {
-    date_t date;
-    int total_minutes;
-    int entry_count;
-} daily_summary_t;
-
 /* Global data */
 logfile_t *current_logfile = NULL;
 date_t current_date = {0, 0, 0};  /* Current date being processed */
@@ -48,20 +42,6 @@ typedef enum {
     LINE_OTHER    /* Everything else (ignored) */
 } line_type_t;
 
-/* Output format enum */
-typedef enum {
-    FORMAT_TEXT,
-    FORMAT_CSV,
-    FORMAT_JSON
-} output_format_t;
-
-/* Tag sorting enum */
-typedef enum {
-    SORT_ALPHA,      /* Alphabetical (default) */
-    SORT_TIME,       /* By total time (descending) */
-    SORT_COUNT       /* By entry count (descending) */
-} tag_sort_t;
-
 /* Function declarations */
 logfile_t* create_logfile(void);
 logline_t* create_logline(void);
@@ -73,12 +53,19 @@ int calculate_duration(summa_time_t *start, summa_time_t *end);
 void free_logfile(logfile_t *file);
 void free_logline(logline_t *entry);
 void free_taglist(taglist_t *list);
-void print_summary(logfile_t *file, tag_sort_t sort_mode);
+void print_summary(logfile_t *file, tag_sort_t sort_mode, int top);
+void print_tag_summary(FILE *out, tag_summary_t *summaries, int tag_count,
+                       int entry_count, int total_minutes, tag_sort_t sort_mode, int top);
 void print_daily_summary(logfile_t *file);
+void print_daily_rows(FILE *out, const daily_summary_t *days, int day_count);
 void print_weekly_summary(logfile_t *file);
+void print_weekly_rows(FILE *out, const weekly_summary_t *weeks, int week_count);
 void print_monthly_summary(logfile_t *file);
+void print_monthly_rows(FILE *out, const monthly_summary_t *months, int month_count);
 void print_csv(logfile_t *file);
-void print_json(logfile_t *file);
+void print_csv_header(FILE *out);
+void print_csv_entry(FILE *out, logline_t *entry);
+void print_json(FILE *out, logfile_t *file);
 void print_version(const char *progname);
 void print_usage(const char *progname);
 
@@ -89,6 +76,7 @@ logline_t* parse_time_line(const char* line, int line_number);
 int parse_two_phase(FILE* input);
 int compare_dates(date_t *d1, date_t *d2);
 bool entry_passes_filters(logline_t *entry);
+bool parse_size(const char *text, size_t *size);
 
 /* Tag sorting comparison functions */
 int compare_tags_alphabetical(const void *a, const void *b);
@@ -244,6 +232,9 @@ void print_version(const char *progname) {
     printf("summa version %s\n", VERSION);
     printf("A fast and flexible time tracking log parser\n");
     printf("Repository: https://github.com/jw4/summa\n");
+    printf("Compressed logs: gzip %s, zstd %s\n",
+           io_compression_supported(COMPRESSION_GZIP) ? "yes" : "no",
+           io_compression_supported(COMPRESSION_ZSTD) ? "yes" : "no");
 }
 
 /* Print usage information */
@@ -258,11 +249,18 @@ void print_usage(const char *progname) {
     printf("  -d, --daily         Show daily summary\n");
     printf("  -w, --weekly        Show weekly summary\n");
     printf("  -m, --monthly       Show monthly summary\n");
+    printf("  --cooccurrence      Show time shared by each pair of tags\n");
+    printf("  --dedupe-overlaps   Count overlapping time once in -d/-w/-m summaries\n");
+    printf("  --overlaps          List periods covered by more than one entry\n");
+    printf("  --gaps              List idle periods within each day\n");
+    printf("  --heatmap           Show minutes by weekday and hour of day\n");
+    printf("  --heatmap-slot MIN  Heatmap slot length: 15, 30, 60 [default: 60]\n");
     printf("  -v, --verbose       Verbose output\n");
     printf("  --from DATE         Filter entries from DATE (YYYY-MM-DD)\n");
     printf("  --to DATE           Filter entries to DATE (YYYY-MM-DD)\n");
     printf("  --tag TAG           Filter entries by TAG (without #)\n");
     printf("  --sort-tags METHOD  Sort tags by: alpha, time, count [default: alpha]\n");
+    printf("  --top N             Show only the N tags with the most time (or entries)\n");
     printf("\n");
     printf("Directory scanning:\n");
     printf("  -S, --scan PATH     Scan directory for time log files\n");
@@ -271,30 +269,74 @@ void print_usage(const char *progname) {
     printf("  --date-from-path    Extract dates from directory paths\n");
     printf("  --include PATTERN   Include only files matching pattern\n");
     printf("  --exclude PATTERN   Exclude files matching pattern\n");
+    printf("  --no-follow-symlinks Skip symbolic links while scanning\n");
+    printf("  --max-file-size SIZE Skip files larger than SIZE (K/M/G) [default: no limit]\n");
     printf("\n");
     printf("Database operations:\n");
-    printf("  --db [PATH]         Use SQLite database (default: ~/.summa/summa.db)\n");
+    printf("  --db [PATH]         Use SQLite database (default: ~/.summa/summa.db);\n");
+    printf("                      repeat to report on several databases\n");
     printf("  --import            Import parsed entries into database\n");
+    printf("  --search TEXT       Entries whose description contains all words of TEXT\n");
     printf("  --db-stats          Show database statistics\n");
     printf("  --db-vacuum         Optimize database storage\n");
-    printf("  --db-backup PATH    Backup database to PATH\n");
+    printf("  --db-rebuild-rollups  Recompute the report totals from the entries\n");
+    printf("  --db-rebuild-search Create or refill the full-text search index\n");
+    printf("  --db-backup PATH    Backup database to PATH, a few pages at a time\n");
+    printf("  --db-backup-step N  Pages copied per backup step [default: 1024]\n");
+    printf("  --db-backup-compact Write the backup with VACUUM INTO (compacted)\n");
+    printf("  --serve SOCKET      Answer report requests on a Unix socket\n");
+    printf("  --db-profile NAME   Tuning: interactive, bulk, safe [default: interactive]\n");
     printf("\n");
     printf("If FILE is omitted, reads from stdin\n");
 }
 
-/* Print text summary */
-void print_summary(logfile_t *file, tag_sort_t sort_mode) {
-    if (!file || file->count == 0) return;
+/* FNV-1a hash of a tag name, for the summary index */
+static unsigned int tag_hash(const char *tag) {
+    unsigned int hash = 2166136261u;
+    for (; *tag; tag++) {
+        hash ^= (unsigned char)*tag;
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
-    printf("=== TIME LOG SUMMARY ===\n");
-    printf("Total entries: %d\n", file->count);
-    printf("\n");
+/* Double the open-addressed tag index and re-insert every summary */
+static bool grow_tag_index(int **index, int *index_size,
+                           const tag_summary_t *summaries, int tag_count) {
+    int size = *index_size * 2;
+    int *grown = malloc(sizeof(int) * size);
+    if (!grown) return false;
+    for (int i = 0; i < size; i++) grown[i] = -1;
+    for (int i = 0; i < tag_count; i++) {
+        unsigned int slot = tag_hash(summaries[i].tag) & (size - 1);
+        while (grown[slot] >= 0) slot = (slot + 1) & (size - 1);
+        grown[slot] = i;
+    }
+    free(*index);
+    *index = grown;
+    *index_size = size;
+    return true;
+}
 
-    /* Calculate tag summaries */
+/* Print text summary; top > 0 keeps only that many tags */
+void print_summary(logfile_t *file, tag_sort_t sort_mode, int top) {
+    if (!file || file->count == 0) return;
+
+    /* Calculate tag summaries, finding each through an index kept at
+     * most half full */
     int summary_capacity = 100;  /* Start with space for 100 tags */
     tag_summary_t *summaries = malloc(sizeof(tag_summary_t) * summary_capacity);
+    int index_size = 256;
+    int *index = malloc(sizeof(int) * index_size);
     int tag_count = 0;
     int total_minutes = 0;
+    if (!summaries || !index) {
+        fprintf(stderr, "Error: Failed to allocate tag summaries\n");
+        free(summaries);
+        free(index);
+        return;
+    }
+    for (int i = 0; i < index_size; i++) index[i] = -1;
 
     for (int i = 0; i < file->count; i++) {
         logline_t *entry = file->entries[i];
@@ -304,14 +346,18 @@ void print_summary(logfile_t *file, tag_sort_t sort_mode) {
             for (int j = 0; j < entry->tags->count; j++) {
                 char *tag = entry->tags->tags[j];
 
+                if (tag_count >= index_size / 2 &&
+                    !grow_tag_index(&index, &index_size, summaries, tag_count)) {
+                    fprintf(stderr, "Error: Failed to expand tag index\n");
+                    break;
+                }
+
                 /* Find or create tag summary */
-                int tag_idx = -1;
-                for (int k = 0; k < tag_count; k++) {
-                    if (strcmp(summaries[k].tag, tag) == 0) {
-                        tag_idx = k;
-                        break;
-                    }
+                unsigned int slot = tag_hash(tag) & (index_size - 1);
+                while (index[slot] >= 0 && strcmp(summaries[index[slot]].tag, tag) != 0) {
+                    slot = (slot + 1) & (index_size - 1);
                 }
+                int tag_idx = index[slot];
 
                 if (tag_idx == -1) {
                     /* New tag - check if we need to grow the array */
@@ -331,6 +377,7 @@ void print_summary(logfile_t *file, tag_sort_t sort_mode) {
                     }
 
                     tag_idx = tag_count++;
+                    index[slot] = tag_idx;
                     summaries[tag_idx].tag = strdup(tag);
                     summaries[tag_idx].total_minutes = 0;
                     summaries[tag_idx].entry_count = 0;
@@ -341,36 +388,94 @@ void print_summary(logfile_t *file, tag_sort_t sort_mode) {
             }
         }
     }
+    free(index);
+
+    print_tag_summary(stdout, summaries, tag_count, file->count, total_minutes, sort_mode, top);
+
+    for (int i = 0; i < tag_count; i++) {
+        free(summaries[i].tag);
+    }
+    free(summaries);
+}
+
+/* Restore the max-heap property below heap[i] */
+static void sift_down_tag(tag_summary_t *heap, int size, int i,
+                          int (*compare)(const void *, const void *)) {
+    for (;;) {
+        int largest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < size && compare(&heap[left], &heap[largest]) > 0) largest = left;
+        if (right < size && compare(&heap[right], &heap[largest]) > 0) largest = right;
+        if (largest == i) return;
+        tag_summary_t swap = heap[i];
+        heap[i] = heap[largest];
+        heap[largest] = swap;
+        i = largest;
+    }
+}
+
+/* Move the first top summaries under compare to the front, unordered.
+ * The front is a heap whose root is the weakest tag kept, so each other
+ * tag costs one comparison unless it displaces the root. */
+static void select_top_tags(tag_summary_t *summaries, int tag_count, int top,
+                            int (*compare)(const void *, const void *)) {
+    for (int i = top / 2 - 1; i >= 0; i--) {
+        sift_down_tag(summaries, top, i, compare);
+    }
+    for (int i = top; i < tag_count; i++) {
+        if (compare(&summaries[i], &summaries[0]) < 0) {
+            tag_summary_t swap = summaries[0];
+            summaries[0] = summaries[i];
+            summaries[i] = swap;
+            sift_down_tag(summaries, top, 0, compare);
+        }
+    }
+}
+
+/* Print tag totals; reorders summaries in place. With top > 0 only the
+ * first top tags are printed, ranked by time unless sorting by count. */
+void print_tag_summary(FILE *out, tag_summary_t *summaries, int tag_count,
+                       int entry_count, int total_minutes, tag_sort_t sort_mode, int top) {
+    fprintf(out, "=== TIME LOG SUMMARY ===\n");
+    fprintf(out, "Total entries: %d\n", entry_count);
+    fprintf(out, "\n");
+
+    if (top > 0 && sort_mode == SORT_ALPHA) sort_mode = SORT_TIME;
 
     /* Sort tag summaries based on sort mode */
+    int (*compare)(const void *, const void *);
     switch (sort_mode) {
         case SORT_TIME:
-            qsort(summaries, tag_count, sizeof(tag_summary_t), compare_tags_by_time);
+            compare = compare_tags_by_time;
             break;
         case SORT_COUNT:
-            qsort(summaries, tag_count, sizeof(tag_summary_t), compare_tags_by_count);
+            compare = compare_tags_by_count;
             break;
         case SORT_ALPHA:
         default:
-            qsort(summaries, tag_count, sizeof(tag_summary_t), compare_tags_alphabetical);
+            compare = compare_tags_alphabetical;
             break;
     }
+    if (top > 0 && tag_count > top) {
+        select_top_tags(summaries, tag_count, top, compare);
+        tag_count = top;
+    }
+    if (tag_count > 1) {
+        qsort(summaries, tag_count, sizeof(tag_summary_t), compare);
+    }
 
-    printf("Time by tag:\n");
+    fprintf(out, "Time by tag:\n");
     for (int i = 0; i < tag_count; i++) {
-        printf("  #%-19s: %2dh %02dm (%d entries)\n",
-               summaries[i].tag,
-               summaries[i].total_minutes / 60,
-               summaries[i].total_minutes % 60,
-               summaries[i].entry_count);
-        free(summaries[i].tag);
+        fprintf(out, "  #%-19s: %2dh %02dm (%d entries)\n",
+                summaries[i].tag,
+                summaries[i].total_minutes / 60,
+                summaries[i].total_minutes % 60,
+                summaries[i].entry_count);
     }
 
-    /* Free the dynamically allocated summaries array */
-    free(summaries);
-
-    printf("\nTotal tracked time: %dh %02dm\n",
-           total_minutes / 60, total_minutes % 60);
+    fprintf(out, "\nTotal tracked time: %dh %02dm\n",
+            total_minutes / 60, total_minutes % 60);
 }
 
 /* Calculate ISO week number (Monday as first day of week) */
@@ -414,8 +519,6 @@ void print_daily_summary(logfile_t *file) {
         return;
     }
 
-    printf("=== DAILY SUMMARY ===\n\n");
-
     /* Dynamic array for daily summaries */
     int day_capacity = 10;
     daily_summary_t *days = malloc(sizeof(daily_summary_t) * day_capacity);
@@ -466,34 +569,40 @@ void print_daily_summary(logfile_t *file) {
     /* Sort daily summaries by date */
     qsort(days, day_count, sizeof(daily_summary_t), compare_daily_summaries);
 
+    print_daily_rows(stdout, days, day_count);
+
+    free(days);
+}
+
+/* Print daily totals, already in date order */
+void print_daily_rows(FILE *out, const daily_summary_t *days, int day_count) {
+    fprintf(out, "=== DAILY SUMMARY ===\n\n");
+
     /* Print daily summaries */
     int grand_total_minutes = 0;
     int grand_total_entries = 0;
 
     for (int i = 0; i < day_count; i++) {
-        printf("%04d-%02d-%02d: %3dh %02dm (%d entries)\n",
-               days[i].date.year, days[i].date.month, days[i].date.day,
-               days[i].total_minutes / 60,
-               days[i].total_minutes % 60,
-               days[i].entry_count);
+        fprintf(out, "%04d-%02d-%02d: %3dh %02dm (%d entries)\n",
+                days[i].date.year, days[i].date.month, days[i].date.day,
+                days[i].total_minutes / 60,
+                days[i].total_minutes % 60,
+                days[i].entry_count);
 
         grand_total_minutes += days[i].total_minutes;
         grand_total_entries += days[i].entry_count;
     }
 
-    printf("\n");
-    printf("Total days: %d\n", day_count);
-    printf("Total entries: %d\n", grand_total_entries);
-    printf("Total time: %dh %02dm\n",
-           grand_total_minutes / 60, grand_total_minutes % 60);
+    fprintf(out, "\n");
+    fprintf(out, "Total days: %d\n", day_count);
+    fprintf(out, "Total entries: %d\n", grand_total_entries);
+    fprintf(out, "Total time: %dh %02dm\n",
+            grand_total_minutes / 60, grand_total_minutes % 60);
     if (day_count > 0) {
-        printf("Average per day: %dh %02dm\n",
-               (grand_total_minutes / day_count) / 60,
-               (grand_total_minutes / day_count) % 60);
+        fprintf(out, "Average per day: %dh %02dm\n",
+                (grand_total_minutes / day_count) / 60,
+                (grand_total_minutes / day_count) % 60);
     }
-
-    /* Free memory */
-    free(days);
 }
 
 /* Print weekly summary */
@@ -503,32 +612,22 @@ void print_weekly_summary(logfile_t *file) {
         return;
     }
 
-    printf("=== WEEKLY SUMMARY ===\n\n");
-
-    /* Structure to hold weekly data */
-    typedef struct {
-        int year;
-        int week;
-        int total_minutes;
-        int entry_count;
-        date_t first_day;
-        date_t last_day;
-    } weekly_summary_t;
-
-    /* Dynamic array for weekly summaries */
+    /* Dynamic array for weekly summaries, keyed by year and Monday */
     int week_capacity = 10;
     weekly_summary_t *weeks = malloc(sizeof(weekly_summary_t) * week_capacity);
+    int *week_mondays = malloc(sizeof(int) * week_capacity);
     int week_count = 0;
 
     /* Aggregate by week */
     for (int i = 0; i < file->count; i++) {
         logline_t *entry = file->entries[i];
-        int week_num = get_iso_week(entry->date.year, entry->date.month, entry->date.day);
+        int days = date_to_days(entry->date);
+        int monday = days - ((days % 7 + 10) % 7);  /* 1970-01-01 was a Thursday */
 
         /* Find or create week entry */
         int week_idx = -1;
         for (int j = 0; j < week_count; j++) {
-            if (weeks[j].year == entry->date.year && weeks[j].week == week_num) {
+            if (weeks[j].year == entry->date.year && week_mondays[j] == monday) {
                 week_idx = j;
                 break;
             }
@@ -544,16 +643,19 @@ void print_weekly_summary(logfile_t *file) {
                 }
                 week_capacity *= 2;
                 weekly_summary_t *new_weeks = realloc(weeks, sizeof(weekly_summary_t) * week_capacity);
-                if (!new_weeks) {
+                int *new_mondays = realloc(week_mondays, sizeof(int) * week_capacity);
+                if (new_weeks) weeks = new_weeks;
+                if (new_mondays) week_mondays = new_mondays;
+                if (!new_weeks || !new_mondays) {
                     fprintf(stderr, "Error: Failed to expand weekly summaries\n");
                     break;  /* Skip this week */
                 }
-                weeks = new_weeks;
             }
 
             week_idx = week_count++;
+            week_mondays[week_idx] = monday;
             weeks[week_idx].year = entry->date.year;
-            weeks[week_idx].week = week_num;
+            weeks[week_idx].week = get_iso_week(entry->date.year, entry->date.month, entry->date.day);
             weeks[week_idx].total_minutes = 0;
             weeks[week_idx].entry_count = 0;
             weeks[week_idx].first_day = entry->date;
@@ -572,36 +674,94 @@ void print_weekly_summary(logfile_t *file) {
         }
     }
 
+    print_weekly_rows(stdout, weeks, week_count);
+
+    free(weeks);
+    free(week_mondays);
+}
+
+/* Print weekly totals */
+void print_weekly_rows(FILE *out, const weekly_summary_t *weeks, int week_count) {
+    fprintf(out, "=== WEEKLY SUMMARY ===\n\n");
+
     /* Print weekly summaries */
     int grand_total_minutes = 0;
     int grand_total_entries = 0;
 
     for (int i = 0; i < week_count; i++) {
-        printf("%04d Week %02d (%04d-%02d-%02d to %04d-%02d-%02d): %3dh %02dm (%d entries)\n",
-               weeks[i].year, weeks[i].week,
-               weeks[i].first_day.year, weeks[i].first_day.month, weeks[i].first_day.day,
-               weeks[i].last_day.year, weeks[i].last_day.month, weeks[i].last_day.day,
-               weeks[i].total_minutes / 60,
-               weeks[i].total_minutes % 60,
-               weeks[i].entry_count);
+        fprintf(out, "%04d Week %02d (%04d-%02d-%02d to %04d-%02d-%02d): %3dh %02dm (%d entries)\n",
+                weeks[i].year, weeks[i].week,
+                weeks[i].first_day.year, weeks[i].first_day.month, weeks[i].first_day.day,
+                weeks[i].last_day.year, weeks[i].last_day.month, weeks[i].last_day.day,
+                weeks[i].total_minutes / 60,
+                weeks[i].total_minutes % 60,
+                weeks[i].entry_count);
 
         grand_total_minutes += weeks[i].total_minutes;
         grand_total_entries += weeks[i].entry_count;
     }
 
-    printf("\n");
-    printf("Total weeks: %d\n", week_count);
-    printf("Total entries: %d\n", grand_total_entries);
-    printf("Total time: %dh %02dm\n",
-           grand_total_minutes / 60, grand_total_minutes % 60);
+    fprintf(out, "\n");
+    fprintf(out, "Total weeks: %d\n", week_count);
+    fprintf(out, "Total entries: %d\n", grand_total_entries);
+    fprintf(out, "Total time: %dh %02dm\n",
+            grand_total_minutes / 60, grand_total_minutes % 60);
     if (week_count > 0) {
-        printf("Average per week: %dh %02dm\n",
-               (grand_total_minutes / week_count) / 60,
-               (grand_total_minutes / week_count) % 60);
+        fprintf(out, "Average per week: %dh %02dm\n",
+                (grand_total_minutes / week_count) / 60,
+                (grand_total_minutes / week_count) % 60);
     }
+}
 
-    /* Free memory */
-    free(weeks);
+/* Group daily rows, in date order, into Monday-based weeks split at year
+ * boundaries, as db_get_weekly_summary groups them */
+weekly_summary_t* weeks_from_days(const daily_summary_t *days, int day_count, int *count) {
+    *count = 0;
+    weekly_summary_t *weeks = day_count > 0 ? malloc(sizeof(weekly_summary_t) * day_count) : NULL;
+    if (!weeks) return NULL;
+
+    int last_monday = 0;
+    for (int i = 0; i < day_count; i++) {
+        int day = date_to_days(days[i].date);
+        int monday = day - ((day % 7 + 10) % 7);  /* 1970-01-01 was a Thursday */
+        weekly_summary_t *week = *count > 0 ? &weeks[*count - 1] : NULL;
+        if (!week || week->year != days[i].date.year || monday != last_monday) {
+            week = &weeks[(*count)++];
+            week->year = days[i].date.year;
+            week->week = get_iso_week(days[i].date.year, days[i].date.month, days[i].date.day);
+            week->first_day = days[i].date;
+            week->total_minutes = 0;
+            week->entry_count = 0;
+            last_monday = monday;
+        }
+        week->last_day = days[i].date;
+        week->total_minutes += days[i].total_minutes;
+        week->entry_count += days[i].entry_count;
+    }
+    return weeks;
+}
+
+/* Group daily rows, in date order, into calendar months */
+monthly_summary_t* months_from_days(const daily_summary_t *days, int day_count, int *count) {
+    *count = 0;
+    monthly_summary_t *months = day_count > 0 ? malloc(sizeof(monthly_summary_t) * day_count) : NULL;
+    if (!months) return NULL;
+
+    for (int i = 0; i < day_count; i++) {
+        monthly_summary_t *month = *count > 0 ? &months[*count - 1] : NULL;
+        if (!month || month->year != days[i].date.year || month->month != days[i].date.month) {
+            month = &months[(*count)++];
+            month->year = days[i].date.year;
+            month->month = days[i].date.month;
+            month->total_minutes = 0;
+            month->entry_count = 0;
+            month->days_with_entries = 0;
+        }
+        month->total_minutes += days[i].total_minutes;
+        month->entry_count += days[i].entry_count;
+        month->days_with_entries++;
+    }
+    return months;
 }
 
 /* Print monthly summary */
@@ -611,17 +771,6 @@ void print_monthly_summary(logfile_t *file) {
         return;
     }
 
-    printf("=== MONTHLY SUMMARY ===\n\n");
-
-    /* Structure to hold monthly data */
-    typedef struct {
-        int year;
-        int month;
-        int total_minutes;
-        int entry_count;
-        int days_with_entries;
-    } monthly_summary_t;
-
     /* Dynamic array for monthly summaries */
     int month_capacity = 10;
     monthly_summary_t *months = malloc(sizeof(monthly_summary_t) * month_capacity);
@@ -713,6 +862,16 @@ void print_monthly_summary(logfile_t *file) {
         }
     }
 
+    print_monthly_rows(stdout, months, month_count);
+
+    free(months);
+    free(day_tracker);
+}
+
+/* Print monthly totals */
+void print_monthly_rows(FILE *out, const monthly_summary_t *months, int month_count) {
+    fprintf(out, "=== MONTHLY SUMMARY ===\n\n");
+
     /* Print monthly summaries */
     int grand_total_minutes = 0;
     int grand_total_entries = 0;
@@ -724,127 +883,663 @@ void print_monthly_summary(logfile_t *file) {
     };
 
     for (int i = 0; i < month_count; i++) {
-        printf("%04d %s: %3dh %02dm (%d entries across %d days)\n",
-               months[i].year,
-               month_names[months[i].month - 1],
-               months[i].total_minutes / 60,
-               months[i].total_minutes % 60,
-               months[i].entry_count,
-               months[i].days_with_entries);
+        fprintf(out, "%04d %s: %3dh %02dm (%d entries across %d days)\n",
+                months[i].year,
+                month_names[months[i].month - 1],
+                months[i].total_minutes / 60,
+                months[i].total_minutes % 60,
+                months[i].entry_count,
+                months[i].days_with_entries);
 
         grand_total_minutes += months[i].total_minutes;
         grand_total_entries += months[i].entry_count;
         grand_total_days += months[i].days_with_entries;
     }
 
-    printf("\n");
-    printf("Total months: %d\n", month_count);
-    printf("Total days with entries: %d\n", grand_total_days);
-    printf("Total entries: %d\n", grand_total_entries);
-    printf("Total time: %dh %02dm\n",
-           grand_total_minutes / 60, grand_total_minutes % 60);
+    fprintf(out, "\n");
+    fprintf(out, "Total months: %d\n", month_count);
+    fprintf(out, "Total days with entries: %d\n", grand_total_days);
+    fprintf(out, "Total entries: %d\n", grand_total_entries);
+    fprintf(out, "Total time: %dh %02dm\n",
+            grand_total_minutes / 60, grand_total_minutes % 60);
     if (month_count > 0) {
-        printf("Average per month: %dh %02dm\n",
-               (grand_total_minutes / month_count) / 60,
-               (grand_total_minutes / month_count) % 60);
+        fprintf(out, "Average per month: %dh %02dm\n",
+                (grand_total_minutes / month_count) / 60,
+                (grand_total_minutes / month_count) % 60);
     }
     if (grand_total_days > 0) {
-        printf("Average per working day: %dh %02dm\n",
-               (grand_total_minutes / grand_total_days) / 60,
-               (grand_total_minutes / grand_total_days) % 60);
+        fprintf(out, "Average per working day: %dh %02dm\n",
+                (grand_total_minutes / grand_total_days) / 60,
+                (grand_total_minutes / grand_total_days) % 60);
     }
-
-    /* Free memory */
-    free(months);
-    free(day_tracker);
 }
 
 /* Print CSV format */
+void print_csv_header(FILE *out) {
+    fprintf(out, "Date,Start,End,Duration_Minutes,Description,Tags,Percentage\n");
+}
+
+void print_csv_entry(FILE *out, logline_t *entry) {
+    fprintf(out, "%04d-%02d-%02d,%02d:%02d,%02d:%02d,%d,",
+            entry->date.year, entry->date.month, entry->date.day,
+            entry->timespan.start.hour, entry->timespan.start.minute,
+            entry->timespan.end.hour, entry->timespan.end.minute,
+            entry->timespan.duration_minutes);
+
+    if (entry->description) {
+        fprintf(out, "%s", entry->description);
+    }
+    fprintf(out, ",");
+
+    if (entry->tags) {
+        for (int j = 0; j < entry->tags->count; j++) {
+            if (j > 0) fprintf(out, ";");
+            fprintf(out, "#%s", entry->tags->tags[j]);
+        }
+    }
+    fprintf(out, ",");
+
+    if (entry->percentage > 0) {
+        fprintf(out, "%d", entry->percentage);
+    }
+
+    fprintf(out, "\n");
+}
+
 void print_csv(logfile_t *file) {
-    printf("Date,Start,End,Duration_Minutes,Description,Tags,Percentage\n");
+    print_csv_header(stdout);
 
     for (int i = 0; i < file->count; i++) {
-        logline_t *entry = file->entries[i];
+        print_csv_entry(stdout, file->entries[i]);
+    }
+}
 
-        printf("%04d-%02d-%02d,%02d:%02d,%02d:%02d,%d,",
-               entry->date.year, entry->date.month, entry->date.day,
-               entry->timespan.start.hour, entry->timespan.start.minute,
-               entry->timespan.end.hour, entry->timespan.end.minute,
-               entry->timespan.duration_minutes);
+/* Print JSON format */
+/* Print text as a JSON string */
+static void print_json_string(FILE *out, const char *text) {
+    fprintf(out, "\"");
+    for (const char *p = text; *p; p++) {
+        if (*p == '"') fprintf(out, "\\\"");
+        else if (*p == '\\') fprintf(out, "\\\\");
+        else fputc(*p, out);
+    }
+    fprintf(out, "\"");
+}
 
+/* Print entries as JSON; databases, if given, names each entry's source */
+static void print_json_entries(FILE *out, logline_t **entries, int count,
+                               const char **databases) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"total_entries\": %d,\n", count);
+    fprintf(out, "  \"entries\": [\n");
+
+    for (int i = 0; i < count; i++) {
+        logline_t *entry = entries[i];
+
+        fprintf(out, "    {\n");
+        if (databases) {
+            fprintf(out, "      \"database\": ");
+            print_json_string(out, databases[i]);
+            fprintf(out, ",\n");
+        }
+        fprintf(out, "      \"date\": \"%04d-%02d-%02d\",\n",
+                entry->date.year, entry->date.month, entry->date.day);
+        fprintf(out, "      \"start\": \"%02d:%02d\",\n",
+                entry->timespan.start.hour, entry->timespan.start.minute);
+        fprintf(out, "      \"end\": \"%02d:%02d\",\n",
+                entry->timespan.end.hour, entry->timespan.end.minute);
+        fprintf(out, "      \"duration_minutes\": %d,\n", entry->timespan.duration_minutes);
+
+        fprintf(out, "      \"description\": ");
         if (entry->description) {
-            printf("%s", entry->description);
+            print_json_string(out, entry->description);
+        } else {
+            fprintf(out, "null");
         }
-        printf(",");
+        fprintf(out, ",\n");
 
+        fprintf(out, "      \"tags\": [");
         if (entry->tags) {
             for (int j = 0; j < entry->tags->count; j++) {
-                if (j > 0) printf(";");
-                printf("#%s", entry->tags->tags[j]);
+                if (j > 0) fprintf(out, ", ");
+                fprintf(out, "\"#%s\"", entry->tags->tags[j]);
             }
         }
-        printf(",");
+        fprintf(out, "]");
 
         if (entry->percentage > 0) {
-            printf("%d", entry->percentage);
+            fprintf(out, ",\n      \"percentage\": %d", entry->percentage);
         }
 
-        printf("\n");
+        fprintf(out, "\n    }");
+        if (i < count - 1) fprintf(out, ",");
+        fprintf(out, "\n");
     }
+
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
 }
 
-/* Print JSON format */
-void print_json(logfile_t *file) {
-    printf("{\n");
-    printf("  \"total_entries\": %d,\n", file->count);
-    printf("  \"entries\": [\n");
+void print_json(FILE *out, logfile_t *file) {
+    print_json_entries(out, file->entries, file->count, NULL);
+}
 
-    for (int i = 0; i < file->count; i++) {
-        logline_t *entry = file->entries[i];
+/* Print tag pairs by shared time as text, CSV or JSON */
+static void print_cooccurrence(FILE *out, const cooccur_t *c, output_format_t format,
+                               tag_sort_t sort_mode, int top) {
+    int pair_count = 0;
+    tag_pair_t *pairs = cooccur_pairs(c, sort_mode, top, &pair_count);
+
+    if (format == FORMAT_CSV) {
+        fprintf(out, "Tag_A,Tag_B,Duration_Minutes,Entries\n");
+        for (int i = 0; i < pair_count; i++) {
+            fprintf(out, "#%s,#%s,%d,%d\n", pairs[i].tag_a, pairs[i].tag_b,
+                    pairs[i].total_minutes, pairs[i].entry_count);
+        }
+    } else if (format == FORMAT_JSON) {
+        fprintf(out, "{\n");
+        fprintf(out, "  \"entries_with_pairs\": %d,\n", cooccur_entry_count(c));
+        fprintf(out, "  \"pairs\": [\n");
+        for (int i = 0; i < pair_count; i++) {
+            fprintf(out, "    {\n");
+            fprintf(out, "      \"tags\": [\"#%s\", \"#%s\"],\n", pairs[i].tag_a, pairs[i].tag_b);
+            fprintf(out, "      \"duration_minutes\": %d,\n", pairs[i].total_minutes);
+            fprintf(out, "      \"entries\": %d\n", pairs[i].entry_count);
+            fprintf(out, "    }%s\n", i < pair_count - 1 ? "," : "");
+        }
+        fprintf(out, "  ]\n");
+        fprintf(out, "}\n");
+    } else {
+        fprintf(out, "=== TAG CO-OCCURRENCE ===\n");
+        fprintf(out, "Entries with several tags: %d\n", cooccur_entry_count(c));
+        fprintf(out, "\n");
+        fprintf(out, "Time by tag pair:\n");
+        for (int i = 0; i < pair_count; i++) {
+            char label[128];
+            snprintf(label, sizeof(label), "#%s + #%s", pairs[i].tag_a, pairs[i].tag_b);
+            fprintf(out, "  %-30s: %2dh %02dm (%d entries)\n", label,
+                    pairs[i].total_minutes / 60, pairs[i].total_minutes % 60,
+                    pairs[i].entry_count);
+        }
+    }
+    free(pairs);
+}
 
-        printf("    {\n");
-        printf("      \"date\": \"%04d-%02d-%02d\",\n",
-               entry->date.year, entry->date.month, entry->date.day);
-        printf("      \"start\": \"%02d:%02d\",\n",
-               entry->timespan.start.hour, entry->timespan.start.minute);
-        printf("      \"end\": \"%02d:%02d\",\n",
-               entry->timespan.end.hour, entry->timespan.end.minute);
-        printf("      \"duration_minutes\": %d,\n", entry->timespan.duration_minutes);
+/* Tag pairs of the entries in a logfile */
+static void print_file_cooccurrence(logfile_t *file, output_format_t format,
+                                    tag_sort_t sort_mode, int top) {
+    cooccur_t *c = cooccur_create();
+    if (!c) {
+        fprintf(stderr, "Error: Failed to allocate tag pairs\n");
+        return;
+    }
+    bool counted = true;
+    for (int i = 0; i < file->count && counted; i++) {
+        counted = cooccur_add_entry(c, file->entries[i]);
+    }
+    if (counted) print_cooccurrence(stdout, c, format, sort_mode, top);
+    cooccur_free(c);
+}
 
-        printf("      \"description\": ");
-        if (entry->description) {
-            printf("\"");
-            for (char *p = entry->description; *p; p++) {
-                if (*p == '"') printf("\\\"");
-                else if (*p == '\\') printf("\\\\");
-                else printf("%c", *p);
+/* db_query_tag_sets callback: count the pairs of one entry */
+typedef struct {
+    cooccur_t *pairs;
+    bool failed;
+} tag_sets_t;
+
+static bool add_tag_set(const char *tags, int minutes, void *ctx) {
+    tag_sets_t *sets = ctx;
+    sets->failed = !cooccur_add_names(sets->pairs, tags, minutes);
+    return !sets->failed;
+}
+
+/* Tag pairs across every database of the set */
+static bool print_db_cooccurrence(FILE *out, const db_set_t *set, const db_report_t *report) {
+    tag_sets_t sets = { cooccur_create(), false };
+    if (!sets.pairs) {
+        fprintf(stderr, "Error: Failed to allocate tag pairs\n");
+        return false;
+    }
+    for (int i = 0; i < set->count && !sets.failed; i++) {
+        if (db_query_tag_sets(set->dbs[i], &report->query, add_tag_set, &sets) < 0) {
+            sets.failed = true;
+        }
+    }
+    if (!sets.failed) print_cooccurrence(out, sets.pairs, report->format, report->sort, report->top);
+    cooccur_free(sets.pairs);
+    return !sets.failed;
+}
+
+/* Print the runs of set minutes in one bitmap per day (overlaps) or the
+ * clear runs between each day's first and last covered minute (gaps) */
+static void print_minute_periods(FILE *out, const day_minutes_t *days, int day_count,
+                                 bool gaps, output_format_t format) {
+    const char *name = gaps ? "gaps" : "overlaps";
+    int total_minutes = 0;
+    int total_days = 0;
+    int periods = 0;
+
+    if (format == FORMAT_CSV) {
+        fprintf(out, "Date,Start,End,Duration_Minutes\n");
+    } else if (format == FORMAT_JSON) {
+        fprintf(out, "{\n");
+        fprintf(out, "  \"%s\": [", name);
+    } else {
+        fprintf(out, "=== %s ===\n\n", gaps ? "GAPS" : "OVERLAPS");
+    }
+
+    for (int i = 0; i < day_count; i++) {
+        const uint64_t *bits = gaps ? days[i].covered : days[i].overlap;
+        int from = 0, limit = DAY_MINUTES;
+        /* Idle time only counts between the day's first and last work */
+        if (gaps && !minutes_span(bits, &from, &limit)) continue;
+
+        date_t date = days_to_date(days[i].day);
+        int start, end;
+        bool counted = false;
+        for (int at = from; minutes_next_run(bits, !gaps, at, limit, &start, &end); at = end) {
+            int minutes = end - start;
+            if (format == FORMAT_CSV) {
+                fprintf(out, "%04d-%02d-%02d,%02d:%02d,%02d:%02d,%d\n",
+                        date.year, date.month, date.day,
+                        start / 60, start % 60, end / 60, end % 60, minutes);
+            } else if (format == FORMAT_JSON) {
+                fprintf(out, "%s\n    {\n", periods > 0 ? "," : "");
+                fprintf(out, "      \"date\": \"%04d-%02d-%02d\",\n", date.year, date.month, date.day);
+                fprintf(out, "      \"start\": \"%02d:%02d\",\n", start / 60, start % 60);
+                fprintf(out, "      \"end\": \"%02d:%02d\",\n", end / 60, end % 60);
+                fprintf(out, "      \"duration_minutes\": %d\n", minutes);
+                fprintf(out, "    }");
+            } else {
+                fprintf(out, "%04d-%02d-%02d  %02d:%02d-%02d:%02d  %2dh %02dm\n",
+                        date.year, date.month, date.day,
+                        start / 60, start % 60, end / 60, end % 60,
+                        minutes / 60, minutes % 60);
             }
-            printf("\"");
-        } else {
-            printf("null");
+            total_minutes += minutes;
+            periods++;
+            counted = true;
         }
-        printf(",\n");
+        if (counted) total_days++;
+    }
 
-        printf("      \"tags\": [");
-        if (entry->tags) {
-            for (int j = 0; j < entry->tags->count; j++) {
-                if (j > 0) printf(", ");
-                printf("\"#%s\"", entry->tags->tags[j]);
+    if (format == FORMAT_JSON) {
+        fprintf(out, "%s],\n", periods > 0 ? "\n  " : "");
+        fprintf(out, "  \"total_minutes\": %d\n", total_minutes);
+        fprintf(out, "}\n");
+    } else if (format == FORMAT_TEXT) {
+        if (periods > 0) fprintf(out, "\n");
+        fprintf(out, "Total %s: %dh %02dm on %d days\n", gaps ? "idle" : "overlapping",
+                total_minutes / 60, total_minutes % 60, total_days);
+    }
+}
+
+/* Reports read from minute bitmaps: summaries that count overlapping time
+ * once, overlapping periods, or gaps */
+static void print_minute_report(FILE *out, minute_days_t *m, const db_report_t *report) {
+    int day_count = 0;
+    const day_minutes_t *days = minute_days_sorted(m, &day_count);
+    if (report->overlaps || report->gaps) {
+        print_minute_periods(out, days, day_count, !report->overlaps, report->format);
+        return;
+    }
+
+    daily_summary_t *rows = malloc(sizeof(daily_summary_t) * (day_count ? day_count : 1));
+    if (!rows) {
+        fprintf(stderr, "Error: Failed to allocate daily summaries\n");
+        return;
+    }
+    long long logged = 0, covered = 0;
+    for (int i = 0; i < day_count; i++) {
+        rows[i].date = days_to_date(days[i].day);
+        rows[i].total_minutes = minutes_count(days[i].covered);
+        rows[i].entry_count = days[i].entry_count;
+        logged += days[i].logged_minutes;
+        covered += rows[i].total_minutes;
+    }
+
+    int count = 0;
+    if (report->weekly) {
+        weekly_summary_t *weeks = weeks_from_days(rows, day_count, &count);
+        print_weekly_rows(out, weeks, count);
+        free(weeks);
+    } else if (report->monthly) {
+        monthly_summary_t *months = months_from_days(rows, day_count, &count);
+        print_monthly_rows(out, months, count);
+        free(months);
+    } else {
+        print_daily_rows(out, rows, day_count);
+    }
+    fprintf(out, "Overlapping time counted once: %lldh %02lldm removed\n",
+            (logged - covered) / 60, (logged - covered) % 60);
+    free(rows);
+}
+
+/* Minute bitmap report over the entries of a logfile */
+static void print_file_minutes(logfile_t *file, const db_report_t *report) {
+    minute_days_t *m = minute_days_create();
+    if (!m) {
+        fprintf(stderr, "Error: Failed to allocate minute bitmaps\n");
+        return;
+    }
+    bool added = true;
+    for (int i = 0; i < file->count && added; i++) {
+        added = minute_days_add_entry(m, file->entries[i]);
+    }
+    if (added) print_minute_report(stdout, m, report);
+    minute_days_free(m);
+}
+
+/* db_query_spans callback: mark one entry */
+typedef struct {
+    minute_days_t *days;
+    bool failed;
+} spans_t;
+
+static bool add_span(int day, int start_minute, int duration, void *ctx) {
+    spans_t *spans = ctx;
+    spans->failed = !minute_days_add(spans->days, day, start_minute, duration);
+    return !spans->failed;
+}
+
+/* Minute bitmap report across every database of the set; a minute logged
+ * in two databases overlaps like one logged twice in one */
+static bool print_db_minutes(FILE *out, const db_set_t *set, const db_report_t *report) {
+    spans_t spans = { minute_days_create(), false };
+    if (!spans.days) {
+        fprintf(stderr, "Error: Failed to allocate minute bitmaps\n");
+        return false;
+    }
+    int rows = 0;
+    for (int i = 0; i < set->count && !spans.failed; i++) {
+        int added = db_query_spans(set->dbs[i], &report->query, add_span, &spans);
+        if (added < 0) spans.failed = true;
+        rows += added;
+    }
+    if (!spans.failed && rows > 0) {
+        print_minute_report(out, spans.days, report);
+    } else if (!spans.failed) {
+        fprintf(out, "No entries found in database\n");
+    }
+    minute_days_free(spans.days);
+    return !spans.failed;
+}
+
+static const char *weekday_names[7] = { "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun" };
+
+/* Print the heatmap with a row per time-of-day slot and a column per
+ * weekday, so 15-minute slots stay readable in a terminal */
+static void print_heatmap(FILE *out, const heatmap_t *h, output_format_t format) {
+    long long day_totals[7] = { 0 };
+    long long total_minutes = 0;
+    for (int d = 0; d < 7; d++) {
+        for (int s = 0; s < h->slot_count; s++) {
+            day_totals[d] += h->minutes[d][s];
+        }
+        total_minutes += day_totals[d];
+    }
+
+    if (format == FORMAT_JSON) {
+        fprintf(out, "{\n");
+        fprintf(out, "  \"slot_minutes\": %d,\n", h->slot_minutes);
+        fprintf(out, "  \"weekdays\": {\n");
+        for (int d = 0; d < 7; d++) {
+            fprintf(out, "    \"%s\": [", weekday_names[d]);
+            for (int s = 0; s < h->slot_count; s++) {
+                fprintf(out, "%s%lld", s > 0 ? ", " : "", h->minutes[d][s]);
             }
+            fprintf(out, "]%s\n", d < 6 ? "," : "");
         }
-        printf("]");
+        fprintf(out, "  },\n");
+        fprintf(out, "  \"total_minutes\": %lld\n", total_minutes);
+        fprintf(out, "}\n");
+        return;
+    }
 
-        if (entry->percentage > 0) {
-            printf(",\n      \"percentage\": %d", entry->percentage);
+    if (format == FORMAT_CSV) {
+        fprintf(out, "Slot");
+        for (int d = 0; d < 7; d++) fprintf(out, ",%s", weekday_names[d]);
+        fprintf(out, "\n");
+    } else {
+        fprintf(out, "=== HEATMAP (minutes per %d-minute slot) ===\n\n", h->slot_minutes);
+        fprintf(out, "Slot ");
+        for (int d = 0; d < 7; d++) fprintf(out, " %7s", weekday_names[d]);
+        fprintf(out, "\n");
+    }
+    for (int s = 0; s < h->slot_count; s++) {
+        int start = s * h->slot_minutes;
+        fprintf(out, "%02d:%02d", start / 60, start % 60);
+        for (int d = 0; d < 7; d++) {
+            if (format == FORMAT_CSV) {
+                fprintf(out, ",%lld", h->minutes[d][s]);
+            } else {
+                fprintf(out, " %7lld", h->minutes[d][s]);
+            }
         }
+        fprintf(out, "\n");
+    }
+    if (format == FORMAT_TEXT) {
+        fprintf(out, "Total");
+        for (int d = 0; d < 7; d++) fprintf(out, " %7lld", day_totals[d]);
+        fprintf(out, "\n\nTotal time: %lldh %02lldm\n", total_minutes / 60, total_minutes % 60);
+    }
+}
 
-        printf("\n    }");
-        if (i < file->count - 1) printf(",");
-        printf("\n");
+/* Heatmap over the entries of a logfile */
+static void print_file_heatmap(logfile_t *file, const db_report_t *report) {
+    heatmap_t *h = malloc(sizeof(heatmap_t));
+    if (!h) {
+        fprintf(stderr, "Error: Failed to allocate heatmap\n");
+        return;
+    }
+    heatmap_init(h, report->heatmap_slot);
+    for (int i = 0; i < file->count; i++) {
+        heatmap_add_entry(h, file->entries[i]);
     }
+    print_heatmap(stdout, h, report->format);
+    free(h);
+}
 
-    printf("  ]\n");
-    printf("}\n");
+/* db_query_spans callback: add one entry to the heatmap */
+static bool add_heatmap_span(int day, int start_minute, int duration, void *ctx) {
+    heatmap_add(ctx, day, start_minute, duration);
+    return true;
+}
+
+/* Heatmap across every database of the set, streamed from the spans
+ * index without loading entries */
+static bool print_db_heatmap(FILE *out, const db_set_t *set, const db_report_t *report) {
+    heatmap_t *h = malloc(sizeof(heatmap_t));
+    if (!h) {
+        fprintf(stderr, "Error: Failed to allocate heatmap\n");
+        return false;
+    }
+    heatmap_init(h, report->heatmap_slot);
+    int rows = 0;
+    bool ok = true;
+    for (int i = 0; i < set->count && ok; i++) {
+        int added = db_query_spans(set->dbs[i], &report->query, add_heatmap_span, h);
+        if (added < 0) ok = false;
+        rows += added;
+    }
+    if (ok && rows > 0) {
+        print_heatmap(out, h, report->format);
+    } else if (ok) {
+        fprintf(out, "No entries found in database\n");
+    }
+    free(h);
+    return ok;
+}
+
+/* db_set_query_each callback: stream entries as CSV rows, led by the
+ * database name when there are several */
+typedef struct {
+    FILE *out;
+    const db_set_t *set;
+    int rows;
+} csv_rows_t;
+
+static bool print_csv_row(logline_t *entry, int db, void *ctx) {
+    csv_rows_t *csv = ctx;
+    bool several = csv->set->count > 1;
+    if (csv->rows++ == 0) {
+        if (several) fprintf(csv->out, "Database,");
+        print_csv_header(csv->out);
+    }
+    if (several) fprintf(csv->out, "%s,", csv->set->names[db]);
+    print_csv_entry(csv->out, entry);
+    return true;
+}
+
+/* db_set_query_each callback: collect entries and their databases */
+typedef struct {
+    logfile_t *entries;
+    const char **databases;
+    int capacity;
+    const db_set_t *set;
+} json_rows_t;
+
+static bool collect_json_row(logline_t *entry, int db, void *ctx) {
+    json_rows_t *json = ctx;
+    if (json->entries->count >= json->capacity) {
+        int capacity = json->capacity ? json->capacity * 2 : 64;
+        const char **grown = realloc(json->databases, sizeof(char *) * capacity);
+        if (!grown) {
+            fprintf(stderr, "Error: Failed to expand entry list\n");
+            return false;
+        }
+        json->databases = grown;
+        json->capacity = capacity;
+    }
+
+    /* The entry is freed after the callback: keep a copy */
+    logline_t *copy = create_logline();
+    *copy = *entry;
+    copy->description = entry->description ? strdup(entry->description) : NULL;
+    copy->raw_line = NULL;
+    copy->tags = create_taglist();
+    for (int i = 0; entry->tags && i < entry->tags->count; i++) {
+        add_tag(copy->tags, entry->tags->tags[i]);
+    }
+    json->databases[json->entries->count] = json->set->names[db];
+    add_entry(json->entries, copy);
+    return true;
+}
+
+/* Print database statistics */
+static bool print_db_stats(FILE *out, const db_set_t *set) {
+    db_stats_t *stats = db_set_get_stats(set);
+    if (!stats) return false;
+
+    fprintf(out, "=== DATABASE STATISTICS ===\n");
+    if (set->count > 1) fprintf(out, "Databases: %d\n", set->count);
+    fprintf(out, "Total entries: %lld\n", stats->total_entries);
+    fprintf(out, "Total files: %d\n", stats->total_files);
+    fprintf(out, "Total tags: %d\n", stats->total_tags);
+    fprintf(out, "Total time: %lldh %lldm\n",
+            stats->total_minutes / 60,
+            stats->total_minutes % 60);
+    if (stats->earliest_date.year > 0) {
+        fprintf(out, "Date range: %04d-%02d-%02d to %04d-%02d-%02d\n",
+                stats->earliest_date.year, stats->earliest_date.month,
+                stats->earliest_date.day,
+                stats->latest_date.year, stats->latest_date.month,
+                stats->latest_date.day);
+    }
+    free(stats);
+    return true;
+}
+
+/* Tag report, followed by each database's share when there are several */
+static int print_db_tag_report(FILE *out, const db_set_t *set, const db_report_t *report) {
+    int rows = 0, total_minutes = 0;
+    int db_entries[DB_SET_MAX], db_minutes[DB_SET_MAX];
+    if (!db_set_get_totals(set, &report->query, &rows, &total_minutes, db_entries, db_minutes) ||
+        rows == 0) {
+        return rows;
+    }
+
+    /* One database ranks and cuts the tags in SQL; merged tags are
+     * ranked by print_tag_summary */
+    int tag_count = 0;
+    tag_summary_t *tags;
+    if (report->top > 0 && set->count == 1) {
+        tag_sort_t order = report->sort == SORT_ALPHA ? SORT_TIME : report->sort;
+        tags = db_get_top_tags(set->dbs[0], &report->query, order, report->top, &tag_count);
+    } else {
+        tags = db_set_get_tag_summary(set, &report->query, &tag_count);
+    }
+    print_tag_summary(out, tags, tag_count, rows, total_minutes, report->sort, report->top);
+    for (int i = 0; i < tag_count; i++) {
+        free(tags[i].tag);
+    }
+    free(tags);
+
+    if (set->count > 1) {
+        fprintf(out, "\nTime by database:\n");
+        for (int i = 0; i < set->count; i++) {
+            fprintf(out, "  %-20s: %2dh %02dm (%d entries)\n",
+                    set->names[i], db_minutes[i] / 60, db_minutes[i] % 60, db_entries[i]);
+        }
+    }
+    return rows;
+}
+
+/* Report from one or more databases. Summaries are aggregated in SQL;
+ * plain CSV streams row by row, and only JSON loads the entries. */
+bool print_db_report(FILE *out, const db_set_t *set, const db_report_t *report) {
+    if (report->stats) return print_db_stats(out, set);
+    if (report->heatmap) return print_db_heatmap(out, set, report);
+    if (report->dedupe_overlaps || report->overlaps || report->gaps) {
+        return print_db_minutes(out, set, report);
+    }
+
+    const query_options_t *query = &report->query;
+    int rows = 0;
+
+    if (report->format == FORMAT_CSV && !report->daily && !report->weekly && !report->monthly &&
+        !report->cooccurrence) {
+        csv_rows_t csv = { out, set, 0 };
+        rows = db_set_query_each(set, query, print_csv_row, &csv);
+        if (rows < 0) return false;
+    } else if (report->daily) {
+        daily_summary_t *days = db_set_get_daily_summary(set, query, &rows);
+        if (rows > 0) print_daily_rows(out, days, rows);
+        free(days);
+    } else if (report->weekly) {
+        weekly_summary_t *weeks = db_set_get_weekly_summary(set, query, &rows);
+        if (rows > 0) print_weekly_rows(out, weeks, rows);
+        free(weeks);
+    } else if (report->monthly) {
+        monthly_summary_t *months = db_set_get_monthly_summary(set, query, &rows);
+        if (rows > 0) print_monthly_rows(out, months, rows);
+        free(months);
+    } else if (report->cooccurrence) {
+        return print_db_cooccurrence(out, set, report);
+    } else if (report->format == FORMAT_TEXT) {
+        rows = print_db_tag_report(out, set, report);
+    } else if (set->count == 1) {
+        logfile_t *entries = db_query_entries(set->dbs[0], query);
+        if (entries) {
+            rows = entries->count;
+            if (rows > 0) print_json(out, entries);
+            free_logfile(entries);
+        }
+    } else {
+        json_rows_t json = { create_logfile(), NULL, 0, set };
+        rows = db_set_query_each(set, query, collect_json_row, &json);
+        if (rows > 0) {
+            print_json_entries(out, json.entries->entries, json.entries->count, json.databases);
+        }
+        free_logfile(json.entries);
+        free(json.databases);
+        if (rows < 0) return false;
+    }
+
+    if (rows == 0) {
+        fprintf(out, "No entries found in database\n");
+    }
+    return true;
 }
 
 /* Two-phase parsing implementation */
@@ -916,6 +1611,55 @@ int validate_date(int year, int month, int day) {
     return 1;
 }
 
+/* Parse a byte count with an optional K, M or G suffix (e.g. 512K, 64M) */
+bool parse_size(const char *text, size_t *size) {
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text || errno != 0 || *text == '-') return false;
+
+    unsigned long long scale = 1;
+    switch (toupper((unsigned char)*end)) {
+        case 'K': scale = 1024ULL; end++; break;
+        case 'M': scale = 1024ULL * 1024; end++; break;
+        case 'G': scale = 1024ULL * 1024 * 1024; end++; break;
+        case '\0': break;
+        default: return false;
+    }
+    if (toupper((unsigned char)*end) == 'B') end++;
+    if (*end != '\0') return false;
+    if (value > SIZE_MAX / scale) return false;
+
+    *size = (size_t)(value * scale);
+    return true;
+}
+
+/* Convert a date to days since 1970-01-01 */
+int date_to_days(date_t date) {
+    int y = date.year - (date.month <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;                                   /* [0, 399] */
+    int doy = (153 * ((date.month + 9) % 12) + 2) / 5 + date.day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;           /* [0, 146096] */
+    return era * 146097 + doe - 719468;
+}
+
+/* Convert days since 1970-01-01 back to a date */
+date_t days_to_date(int days) {
+    days += 719468;
+    int era = (days >= 0 ? days : days - 146096) / 146097;
+    int doe = days - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+
+    date_t date;
+    date.day = doy - (153 * mp + 2) / 5 + 1;
+    date.month = mp < 10 ? mp + 3 : mp - 9;
+    date.year = yoe + era * 400 + (date.month <= 2);
+    return date;
+}
+
 /* Compare two dates. Returns: -1 if d1 < d2, 0 if equal, 1 if d1 > d2 */
 int compare_dates(date_t *d1, date_t *d2) {
     if (d1->year != d2->year) return d1->year < d2->year ? -1 : 1;
@@ -987,6 +1731,11 @@ bool entry_passes_filters(logline_t *entry) {
     return true;
 }
 
+/* True when --from, --to or --tag narrows what the parser keeps */
+bool entry_filters_active(void) {
+    return filter_from.year > 0 || filter_to.year > 0 || filter_tag != NULL;
+}
+
 /* Phase 2: Parse date line "# YYYY-MM-DD" */
 date_t parse_date_line(const char* line, int line_number) {
     date_t date = {0, 0, 0};
@@ -1012,10 +1761,11 @@ date_t parse_date_line(const char* line, int line_number) {
                line_number, date.year, date.month, date.day);
         /* Return current date as fallback */
         time_t now = time(NULL);
-        struct tm *tm = localtime(&now);
-        date.year = tm->tm_year + 1900;
-        date.month = tm->tm_mon + 1;
-        date.day = tm->tm_mday;
+        struct tm tm;
+        localtime_r(&now, &tm);
+        date.year = tm.tm_year + 1900;
+        date.month = tm.tm_mon + 1;
+        date.day = tm.tm_mday;
     }
 
     return date;
@@ -1024,8 +1774,8 @@ date_t parse_date_line(const char* line, int line_number) {
 /* Phase 2: Parse time line "HHMM-HHMM description #tags" */
 logline_t* parse_time_line(const char* line, int line_number) {
     logline_t* entry = create_logline();
-    entry->date = current_date;
     entry->percentage = 0;
+    entry->line_number = line_number;
 
     /* Extract start time */
     int start_hour = (line[0] - '0') * 10 + (line[1] - '0');
@@ -1140,8 +1890,15 @@ logline_t* parse_time_line(const char* line, int line_number) {
     return entry;
 }
 
-/* Main two-phase parsing function */
+/* Main two-phase parsing function, on the global date and logfile */
 int parse_two_phase(FILE* input) {
+    return parse_log(input, &current_date, current_logfile);
+}
+
+/* Parse a log stream into out. *date is the date in effect for entries
+ * before the first header and follows the headers read. Uses no other
+ * shared state, so separate files can be parsed on separate threads. */
+int parse_log(FILE* input, date_t *date, logfile_t *out) {
     char line[4096];
     int line_number = 0;
 
@@ -1159,10 +1916,10 @@ int parse_two_phase(FILE* input) {
 
         switch (type) {
             case LINE_DATE: {
-                current_date = parse_date_line(line, line_number);
+                *date = parse_date_line(line, line_number);
                 if (verbose) {
                     fprintf(stderr, "Line %d: Debug: Parsed date %04d-%02d-%02d\n",
-                           line_number, current_date.year, current_date.month, current_date.day);
+                           line_number, date->year, date->month, date->day);
                 }
                 break;
             }
@@ -1170,6 +1927,7 @@ int parse_two_phase(FILE* input) {
             case LINE_TIME: {
                 logline_t* entry = parse_time_line(line, line_number);
                 if (entry) {
+                    entry->date = *date;
                     if (verbose) {
                         fprintf(stderr, "Line %d: Debug: Parsed time entry %02d:%02d-%02d:%02d\n",
                                line_number, entry->timespan.start.hour, entry->timespan.start.minute,
@@ -1178,7 +1936,7 @@ int parse_two_phase(FILE* input) {
 
                     /* Apply filters before adding */
                     if (entry_passes_filters(entry)) {
-                        add_entry(current_logfile, entry);
+                        add_entry(out, entry);
                     } else {
                         /* Free filtered entry */
                         if (entry->description) free(entry->description);
@@ -1208,33 +1966,73 @@ int parse_two_phase(FILE* input) {
     return 0; /* Success */
 }
 
+/* Backup progress on stderr, one line rewritten in place; ctx keeps the
+ * last remaining count */
+static void print_backup_progress(int remaining, int total, void *ctx) {
+    *(int *)ctx = remaining;
+    if (total <= 0) return;
+
+    int copied = total - remaining;
+    fprintf(stderr, "\rCopied %d of %d pages (%d%%)", copied, total,
+            (int)((long long)copied * 100 / total));
+    if (remaining == 0) fputc('\n', stderr);
+}
+
+/* Free the include/exclude patterns given on the command line */
+static void free_scan_patterns(scan_config_t *config) {
+    for (int i = 0; i < config->include_count; i++) {
+        free(config->include_patterns[i]);
+    }
+    free(config->include_patterns);
+
+    for (int i = 0; i < config->exclude_count; i++) {
+        free(config->exclude_patterns[i]);
+    }
+    free(config->exclude_patterns);
+}
+
 /* Main function */
 int main(int argc, char ** argv) {
     int opt;
     output_format_t format = FORMAT_TEXT;
     tag_sort_t tag_sort = SORT_ALPHA;
+    int top_tags = 0;
     const char *input_file = NULL;
     const char *scan_path = NULL;
     bool show_daily = false;
     bool show_weekly = false;
     bool show_monthly = false;
+    bool show_cooccurrence = false;
+    bool dedupe_overlaps = false;
+    bool show_overlaps = false;
+    bool show_gaps = false;
+    bool show_heatmap = false;
+    int heatmap_slot = 60;
     /* Database options */
     const char *db_path = NULL;
+    const char *db_paths[DB_SET_MAX];    /* Every --db given, in order */
+    int db_path_count = 0;
     bool use_db = false;
     bool db_import = false;
     bool db_stats = false;
     bool db_do_vacuum = false;
+    bool db_do_rebuild_rollups = false;
+    bool db_do_rebuild_search = false;
+    const char *search_text = NULL;
     const char *db_backup_path = NULL;
+    db_backup_options_t backup_options = {0};
+    const char *serve_socket = NULL;
+    db_profile_t db_profile = DB_PROFILE_INTERACTIVE;
 
     /* Scanning options */
     scan_config_t scan_config = {
         .recursive = false,
-        .follow_symlinks = false,
+        .follow_symlinks = true,
         .date_from_filename = false,
         .date_from_path = false,
         .verbose = false,
         .max_depth = 10,
-        .max_file_size = 10 * 1024 * 1024,  /* 10MB */
+        .max_file_size = 0,  /* Unlimited */
         .exclude_patterns = NULL,
         .exclude_count = 0,
         .include_patterns = NULL,
@@ -1256,16 +2054,33 @@ int main(int argc, char ** argv) {
         {"date-from-path", no_argument, 0, 2002},
         {"include", required_argument, 0, 2003},
         {"exclude", required_argument, 0, 2004},
+        {"follow-symlinks", no_argument, 0, 2005},
+        {"no-follow-symlinks", no_argument, 0, 2007},
+        {"max-file-size", required_argument, 0, 2006},
         {"from",    required_argument, 0, 1001},
         {"to",      required_argument, 0, 1002},
         {"tag",     required_argument, 0, 1003},
         {"sort-tags", required_argument, 0, 1004},
+        {"top",     required_argument, 0, 1005},
+        {"cooccurrence", no_argument,  0, 1006},
+        {"dedupe-overlaps", no_argument, 0, 1007},
+        {"overlaps", no_argument,      0, 1008},
+        {"gaps",    no_argument,       0, 1009},
+        {"heatmap", no_argument,       0, 1010},
+        {"heatmap-slot", required_argument, 0, 1011},
         /* Database options */
         {"db",      optional_argument, 0, 3001},
         {"import",  no_argument,       0, 3002},
         {"db-stats", no_argument,      0, 3003},
         {"db-vacuum", no_argument,     0, 3004},
         {"db-backup", required_argument, 0, 3005},
+        {"db-profile", required_argument, 0, 3006},
+        {"db-rebuild-rollups", no_argument, 0, 3007},
+        {"search", required_argument, 0, 3008},
+        {"db-rebuild-search", no_argument, 0, 3009},
+        {"db-backup-step", required_argument, 0, 3010},
+        {"db-backup-compact", no_argument, 0, 3011},
+        {"serve", required_argument, 0, 3012},
         {0, 0, 0, 0}
     };
 
@@ -1339,6 +2154,18 @@ int main(int argc, char ** argv) {
                 scan_config.exclude_patterns = new_exclude_patterns;
                 scan_config.exclude_patterns[scan_config.exclude_count - 1] = strdup(optarg);
                 break;
+            case 2005: /* --follow-symlinks */
+                scan_config.follow_symlinks = true;
+                break;
+            case 2007: /* --no-follow-symlinks */
+                scan_config.follow_symlinks = false;
+                break;
+            case 2006: /* --max-file-size */
+                if (!parse_size(optarg, &scan_config.max_file_size)) {
+                    fprintf(stderr, "Error: Invalid size for --max-file-size (e.g. 512K, 64M, 0 for no limit)\n");
+                    return 1;
+                }
+                break;
             case 1001: /* --from */
                 if (sscanf(optarg, "%d-%d-%d", &filter_from.year, &filter_from.month, &filter_from.day) != 3) {
                     fprintf(stderr, "Error: Invalid date format for --from (use YYYY-MM-DD)\n");
@@ -1375,10 +2202,46 @@ int main(int argc, char ** argv) {
                     return 1;
                 }
                 break;
+            case 1005: { /* --top */
+                char *end;
+                long top = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || top < 1 || top > INT_MAX) {
+                    fprintf(stderr, "Error: Invalid tag count for --top (must be at least 1)\n");
+                    return 1;
+                }
+                top_tags = (int)top;
+                break;
+            }
+            case 1006: /* --cooccurrence */
+                show_cooccurrence = true;
+                break;
+            case 1007: /* --dedupe-overlaps */
+                dedupe_overlaps = true;
+                break;
+            case 1008: /* --overlaps */
+                show_overlaps = true;
+                break;
+            case 1009: /* --gaps */
+                show_gaps = true;
+                break;
+            case 1010: /* --heatmap */
+                show_heatmap = true;
+                break;
+            case 1011: /* --heatmap-slot */
+                if (!heatmap_parse_slot(optarg, &heatmap_slot)) {
+                    fprintf(stderr, "Error: Invalid slot for --heatmap-slot (use 15, 30 or 60)\n");
+                    return 1;
+                }
+                break;
             /* Database options */
             case 3001: /* --db */
                 use_db = true;
-                db_path = optarg ? optarg : NULL;
+                if (db_path_count == DB_SET_MAX) {
+                    fprintf(stderr, "Error: At most %d databases can be read at once\n", DB_SET_MAX);
+                    return 1;
+                }
+                db_paths[db_path_count++] = optarg;
+                db_path = db_paths[0];
                 break;
             case 3002: /* --import */
                 db_import = true;
@@ -1396,15 +2259,108 @@ int main(int argc, char ** argv) {
                 db_backup_path = optarg;
                 use_db = true;
                 break;
+            case 3006: /* --db-profile */
+                if (!db_parse_profile(optarg, &db_profile)) {
+                    fprintf(stderr, "Error: Invalid database profile '%s'. Valid options: interactive, bulk, safe\n", optarg);
+                    return 1;
+                }
+                break;
+            case 3007: /* --db-rebuild-rollups */
+                db_do_rebuild_rollups = true;
+                use_db = true;
+                break;
+            case 3008: /* --search */
+                search_text = optarg;
+                break;
+            case 3009: /* --db-rebuild-search */
+                db_do_rebuild_search = true;
+                use_db = true;
+                break;
+            case 3010: { /* --db-backup-step */
+                char *end;
+                long pages = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || pages < 1 || pages > INT_MAX) {
+                    fprintf(stderr, "Error: Invalid page count for --db-backup-step (must be at least 1)\n");
+                    return 1;
+                }
+                backup_options.pages_per_step = (int)pages;
+                break;
+            }
+            case 3011: /* --db-backup-compact */
+                backup_options.compact = true;
+                break;
+            case 3012: /* --serve */
+                serve_socket = optarg;
+                use_db = true;
+                break;
             default:
                 print_usage(argv[0]);
                 return 1;
         }
     }
 
+    if (search_text && !use_db) {
+        fprintf(stderr, "Error: --search queries the database; use it with --db\n");
+        return 1;
+    }
+
+    db_report_t report = {
+        .query = {
+            .from_date = filter_from,
+            .to_date = filter_to,
+            .tag = filter_tag,
+            .search = (char *)search_text
+        },
+        .format = format,
+        .sort = tag_sort,
+        .top = top_tags,
+        .daily = show_daily,
+        .weekly = show_weekly,
+        .monthly = show_monthly,
+        .cooccurrence = show_cooccurrence,
+        .dedupe_overlaps = dedupe_overlaps,
+        .overlaps = show_overlaps,
+        .gaps = show_gaps,
+        .heatmap = show_heatmap,
+        .heatmap_slot = heatmap_slot,
+        .stats = db_stats
+    };
+
+    /* Several databases: a report over all of them, nothing else */
+    if (db_path_count > 1) {
+        if (db_import || db_do_vacuum || db_do_rebuild_rollups || db_do_rebuild_search ||
+            db_backup_path || serve_socket) {
+            fprintf(stderr, "Error: Only reports can read several databases; give one --db for this operation\n");
+            return 1;
+        }
+
+        summa_db_t *dbs[DB_SET_MAX];
+        const char *names[DB_SET_MAX];
+        db_set_t set = { dbs, names, 0 };
+        bool reported = true;
+        for (int i = 0; i < db_path_count; i++) {
+            names[i] = db_paths[i] ? db_paths[i] : DEFAULT_DB_PATH;
+            dbs[i] = db_open(db_paths[i], db_profile);
+            if (!dbs[i]) {
+                fprintf(stderr, "Error: Failed to open database %s\n", names[i]);
+                reported = false;
+                break;
+            }
+            set.count++;
+        }
+
+        if (reported) {
+            reported = print_db_report(stdout, &set, &report);
+        }
+        for (int i = 0; i < set.count; i++) {
+            db_close(dbs[i]);
+        }
+        return reported ? 0 : 1;
+    }
+
     /* Handle database operations if requested */
     if (use_db) {
-        summa_db_t *db = db_open(db_path);
+        summa_db_t *db = db_open(db_path, db_profile);
         if (!db) {
             fprintf(stderr, "Error: Failed to open database\n");
             return 1;
@@ -1422,81 +2378,65 @@ int main(int argc, char ** argv) {
             return 0;
         }
 
-        if (db_backup_path) {
-            printf("Backing up database to %s...\n", db_backup_path);
-            if (db_backup(db, db_backup_path)) {
-                printf("Database backed up successfully\n");
+        if (db_do_rebuild_rollups) {
+            printf("Rebuilding report rollups...\n");
+            if (db_rebuild_rollups(db)) {
+                printf("Rollups rebuilt successfully\n");
             } else {
-                fprintf(stderr, "Failed to backup database\n");
+                fprintf(stderr, "Failed to rebuild rollups\n");
             }
             db_close(db);
             return 0;
         }
 
-        if (db_stats) {
-            db_stats_t *stats = db_get_stats(db);
-            if (stats) {
-                printf("=== DATABASE STATISTICS ===\n");
-                printf("Total entries: %d\n", stats->total_entries);
-                printf("Total files: %d\n", stats->total_files);
-                printf("Total tags: %d\n", stats->total_tags);
-                printf("Total time: %dh %dm\n",
-                       stats->total_minutes / 60,
-                       stats->total_minutes % 60);
-                if (stats->earliest_date.year > 0) {
-                    printf("Date range: %04d-%02d-%02d to %04d-%02d-%02d\n",
-                           stats->earliest_date.year, stats->earliest_date.month,
-                           stats->earliest_date.day,
-                           stats->latest_date.year, stats->latest_date.month,
-                           stats->latest_date.day);
-                }
-                free(stats);
+        if (db_do_rebuild_search) {
+            printf("Rebuilding full-text search index...\n");
+            if (db_rebuild_search(db)) {
+                printf("Search index rebuilt successfully\n");
+            } else {
+                fprintf(stderr, "Failed to rebuild search index\n");
             }
             db_close(db);
             return 0;
         }
 
-        /* If importing, we'll do that after parsing the file */
-        if (!db_import) {
-            /* Query from database */
-            /* If we have date filters, use them */
-            if (filter_from.year > 0 && filter_to.year > 0) {
-                current_logfile = db_query_by_date_range(db, filter_from, filter_to);
-            } else if (filter_tag) {
-                current_logfile = db_query_by_tag(db, filter_tag);
-            } else {
-                /* Query all entries */
-                date_t from = {2000, 1, 1};
-                date_t to = {2100, 12, 31};
-                current_logfile = db_query_by_date_range(db, from, to);
+        if (db_backup_path) {
+            printf("Backing up database to %s...\n", db_backup_path);
+            fflush(stdout);
+            int remaining = -1;
+            if (!backup_options.compact && (verbose || isatty(STDERR_FILENO))) {
+                backup_options.progress = print_backup_progress;
+                backup_options.progress_ctx = &remaining;
             }
-
-            if (current_logfile && current_logfile->count > 0) {
-                /* Display results */
-                if (show_daily) {
-                    print_daily_summary(current_logfile);
-                } else if (show_weekly) {
-                    print_weekly_summary(current_logfile);
-                } else if (show_monthly) {
-                    print_monthly_summary(current_logfile);
-                } else if (format == FORMAT_TEXT) {
-                    print_summary(current_logfile, tag_sort);
-                } else if (format == FORMAT_CSV) {
-                    print_csv(current_logfile);
-                } else if (format == FORMAT_JSON) {
-                    print_json(current_logfile);
-                }
+            bool backed_up = db_backup(db, db_backup_path, &backup_options);
+            if (remaining > 0) fputc('\n', stderr);  /* Progress line cut short */
+            if (backed_up) {
+                printf("Database backed up successfully\n");
             } else {
-                printf("No entries found in database\n");
+                fprintf(stderr, "Failed to backup database\n");
             }
+            db_close(db);
+            return backed_up ? 0 : 1;
+        }
 
-            free_logfile(current_logfile);
+        if (serve_socket) {
+            bool served = serve_queries(db, serve_socket);
             db_close(db);
-            return 0;
+            return served ? 0 : 1;
+        }
+
+        if (db_stats || !db_import) {
+            /* Query from database; date and tag filters run in SQL */
+            const char *name = db_path ? db_path : DEFAULT_DB_PATH;
+            db_set_t one = { &db, &name, 1 };
+            bool reported = print_db_report(stdout, &one, &report);
+            db_close(db);
+            return reported ? 0 : 1;
         }
 
         /* For import, continue to parse the file and then import */
-        /* The database will be used after parsing */
+        /* The database is reopened after parsing */
+        db_close(db);
     }
 
     /* Handle directory scanning if requested */
@@ -1517,46 +2457,61 @@ int main(int argc, char ** argv) {
                    scan_result->files_with_dates - scan_result->files_without_dates);
         }
 
-        /* Process scan results */
-        current_logfile = process_scan_results(scan_result, &scan_config);
+        /* Parse the scanned files once: with --import each file is stored
+         * as soon as it is parsed, and the report reads the same entries */
+        bool importing = use_db && db_import;
+        bool imported = false;
+        if (importing) {
+            summa_db_t *db = db_open(db_path, db_profile);
+            if (db) {
+                current_logfile = create_logfile();
+                imported = db_import_scan_results(db, scan_result, &scan_config, current_logfile);
+                db_close(db);
+            } else {
+                fprintf(stderr, "Error: Failed to open database for scan import\n");
+                importing = false;
+            }
+        }
+        if (!current_logfile) {
+            current_logfile = process_scan_results(scan_result, &scan_config);
+        }
 
         /* Continue to display results */
         if (current_logfile && current_logfile->count > 0) {
-            if (show_daily) {
+            if (report.heatmap) {
+                print_file_heatmap(current_logfile, &report);
+            } else if (report.dedupe_overlaps || report.overlaps || report.gaps) {
+                print_file_minutes(current_logfile, &report);
+            } else if (show_daily) {
                 print_daily_summary(current_logfile);
             } else if (show_weekly) {
                 print_weekly_summary(current_logfile);
             } else if (show_monthly) {
                 print_monthly_summary(current_logfile);
+            } else if (show_cooccurrence) {
+                print_file_cooccurrence(current_logfile, format, tag_sort, top_tags);
             } else if (format == FORMAT_TEXT) {
-                print_summary(current_logfile, tag_sort);
+                print_summary(current_logfile, tag_sort, top_tags);
             } else if (format == FORMAT_CSV) {
                 print_csv(current_logfile);
             } else if (format == FORMAT_JSON) {
-                print_json(current_logfile);
+                print_json(stdout, current_logfile);
             }
         }
 
-        /* Handle database import for scanned results if requested */
-        if (use_db && db_import && current_logfile && current_logfile->count > 0) {
-            summa_db_t *db = db_open(db_path);
-            if (db) {
-                printf("Importing %d scanned entries to database...\n", current_logfile->count);
-                if (db_import_scan_results(db, scan_result)) {
-                    printf("Successfully imported %d entries from %d files\n",
-                           current_logfile->count, scan_result->file_count);
-                } else {
-                    fprintf(stderr, "Failed to import scanned entries\n");
-                }
-                db_close(db);
+        if (importing && current_logfile && current_logfile->count > 0) {
+            if (imported) {
+                printf("Successfully imported %d entries from %d files\n",
+                       current_logfile->count, scan_result->file_count);
             } else {
-                fprintf(stderr, "Error: Failed to open database for scan import\n");
+                fprintf(stderr, "Failed to import scanned entries\n");
             }
         }
 
-        free_scan_result(scan_result);
-
+        /* Entries point at paths in the scan result */
         free_logfile(current_logfile);
+        free_scan_result(scan_result);
+        free_scan_patterns(&scan_config);
         return 0;
     }
 
@@ -1564,7 +2519,7 @@ int main(int argc, char ** argv) {
     FILE *input;
     if (optind < argc) {
         input_file = argv[optind];
-        input = fopen(input_file, "r");
+        input = io_open(input_file);
         if (!input) {
             fprintf(stderr, "Error: Cannot open file '%s'\n", input_file);
             return 1;
@@ -1593,7 +2548,11 @@ int main(int argc, char ** argv) {
 
     /* Print summary if parsing succeeded */
     if (result == 0 && current_logfile->count > 0) {
-        if (show_daily) {
+        if (report.heatmap) {
+            print_file_heatmap(current_logfile, &report);
+        } else if (report.dedupe_overlaps || report.overlaps || report.gaps) {
+            print_file_minutes(current_logfile, &report);
+        } else if (show_daily) {
             /* Daily summary overrides format option */
             print_daily_summary(current_logfile);
         } else if (show_weekly) {
@@ -1602,12 +2561,14 @@ int main(int argc, char ** argv) {
         } else if (show_monthly) {
             /* Monthly summary overrides format option */
             print_monthly_summary(current_logfile);
+        } else if (show_cooccurrence) {
+            print_file_cooccurrence(current_logfile, format, tag_sort, top_tags);
         } else if (format == FORMAT_TEXT) {
-            print_summary(current_logfile, tag_sort);
+            print_summary(current_logfile, tag_sort, top_tags);
         } else if (format == FORMAT_CSV) {
             print_csv(current_logfile);
         } else if (format == FORMAT_JSON) {
-            print_json(current_logfile);
+            print_json(stdout, current_logfile);
         }
     }
 
@@ -1618,11 +2579,25 @@ int main(int argc, char ** argv) {
 
     /* Handle database import if requested */
     if (use_db && db_import && current_logfile && current_logfile->count > 0) {
-        summa_db_t *db = db_open(db_path);
+        summa_db_t *db = db_open(db_path, db_profile);
         if (db) {
             printf("Importing %d entries to database...\n", current_logfile->count);
-            const char *import_file = input_file ? input_file : "stdin";
-            if (db_import_file(db, import_file, current_logfile)) {
+            /* A file is synced to its current contents; stdin has no
+             * stable contents, so its entries only accumulate */
+            bool imported;
+            if (input_file) {
+                imported = db_import_file(db, input_file, current_logfile);
+            } else {
+                db_begin_transaction(db);
+                imported = db_import_entries(db, "stdin", current_logfile->entries,
+                                             current_logfile->count);
+                if (imported) {
+                    db_commit_transaction(db);
+                } else {
+                    db_rollback_transaction(db);
+                }
+            }
+            if (imported) {
                 printf("Successfully imported %d entries\n", current_logfile->count);
             } else {
                 fprintf(stderr, "Failed to import entries\n");
@@ -1636,16 +2611,7 @@ int main(int argc, char ** argv) {
     /* Clean up */
     free_logfile(current_logfile);
 
-    /* Free include/exclude patterns */
-    for (int i = 0; i < scan_config.include_count; i++) {
-        free(scan_config.include_patterns[i]);
-    }
-    free(scan_config.include_patterns);
-
-    for (int i = 0; i < scan_config.exclude_count; i++) {
-        free(scan_config.exclude_patterns[i]);
-    }
-    free(scan_config.exclude_patterns);
+    free_scan_patterns(&scan_config);
 
     return result;
 }
@@ -43,6 +43,8 @@ typedef struct {
     int percentage;
     taglist_t *tags;
     char *raw_line;
+    int line_number;     /* Line in the source file, 0 if unknown */
+    const char *source;  /* Scanned file it came from, not owned; NULL otherwise */
 } logline_t;
 
 /* Log file */
@@ -52,6 +54,53 @@ typedef struct logfile {
     int capacity;
 } logfile_t;
 
+/* Tag aggregation structure */
+typedef struct {
+    char *tag;
+    int total_minutes;
+    int entry_count;
+} tag_summary_t;
+
+/* Daily summary structure */
+typedef struct {
+    date_t date;
+    int total_minutes;
+    int entry_count;
+} daily_summary_t;
+
+/* Weekly summary structure (weeks start on Monday, split at year end) */
+typedef struct {
+    int year;
+    int week;
+    int total_minutes;
+    int entry_count;
+    date_t first_day;
+    date_t last_day;
+} weekly_summary_t;
+
+/* Monthly summary structure */
+typedef struct {
+    int year;
+    int month;
+    int total_minutes;
+    int entry_count;
+    int days_with_entries;
+} monthly_summary_t;
+
+/* Output format enum */
+typedef enum {
+    FORMAT_TEXT,
+    FORMAT_CSV,
+    FORMAT_JSON
+} output_format_t;
+
+/* Tag sorting enum */
+typedef enum {
+    SORT_ALPHA,      /* Alphabetical (default) */
+    SORT_TIME,       /* By total time (descending) */
+    SORT_COUNT       /* By entry count (descending) */
+} tag_sort_t;
+
 /* Global variables (declared extern) */
 extern date_t current_date;
 extern logfile_t *current_logfile;
@@ -59,8 +108,20 @@ extern bool verbose;
 
 /* Core functions */
 logfile_t* create_logfile(void);
+void add_entry(logfile_t *file, logline_t *entry);
 void free_logfile(logfile_t *file);
 int parse_two_phase(FILE *input);
+int parse_log(FILE *input, date_t *date, logfile_t *out);
+bool entry_filters_active(void);
+
+/* Calendar helpers: days since 1970-01-01 (proleptic Gregorian) */
+int date_to_days(date_t date);
+date_t days_to_date(int days);
+int get_iso_week(int year, int month, int day);
+
+/* Weeks and months from daily rows in date order; malloc'd arrays */
+weekly_summary_t* weeks_from_days(const daily_summary_t *days, int day_count, int *count);
+monthly_summary_t* months_from_days(const daily_summary_t *days, int day_count, int *count);
 
 /* Filter variables */
 extern date_t filter_from;
@@ -0,0 +1,332 @@
+/*
+ * summa_cooccur.c - Time shared by pairs of tags
+ *
+ * Tag names are interned once into small integer ids through an
+ * open-addressed index. A pair is then a single 64-bit key, the lower id
+ * in the high half, so the symmetric matrix stores each pair once and
+ * only the pairs that occur. Both tables are kept at most half full and
+ * doubled when needed. Names are only compared again when the pairs are
+ * ranked for output.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "summa.h"
+#include "summa_cooccur.h"
+
+/* One occupied cell of the matrix; key 0 marks an empty slot */
+typedef struct {
+    uint64_t key;
+    int minutes;
+    int entries;
+} pair_slot_t;
+
+struct cooccur {
+    char **names;                /* Interned tag names, by id */
+    int name_count;
+    int name_capacity;
+    int *name_index;             /* Ids by name hash, -1 = empty */
+    int name_index_size;         /* Power of two */
+
+    pair_slot_t *pairs;
+    int pair_count;
+    int pair_size;               /* Power of two */
+
+    int *ids;                    /* Scratch: the current entry's tag ids */
+    int id_capacity;
+    int entry_count;
+};
+
+/* FNV-1a hash of the first len bytes of a name */
+static unsigned int name_hash(const char *name, size_t len) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Fibonacci hashing spreads the packed ids over the table */
+static unsigned int pair_hash(uint64_t key, int size) {
+    return (unsigned int)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (unsigned int)(size - 1);
+}
+
+cooccur_t* cooccur_create(void) {
+    cooccur_t *c = calloc(1, sizeof(cooccur_t));
+    if (!c) return NULL;
+
+    c->name_index_size = 256;
+    c->name_index = malloc(sizeof(int) * c->name_index_size);
+    c->pair_size = 1024;
+    c->pairs = calloc(c->pair_size, sizeof(pair_slot_t));
+    if (!c->name_index || !c->pairs) {
+        cooccur_free(c);
+        return NULL;
+    }
+    for (int i = 0; i < c->name_index_size; i++) c->name_index[i] = -1;
+    return c;
+}
+
+void cooccur_free(cooccur_t *c) {
+    if (!c) return;
+    for (int i = 0; i < c->name_count; i++) {
+        free(c->names[i]);
+    }
+    free(c->names);
+    free(c->name_index);
+    free(c->pairs);
+    free(c->ids);
+    free(c);
+}
+
+static bool grow_name_index(cooccur_t *c) {
+    int size = c->name_index_size * 2;
+    int *index = malloc(sizeof(int) * size);
+    if (!index) return false;
+    for (int i = 0; i < size; i++) index[i] = -1;
+    for (int id = 0; id < c->name_count; id++) {
+        unsigned int slot = name_hash(c->names[id], strlen(c->names[id])) & (size - 1);
+        while (index[slot] >= 0) slot = (slot + 1) & (size - 1);
+        index[slot] = id;
+    }
+    free(c->name_index);
+    c->name_index = index;
+    c->name_index_size = size;
+    return true;
+}
+
+/* Id of a tag name, adding it if new; -1 if out of memory */
+static int intern_name(cooccur_t *c, const char *name, size_t len) {
+    if (c->name_count >= c->name_index_size / 2 && !grow_name_index(c)) return -1;
+
+    int mask = c->name_index_size - 1;
+    unsigned int slot = name_hash(name, len) & mask;
+    while (c->name_index[slot] >= 0) {
+        const char *known = c->names[c->name_index[slot]];
+        if (strncmp(known, name, len) == 0 && known[len] == '\0') {
+            return c->name_index[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (c->name_count >= c->name_capacity) {
+        int capacity = c->name_capacity ? c->name_capacity * 2 : 64;
+        char **names = realloc(c->names, sizeof(char *) * capacity);
+        if (!names) return -1;
+        c->names = names;
+        c->name_capacity = capacity;
+    }
+    char *copy = malloc(len + 1);
+    if (!copy) return -1;
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+
+    c->names[c->name_count] = copy;
+    c->name_index[slot] = c->name_count;
+    return c->name_count++;
+}
+
+/* Make room for the scratch id list of an entry */
+static bool reserve_ids(cooccur_t *c, int count) {
+    if (count <= c->id_capacity) return true;
+    int capacity = c->id_capacity ? c->id_capacity : 16;
+    while (capacity < count) capacity *= 2;
+    int *ids = realloc(c->ids, sizeof(int) * capacity);
+    if (!ids) return false;
+    c->ids = ids;
+    c->id_capacity = capacity;
+    return true;
+}
+
+/* Rehash the matrix until another added pairs fit at most half full */
+static bool reserve_pairs(cooccur_t *c, int added) {
+    if (c->pair_count + added <= c->pair_size / 2) return true;
+
+    int size = c->pair_size;
+    while (c->pair_count + added > size / 2) {
+        if (size > (1 << 29)) {
+            fprintf(stderr, "Error: Too many tag pairs\n");
+            return false;
+        }
+        size *= 2;
+    }
+    pair_slot_t *pairs = calloc(size, sizeof(pair_slot_t));
+    if (!pairs) {
+        fprintf(stderr, "Error: Failed to expand tag pairs\n");
+        return false;
+    }
+    for (int i = 0; i < c->pair_size; i++) {
+        if (!c->pairs[i].key) continue;
+        unsigned int slot = pair_hash(c->pairs[i].key, size);
+        while (pairs[slot].key) slot = (slot + 1) & (size - 1);
+        pairs[slot] = c->pairs[i];
+    }
+    free(c->pairs);
+    c->pairs = pairs;
+    c->pair_size = size;
+    return true;
+}
+
+/* Count the pairs among the count ids in c->ids */
+static bool add_ids(cooccur_t *c, int count, int minutes) {
+    /* Insertion sort, then drop repeats: entries carry few tags */
+    int *ids = c->ids;
+    for (int i = 1; i < count; i++) {
+        int id = ids[i], j = i;
+        while (j > 0 && ids[j - 1] > id) {
+            ids[j] = ids[j - 1];
+            j--;
+        }
+        ids[j] = id;
+    }
+    int distinct = 0;
+    for (int i = 0; i < count; i++) {
+        if (distinct == 0 || ids[distinct - 1] != ids[i]) ids[distinct++] = ids[i];
+    }
+    if (distinct < 2) return true;
+
+    if (!reserve_pairs(c, distinct * (distinct - 1) / 2)) return false;
+    c->entry_count++;
+
+    int mask = c->pair_size - 1;
+    for (int i = 0; i < distinct; i++) {
+        for (int j = i + 1; j < distinct; j++) {
+            /* Ids are offset by one so no pair packs to the empty key */
+            uint64_t key = ((uint64_t)(ids[i] + 1) << 32) | (uint64_t)(ids[j] + 1);
+            unsigned int slot = pair_hash(key, c->pair_size);
+            while (c->pairs[slot].key && c->pairs[slot].key != key) {
+                slot = (slot + 1) & mask;
+            }
+            if (!c->pairs[slot].key) {
+                c->pairs[slot].key = key;
+                c->pair_count++;
+            }
+            c->pairs[slot].minutes += minutes;
+            c->pairs[slot].entries++;
+        }
+    }
+    return true;
+}
+
+bool cooccur_add_entry(cooccur_t *c, const logline_t *entry) {
+    if (!entry->tags || entry->tags->count < 2) return true;
+    if (!reserve_ids(c, entry->tags->count)) return false;
+
+    for (int i = 0; i < entry->tags->count; i++) {
+        const char *tag = entry->tags->tags[i];
+        c->ids[i] = intern_name(c, tag, strlen(tag));
+        if (c->ids[i] < 0) return false;
+    }
+    return add_ids(c, entry->tags->count, entry->timespan.duration_minutes);
+}
+
+bool cooccur_add_names(cooccur_t *c, const char *names, int minutes) {
+    int count = 0;
+    const char *p = names;
+    while (*p) {
+        while (*p == ' ') p++;
+        if (!*p) break;
+        const char *end = strchr(p, ' ');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+
+        if (!reserve_ids(c, count + 1)) return false;
+        c->ids[count] = intern_name(c, p, len);
+        if (c->ids[count++] < 0) return false;
+        p += len;
+    }
+    return add_ids(c, count, minutes);
+}
+
+int cooccur_entry_count(const cooccur_t *c) {
+    return c->entry_count;
+}
+
+/* Pair orders, matching the tag report's: names break ties */
+static int compare_pairs_alphabetical(const void *a, const void *b) {
+    const tag_pair_t *pair_a = a;
+    const tag_pair_t *pair_b = b;
+    int cmp = strcmp(pair_a->tag_a, pair_b->tag_a);
+    return cmp ? cmp : strcmp(pair_a->tag_b, pair_b->tag_b);
+}
+
+static int compare_pairs_by_time(const void *a, const void *b) {
+    const tag_pair_t *pair_a = a;
+    const tag_pair_t *pair_b = b;
+    if (pair_a->total_minutes != pair_b->total_minutes) {
+        return pair_a->total_minutes < pair_b->total_minutes ? 1 : -1;
+    }
+    return compare_pairs_alphabetical(a, b);
+}
+
+static int compare_pairs_by_count(const void *a, const void *b) {
+    const tag_pair_t *pair_a = a;
+    const tag_pair_t *pair_b = b;
+    if (pair_a->entry_count != pair_b->entry_count) {
+        return pair_a->entry_count < pair_b->entry_count ? 1 : -1;
+    }
+    return compare_pairs_alphabetical(a, b);
+}
+
+/* Restore the max-heap property below heap[i] */
+static void sift_down_pair(tag_pair_t *heap, int size, int i,
+                           int (*compare)(const void *, const void *)) {
+    for (;;) {
+        int largest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < size && compare(&heap[left], &heap[largest]) > 0) largest = left;
+        if (right < size && compare(&heap[right], &heap[largest]) > 0) largest = right;
+        if (largest == i) return;
+        tag_pair_t swap = heap[i];
+        heap[i] = heap[largest];
+        heap[largest] = swap;
+        i = largest;
+    }
+}
+
+tag_pair_t* cooccur_pairs(const cooccur_t *c, tag_sort_t order, int top, int *count) {
+    *count = 0;
+    tag_pair_t *pairs = malloc(sizeof(tag_pair_t) * (c->pair_count ? c->pair_count : 1));
+    if (!pairs) return NULL;
+
+    int n = 0;
+    for (int i = 0; i < c->pair_size; i++) {
+        const pair_slot_t *slot = &c->pairs[i];
+        if (!slot->key) continue;
+        const char *a = c->names[(slot->key >> 32) - 1];
+        const char *b = c->names[(slot->key & 0xFFFFFFFFu) - 1];
+        if (strcmp(a, b) > 0) {
+            const char *swap = a;
+            a = b;
+            b = swap;
+        }
+        pairs[n++] = (tag_pair_t){ a, b, slot->minutes, slot->entries };
+    }
+
+    if (top > 0 && order == SORT_ALPHA) order = SORT_TIME;
+    int (*compare)(const void *, const void *) =
+        order == SORT_TIME ? compare_pairs_by_time :
+        order == SORT_COUNT ? compare_pairs_by_count : compare_pairs_alphabetical;
+
+    /* Keep the best top pairs in a heap rooted at the weakest of them */
+    if (top > 0 && n > top) {
+        for (int i = top / 2 - 1; i >= 0; i--) {
+            sift_down_pair(pairs, top, i, compare);
+        }
+        for (int i = top; i < n; i++) {
+            if (compare(&pairs[i], &pairs[0]) < 0) {
+                pairs[0] = pairs[i];
+                sift_down_pair(pairs, top, 0, compare);
+            }
+        }
+        n = top;
+    }
+    if (n > 1) qsort(pairs, n, sizeof(tag_pair_t), compare);
+
+    *count = n;
+    return pairs;
+}
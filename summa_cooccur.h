@@ -0,0 +1,39 @@
+/*
+ * summa_cooccur.h - Time shared by pairs of tags
+ */
+
+#ifndef SUMMA_COOCCUR_H
+#define SUMMA_COOCCUR_H
+
+#include <stdbool.h>
+#include "summa.h"
+
+/* Two tags found on the same entries; tag_a sorts before tag_b */
+typedef struct {
+    const char *tag_a;           /* Owned by the cooccur_t */
+    const char *tag_b;
+    int total_minutes;
+    int entry_count;
+} tag_pair_t;
+
+/* Sparse symmetric matrix of tag pairs. Tags are interned to ids and each
+ * pair is one hash slot keyed by both ids, so an entry with n tags costs
+ * n lookups and n(n-1)/2 slot updates. */
+typedef struct cooccur cooccur_t;
+
+cooccur_t* cooccur_create(void);
+void cooccur_free(cooccur_t *c);
+
+/* Count every pair of distinct tags on one entry, given as a logline or
+ * as the database's space-separated tag names */
+bool cooccur_add_entry(cooccur_t *c, const logline_t *entry);
+bool cooccur_add_names(cooccur_t *c, const char *names, int minutes);
+
+/* Entries that had two or more distinct tags */
+int cooccur_entry_count(const cooccur_t *c);
+
+/* The pairs in order; with top > 0, only the first top, ranked by time
+ * unless ordered by count. Returns a malloc'd array. */
+tag_pair_t* cooccur_pairs(const cooccur_t *c, tag_sort_t order, int top, int *count);
+
+#endif /* SUMMA_COOCCUR_H */
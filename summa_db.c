@@ -11,12 +11,153 @@
 #include <limits.h>
 #include <errno.h>
 #include <wordexp.h>
+#include <stdint.h>
+#include <ctype.h>
 #include "summa_db.h"
+#include "summa_io.h"
 
 /* External functions from summa.c */
 extern logfile_t* create_logfile(void);
 extern void add_entry(logfile_t *file, logline_t *entry);
+extern taglist_t* create_taglist(void);
+extern void free_logline(logline_t *entry);
+extern void add_tag(taglist_t *list, const char *tag);
 extern bool verbose;  /* Verbose mode flag from summa.c */
+extern int validate_date(int year, int month, int day);
+
+/* Table layouts shared by schema creation and the version 3 migration.
+ * Dates are days since 1970-01-01 and times are minutes since midnight;
+ * a NULL day means the entry had no valid date. */
+#define ENTRIES_COLUMNS \
+    "  id INTEGER PRIMARY KEY AUTOINCREMENT," \
+    "  file_id INTEGER," \
+    "  day INTEGER," \
+    "  start_minute INTEGER," \
+    "  end_minute INTEGER," \
+    "  duration_minutes INTEGER," \
+    "  description TEXT," \
+    "  percentage INTEGER," \
+    "  line_number INTEGER," \
+    "  entry_hash INTEGER," \
+    "  created_at INTEGER DEFAULT (strftime('%s', 'now'))," \
+    "  FOREIGN KEY (file_id) REFERENCES files(id) ON DELETE CASCADE"
+
+/* entry_tags is a pure link table: WITHOUT ROWID keeps it a single b-tree */
+#define ENTRY_TAGS_COLUMNS \
+    "  entry_id INTEGER," \
+    "  tag_id INTEGER," \
+    "  PRIMARY KEY (entry_id, tag_id)," \
+    "  FOREIGN KEY (entry_id) REFERENCES entries(id) ON DELETE CASCADE," \
+    "  FOREIGN KEY (tag_id) REFERENCES tags(id) ON DELETE CASCADE"
+
+/* The day index covers range totals without touching the table; the
+ * (file_id, entry_hash) key also serves lookups by file */
+#define ENTRIES_INDEXES \
+    "CREATE INDEX IF NOT EXISTS idx_entries_day ON entries(day, start_minute, duration_minutes);" \
+    "CREATE UNIQUE INDEX IF NOT EXISTS idx_entries_hash ON entries(file_id, entry_hash);" \
+    "CREATE INDEX IF NOT EXISTS idx_entry_tags_tag ON entry_tags(tag_id);"
+
+/* Report rollups: per-day totals, overall and per tag, over entries with
+ * a valid day. The triggers keep them exact for every write. Deleting an
+ * entry settles its tag totals before the cascade removes the tag links,
+ * because the parent row is already gone when the link triggers fire. */
+#define ROLLUP_TABLES \
+    "CREATE TABLE IF NOT EXISTS daily_totals (" \
+    "  day INTEGER PRIMARY KEY," \
+    "  minutes INTEGER NOT NULL," \
+    "  entries INTEGER NOT NULL" \
+    ");" \
+    "CREATE TABLE IF NOT EXISTS daily_tag_totals (" \
+    "  tag_id INTEGER," \
+    "  day INTEGER," \
+    "  minutes INTEGER NOT NULL," \
+    "  entries INTEGER NOT NULL," \
+    "  PRIMARY KEY (tag_id, day)" \
+    ") WITHOUT ROWID;"
+
+/* Add or remove one entry (sign 1 / -1) of the given day and minutes */
+#define ROLLUP_DAY_ADD(day, minutes) \
+    "INSERT INTO daily_totals (day, minutes, entries) " \
+    "SELECT " day ", " minutes ", 1 WHERE " day " IS NOT NULL " \
+    "ON CONFLICT (day) DO UPDATE SET minutes = minutes + excluded.minutes," \
+    "  entries = entries + 1;"
+#define ROLLUP_DAY_REMOVE(day, minutes) \
+    "UPDATE daily_totals SET minutes = minutes - " minutes ", entries = entries - 1 " \
+    "WHERE day = " day ";" \
+    "DELETE FROM daily_totals WHERE day = " day " AND entries <= 0;"
+/* The same for every tag currently linked to entry id */
+#define ROLLUP_TAGS_ADD(id, day, minutes) \
+    "INSERT INTO daily_tag_totals (tag_id, day, minutes, entries) " \
+    "SELECT tag_id, " day ", " minutes ", 1 FROM entry_tags " \
+    "WHERE entry_id = " id " AND " day " IS NOT NULL " \
+    "ON CONFLICT (tag_id, day) DO UPDATE SET minutes = minutes + excluded.minutes," \
+    "  entries = entries + 1;"
+#define ROLLUP_TAGS_REMOVE(id, day, minutes) \
+    "UPDATE daily_tag_totals SET minutes = minutes - " minutes ", entries = entries - 1 " \
+    "WHERE day = " day " AND tag_id IN (SELECT tag_id FROM entry_tags WHERE entry_id = " id ");" \
+    "DELETE FROM daily_tag_totals WHERE day = " day " AND entries <= 0" \
+    "  AND tag_id IN (SELECT tag_id FROM entry_tags WHERE entry_id = " id ");"
+
+#define ROLLUP_TRIGGERS \
+    "CREATE TRIGGER IF NOT EXISTS rollup_entry_insert AFTER INSERT ON entries BEGIN " \
+    ROLLUP_DAY_ADD("NEW.day", "NEW.duration_minutes") \
+    "END;" \
+    "CREATE TRIGGER IF NOT EXISTS rollup_entry_delete BEFORE DELETE ON entries BEGIN " \
+    ROLLUP_DAY_REMOVE("OLD.day", "OLD.duration_minutes") \
+    ROLLUP_TAGS_REMOVE("OLD.id", "OLD.day", "OLD.duration_minutes") \
+    "END;" \
+    "CREATE TRIGGER IF NOT EXISTS rollup_entry_update" \
+    "  AFTER UPDATE OF day, duration_minutes ON entries BEGIN " \
+    ROLLUP_DAY_REMOVE("OLD.day", "OLD.duration_minutes") \
+    ROLLUP_TAGS_REMOVE("NEW.id", "OLD.day", "OLD.duration_minutes") \
+    ROLLUP_DAY_ADD("NEW.day", "NEW.duration_minutes") \
+    ROLLUP_TAGS_ADD("NEW.id", "NEW.day", "NEW.duration_minutes") \
+    "END;" \
+    "CREATE TRIGGER IF NOT EXISTS rollup_tag_insert AFTER INSERT ON entry_tags BEGIN " \
+    "INSERT INTO daily_tag_totals (tag_id, day, minutes, entries) " \
+    "SELECT NEW.tag_id, day, duration_minutes, 1 FROM entries " \
+    "WHERE id = NEW.entry_id AND day IS NOT NULL " \
+    "ON CONFLICT (tag_id, day) DO UPDATE SET minutes = minutes + excluded.minutes," \
+    "  entries = entries + 1;" \
+    "END;" \
+    "CREATE TRIGGER IF NOT EXISTS rollup_tag_delete AFTER DELETE ON entry_tags BEGIN " \
+    "UPDATE daily_tag_totals SET entries = entries - 1," \
+    "  minutes = minutes - (SELECT duration_minutes FROM entries WHERE id = OLD.entry_id) " \
+    "WHERE tag_id = OLD.tag_id AND day = (SELECT day FROM entries WHERE id = OLD.entry_id);" \
+    "DELETE FROM daily_tag_totals WHERE tag_id = OLD.tag_id AND entries <= 0" \
+    "  AND day = (SELECT day FROM entries WHERE id = OLD.entry_id);" \
+    "END;"
+
+/* Recompute the rollups from entries; run inside a transaction */
+#define ROLLUP_REBUILD \
+    "DELETE FROM daily_totals;" \
+    "DELETE FROM daily_tag_totals;" \
+    "INSERT INTO daily_totals (day, minutes, entries) " \
+    "SELECT day, SUM(duration_minutes), COUNT(*) FROM entries " \
+    "WHERE day IS NOT NULL GROUP BY day;" \
+    "INSERT INTO daily_tag_totals (tag_id, day, minutes, entries) " \
+    "SELECT et.tag_id, e.day, SUM(e.duration_minutes), COUNT(*) " \
+    "FROM entries e JOIN entry_tags et ON et.entry_id = e.id " \
+    "WHERE e.day IS NOT NULL GROUP BY et.tag_id, e.day;"
+
+/* Full-text index over entry descriptions. External content: the text
+ * lives only in entries, and the triggers mirror every change into the
+ * index. Optional, since SQLite may be built without FTS5. */
+#define SEARCH_SCHEMA \
+    "CREATE VIRTUAL TABLE IF NOT EXISTS entries_fts USING fts5(" \
+    "  description, content = 'entries', content_rowid = 'id');" \
+    "CREATE TRIGGER IF NOT EXISTS search_entry_insert AFTER INSERT ON entries BEGIN " \
+    "INSERT INTO entries_fts (rowid, description) VALUES (NEW.id, NEW.description);" \
+    "END;" \
+    "CREATE TRIGGER IF NOT EXISTS search_entry_delete AFTER DELETE ON entries BEGIN " \
+    "INSERT INTO entries_fts (entries_fts, rowid, description) " \
+    "VALUES ('delete', OLD.id, OLD.description);" \
+    "END;" \
+    "CREATE TRIGGER IF NOT EXISTS search_entry_update AFTER UPDATE OF description ON entries BEGIN " \
+    "INSERT INTO entries_fts (entries_fts, rowid, description) " \
+    "VALUES ('delete', OLD.id, OLD.description);" \
+    "INSERT INTO entries_fts (rowid, description) VALUES (NEW.id, NEW.description);" \
+    "END;"
 
 /* SQL statements for schema creation */
 static const char *schema_sql =
@@ -30,21 +171,12 @@ static const char *schema_sql =
     "  filepath TEXT UNIQUE NOT NULL,"
     "  last_modified INTEGER,"
     "  last_scanned INTEGER,"
-    "  entry_count INTEGER DEFAULT 0"
+    "  entry_count INTEGER DEFAULT 0,"
+    "  content_hash INTEGER"
     ");"
     ""
     "CREATE TABLE IF NOT EXISTS entries ("
-    "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
-    "  file_id INTEGER,"
-    "  date TEXT,"
-    "  start_time TEXT,"
-    "  end_time TEXT,"
-    "  duration_minutes INTEGER,"
-    "  description TEXT,"
-    "  percentage INTEGER,"
-    "  line_number INTEGER,"
-    "  created_at INTEGER DEFAULT (strftime('%s', 'now')),"
-    "  FOREIGN KEY (file_id) REFERENCES files(id) ON DELETE CASCADE"
+    ENTRIES_COLUMNS
     ");"
     ""
     "CREATE TABLE IF NOT EXISTS tags ("
@@ -53,18 +185,188 @@ static const char *schema_sql =
     ");"
     ""
     "CREATE TABLE IF NOT EXISTS entry_tags ("
-    "  entry_id INTEGER,"
-    "  tag_id INTEGER,"
-    "  PRIMARY KEY (entry_id, tag_id),"
-    "  FOREIGN KEY (entry_id) REFERENCES entries(id) ON DELETE CASCADE,"
-    "  FOREIGN KEY (tag_id) REFERENCES tags(id) ON DELETE CASCADE"
-    ");"
+    ENTRY_TAGS_COLUMNS
+    ") WITHOUT ROWID;"
     ""
-    "CREATE INDEX IF NOT EXISTS idx_entries_date ON entries(date);"
-    "CREATE INDEX IF NOT EXISTS idx_entries_file ON entries(file_id);"
-    "CREATE INDEX IF NOT EXISTS idx_tags_name ON tags(name);"
-    "CREATE INDEX IF NOT EXISTS idx_entry_tags_entry ON entry_tags(entry_id);"
-    "CREATE INDEX IF NOT EXISTS idx_entry_tags_tag ON entry_tags(tag_id);";
+    ENTRIES_INDEXES
+    ROLLUP_TABLES
+    ROLLUP_TRIGGERS;
+
+/* SQL for the cached statements, indexed by db_stmt_id_t */
+static const char *stmt_sql[STMT_COUNT] = {
+    [STMT_FILE_INSERT] =
+        "INSERT OR IGNORE INTO files (filepath) VALUES (?)",
+    [STMT_FILE_ID] =
+        "SELECT id, content_hash, entry_count FROM files WHERE filepath = ?",
+    [STMT_FILE_COUNT_UPDATE] =
+        "UPDATE files SET entry_count = entry_count + ?, content_hash = NULL WHERE id = ?",
+    [STMT_ENTRY_INSERT] =
+        "INSERT INTO entries (file_id, day, start_minute, end_minute, "
+        "duration_minutes, description, percentage, line_number, entry_hash) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)",
+    [STMT_ENTRY_INSERT_BATCH] = NULL,  /* Built by build_batch_insert_sql() */
+    [STMT_ENTRY_TAG_INSERT] =
+        "INSERT INTO entry_tags (entry_id, tag_id) VALUES (?, ?)",
+    [STMT_TAG_SELECT] =
+        "SELECT id FROM tags WHERE name = ?",
+    [STMT_TAG_INSERT] =
+        "INSERT INTO tags (name) VALUES (?)",
+    [STMT_FILE_ENTRIES] =
+        "SELECT id, entry_hash, line_number FROM entries "
+        "WHERE file_id = ? ORDER BY entry_hash",
+    [STMT_FILE_ENTRY_COUNT] =
+        "SELECT count(*) FROM entries WHERE file_id = ?",
+    [STMT_FILE_SYNC_UPDATE] =
+        "UPDATE files SET entry_count = ?, content_hash = ? WHERE id = ?",
+    [STMT_ENTRY_DELETE] =
+        "DELETE FROM entries WHERE id = ?",
+    [STMT_ENTRY_LINE_UPDATE] =
+        "UPDATE entries SET line_number = ? WHERE id = ?",
+    [STMT_DATA_VERSION] =
+        "PRAGMA data_version"
+};
+
+/* Columns bound per row by STMT_ENTRY_INSERT(_BATCH) */
+#define ENTRY_INSERT_COLUMNS 9
+
+/* Duplicates hit the unique (file_id, entry_hash) index and are skipped;
+ * only rows actually inserted come back */
+#define ENTRY_INSERT_TAIL " ON CONFLICT (file_id, entry_hash) DO NOTHING RETURNING id, entry_hash"
+
+/* Build the rows-row form of STMT_ENTRY_INSERT with its conflict clause */
+static char* build_insert_sql(int rows) {
+    const char *head = stmt_sql[STMT_ENTRY_INSERT];
+    const char *values = strstr(head, "VALUES ") + strlen("VALUES ");
+    size_t head_len = (size_t)(values - head);
+    size_t row_len = strlen(values);
+    size_t tail_len = strlen(ENTRY_INSERT_TAIL);
+
+    char *sql = malloc(head_len + (size_t)rows * (row_len + 1) + tail_len + 1);
+    if (!sql) return NULL;
+
+    char *p = sql;
+    memcpy(p, head, head_len);
+    p += head_len;
+    for (int i = 0; i < rows; i++) {
+        if (i > 0) *p++ = ',';
+        memcpy(p, values, row_len);
+        p += row_len;
+    }
+    memcpy(p, ENTRY_INSERT_TAIL, tail_len + 1);
+    return sql;
+}
+
+/* Get a cached statement, preparing it on first use. The statement comes
+ * back reset with no bindings; callers sqlite3_reset() it when done so it
+ * does not hold a read transaction open. */
+static sqlite3_stmt* db_stmt(summa_db_t *db, db_stmt_id_t id) {
+    sqlite3_stmt *stmt = db->stmts[id];
+    if (stmt) {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        return stmt;
+    }
+
+    char *built = NULL;
+    const char *sql = stmt_sql[id];
+    if (id == STMT_ENTRY_INSERT || id == STMT_ENTRY_INSERT_BATCH) {
+        sql = built = build_insert_sql(id == STMT_ENTRY_INSERT ? 1 : DB_INSERT_BATCH);
+        if (!sql) return NULL;
+    }
+
+    int rc = sqlite3_prepare_v3(db->db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, NULL);
+    free(built);
+    if (rc != SQLITE_OK) {
+        if (verbose) {
+            fprintf(stderr, "Debug: Failed to prepare statement: %s\n", sqlite3_errmsg(db->db));
+        }
+        return NULL;
+    }
+
+    db->stmts[id] = stmt;
+    return stmt;
+}
+
+/* Open-addressing map from tag name to tags.id */
+struct db_tag_cache {
+    char **names;
+    int *ids;
+    size_t capacity;     /* Power of two */
+    size_t count;
+};
+
+/* FNV-1a string hash */
+static uint64_t hash_string(const char *str) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void tag_cache_free(db_tag_cache_t *cache) {
+    if (!cache) return;
+    for (size_t i = 0; i < cache->capacity; i++) {
+        free(cache->names[i]);
+    }
+    free(cache->names);
+    free(cache->ids);
+    free(cache);
+}
+
+/* Look up a tag; returns -1 if not cached */
+static int tag_cache_get(db_tag_cache_t *cache, const char *name) {
+    if (!cache || cache->count == 0) return -1;
+
+    size_t i = (size_t)hash_string(name) & (cache->capacity - 1);
+    while (cache->names[i]) {
+        if (strcmp(cache->names[i], name) == 0) return cache->ids[i];
+        i = (i + 1) & (cache->capacity - 1);
+    }
+    return -1;
+}
+
+/* Insert into a table known not to contain name; the table has room */
+static void tag_cache_place(db_tag_cache_t *cache, char *name, int id) {
+    size_t i = (size_t)hash_string(name) & (cache->capacity - 1);
+    while (cache->names[i]) i = (i + 1) & (cache->capacity - 1);
+    cache->names[i] = name;
+    cache->ids[i] = id;
+    cache->count++;
+}
+
+/* Remember a tag ID, growing the table as needed */
+static void tag_cache_put(summa_db_t *db, const char *name, int id) {
+    db_tag_cache_t *cache = db->tag_cache;
+    if (!cache) {
+        cache = db->tag_cache = calloc(1, sizeof(db_tag_cache_t));
+        if (!cache) return;
+    }
+
+    if ((cache->count + 1) * 10 > cache->capacity * 7) {
+        db_tag_cache_t grown = { 0 };
+        grown.capacity = cache->capacity ? cache->capacity * 2 : 256;
+        grown.names = calloc(grown.capacity, sizeof(char*));
+        grown.ids = calloc(grown.capacity, sizeof(int));
+        if (!grown.names || !grown.ids) {
+            free(grown.names);
+            free(grown.ids);
+            return;  /* Cache is an optimization only */
+        }
+        for (size_t i = 0; i < cache->capacity; i++) {
+            if (cache->names[i]) tag_cache_place(&grown, cache->names[i], cache->ids[i]);
+        }
+        free(cache->names);
+        free(cache->ids);
+        *cache = grown;
+    }
+
+    char *copy = strdup(name);
+    if (copy) tag_cache_place(cache, copy, id);
+}
+
+static void sql_entry_hash(sqlite3_context *ctx, int argc, sqlite3_value **argv);
 
 /* Create directory recursively */
 static int mkdir_recursive(const char *path, mode_t mode) {
@@ -157,8 +459,120 @@ char* db_expand_path(const char *path) {
     return expanded;
 }
 
+/* PRAGMA settings per profile, indexed by db_profile_t */
+static const struct {
+    const char *name;
+    const char *journal_mode;
+    const char *synchronous;
+    int cache_kib;             /* cache_size, as a negative KiB count */
+    long long mmap_bytes;
+    const char *temp_store;
+    int busy_timeout_ms;
+} db_profiles[] = {
+    [DB_PROFILE_INTERACTIVE] = { "interactive", "WAL", "NORMAL", 16 * 1024,
+                                 256LL << 20, "MEMORY", 5000 },
+    /* synchronous=OFF can lose the last transactions on power failure;
+     * bulk loads are re-runnable, so that is an acceptable trade */
+    [DB_PROFILE_BULK]        = { "bulk", "WAL", "OFF", 256 * 1024,
+                                 1LL << 30, "MEMORY", 30000 },
+    /* WAL needs shared memory, which network filesystems do not provide */
+    [DB_PROFILE_SAFE]        = { "safe", "DELETE", "FULL", 2 * 1024,
+                                 0, "DEFAULT", 10000 }
+};
+
+/* Look up a profile by name */
+bool db_parse_profile(const char *name, db_profile_t *profile) {
+    for (size_t i = 0; i < sizeof(db_profiles) / sizeof(db_profiles[0]); i++) {
+        if (strcmp(name, db_profiles[i].name) == 0) {
+            *profile = (db_profile_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Run a journal_mode pragma and copy the mode it reports into mode */
+static bool journal_mode_pragma(summa_db_t *db, const char *sql, char *mode, size_t size) {
+    sqlite3_stmt *stmt = NULL;
+    bool ok = sqlite3_prepare_v2(db->db, sql, -1, &stmt, NULL) == SQLITE_OK &&
+              sqlite3_step(stmt) == SQLITE_ROW;
+    if (ok) snprintf(mode, size, "%s", (const char *)sqlite3_column_text(stmt, 0));
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+/* Switch to the profile's journal mode if the database is not in it
+ * already. Leaving WAL needs the database to itself, so with another
+ * connection open the switch fails; the current mode is kept then,
+ * rather than refusing to open. */
+static void apply_journal_mode(summa_db_t *db, db_profile_t profile) {
+    const char *wanted = db_profiles[profile].journal_mode;
+    char mode[32] = "";
+    if (journal_mode_pragma(db, "PRAGMA journal_mode", mode, sizeof(mode)) &&
+        sqlite3_stricmp(mode, wanted) == 0) {
+        return;
+    }
+
+    char sql[64];
+    snprintf(sql, sizeof(sql), "PRAGMA journal_mode = %s", wanted);
+    char now[32] = "";
+    if (!journal_mode_pragma(db, sql, now, sizeof(now))) {
+        fprintf(stderr, "Warning: Keeping journal mode %s for profile %s: %s\n",
+                mode[0] ? mode : "unknown", db_profiles[profile].name, sqlite3_errmsg(db->db));
+    } else if (sqlite3_stricmp(now, wanted) != 0) {
+        fprintf(stderr, "Warning: Keeping journal mode %s for profile %s\n",
+                now, db_profiles[profile].name);
+    }
+}
+
+/* Apply a tuning profile to an open connection */
+bool db_apply_profile(summa_db_t *db, db_profile_t profile) {
+    if (!db || !db->db) return false;
+
+    db->busy_timeout_ms = db_profiles[profile].busy_timeout_ms;
+    sqlite3_busy_timeout(db->db, db->busy_timeout_ms);
+    apply_journal_mode(db, profile);
+
+    char sql[512];
+    snprintf(sql, sizeof(sql),
+             "PRAGMA synchronous = %s;"
+             "PRAGMA cache_size = -%d;"
+             "PRAGMA mmap_size = %lld;"
+             "PRAGMA temp_store = %s;",
+             db_profiles[profile].synchronous,
+             db_profiles[profile].cache_kib,
+             db_profiles[profile].mmap_bytes,
+             db_profiles[profile].temp_store);
+
+    char *err_msg = NULL;
+    if (sqlite3_exec(db->db, sql, NULL, NULL, &err_msg) != SQLITE_OK) {
+        fprintf(stderr, "Error applying database profile %s: %s\n",
+                db_profiles[profile].name, err_msg);
+        sqlite3_free(err_msg);
+        return false;
+    }
+
+    if (verbose) {
+        fprintf(stderr, "Debug: Using database profile %s\n", db_profiles[profile].name);
+    }
+    return true;
+}
+
+/* Whether the full-text index was created for this database */
+static bool search_index_exists(summa_db_t *db) {
+    sqlite3_stmt *stmt = NULL;
+    bool exists = false;
+    if (sqlite3_prepare_v2(db->db,
+            "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'entries_fts'",
+            -1, &stmt, NULL) == SQLITE_OK) {
+        exists = (sqlite3_step(stmt) == SQLITE_ROW);
+        sqlite3_finalize(stmt);
+    }
+    return exists;
+}
+
 /* Open database connection */
-summa_db_t* db_open(const char *path) {
+summa_db_t* db_open(const char *path, db_profile_t profile) {
     summa_db_t *db = calloc(1, sizeof(summa_db_t));
     if (!db) return NULL;
 
@@ -200,6 +614,12 @@ summa_db_t* db_open(const char *path) {
     /* Enable foreign keys */
     sqlite3_exec(db->db, "PRAGMA foreign_keys = ON", NULL, NULL, NULL);
 
+    /* Before any schema work, so migrations run with the same settings */
+    if (!db_apply_profile(db, profile)) {
+        db_close(db);
+        return NULL;
+    }
+
     /* Initialize schema if needed */
     if (verbose) {
         fprintf(stderr, "Debug: Checking database schema at %s\n", db->path);
@@ -221,6 +641,7 @@ summa_db_t* db_open(const char *path) {
         fprintf(stderr, "Debug: Database schema is current\n");
     }
 
+    db->has_search = search_index_exists(db);
     return db;
 }
 
@@ -232,6 +653,11 @@ void db_close(summa_db_t *db) {
         db_rollback_transaction(db);
     }
 
+    for (int i = 0; i < STMT_COUNT; i++) {
+        sqlite3_finalize(db->stmts[i]);
+    }
+    tag_cache_free(db->tag_cache);
+
     if (db->db) {
         sqlite3_close(db->db);
     }
@@ -240,6 +666,32 @@ void db_close(summa_db_t *db) {
     free(db);
 }
 
+/* Create and fill the full-text index if SQLite supports it; a database
+ * without one still works, searching with a substring scan instead. Failure
+ * is only an error when the index was explicitly asked for. */
+static bool create_search_index(summa_db_t *db, bool required) {
+    char *err_msg = NULL;
+    int rc = sqlite3_exec(db->db,
+        "SAVEPOINT search_index;"
+        SEARCH_SCHEMA
+        "INSERT INTO entries_fts (entries_fts) VALUES ('rebuild');"
+        "RELEASE search_index;", NULL, NULL, &err_msg);
+
+    if (rc != SQLITE_OK) {
+        if (required) {
+            fprintf(stderr, "Error building full-text search index: %s\n",
+                    err_msg ? err_msg : sqlite3_errmsg(db->db));
+        } else if (verbose) {
+            fprintf(stderr, "Debug: No full-text search index: %s\n",
+                   err_msg ? err_msg : sqlite3_errmsg(db->db));
+        }
+        sqlite3_free(err_msg);
+        sqlite3_exec(db->db, "ROLLBACK TO search_index; RELEASE search_index;", NULL, NULL, NULL);
+        return false;
+    }
+    return true;
+}
+
 /* Initialize database schema */
 bool db_init_schema(summa_db_t *db) {
     if (!db || !db->db) return false;
@@ -266,6 +718,7 @@ bool db_init_schema(summa_db_t *db) {
         return false;
     }
 
+    create_search_index(db, false);
     return true;
 }
 
@@ -304,16 +757,245 @@ bool db_check_schema(summa_db_t *db) {
     return version == DB_VERSION;
 }
 
-/* Migrate schema to current version */
+/* Rows copied per transaction by the version 3 migration */
+#define MIGRATION_BATCH 50000
+
+/* Run a multi-statement script, reporting errors as context: message */
+static bool exec_sql(summa_db_t *db, const char *sql, const char *context) {
+    char *err_msg = NULL;
+    if (sqlite3_exec(db->db, sql, NULL, NULL, &err_msg) != SQLITE_OK) {
+        fprintf(stderr, "Error %s: %s\n", context, err_msg ? err_msg : sqlite3_errmsg(db->db));
+        sqlite3_free(err_msg);
+        return false;
+    }
+    return true;
+}
+
+/* Version 3: integer day / minute-of-day columns, WITHOUT ROWID tag links
+ * and a covering day index. Rows are streamed into the new tables in
+ * MIGRATION_BATCH-sized transactions, with the last copied id kept in
+ * metadata so an interrupted upgrade resumes where it stopped; the old
+ * tables are swapped out in one final transaction. Works from either the
+ * version 1 or version 2 layout: entry_hash is recomputed on the way and
+ * the unique index drops any duplicates. */
+static bool migrate_to_v3(summa_db_t *db) {
+    static const char *setup_sql =
+        "BEGIN IMMEDIATE;"
+        "CREATE TABLE IF NOT EXISTS entries_v3 (" ENTRIES_COLUMNS ");"
+        "CREATE TABLE IF NOT EXISTS entry_tags_v3 (" ENTRY_TAGS_COLUMNS ") WITHOUT ROWID;"
+        "DROP INDEX IF EXISTS idx_entries_hash;"
+        "CREATE UNIQUE INDEX IF NOT EXISTS idx_entries_hash ON entries_v3(file_id, entry_hash);"
+        "INSERT OR IGNORE INTO metadata (key, value) VALUES ('migration_last_id', '0');"
+        "COMMIT;";
+
+    static const char *batch_end_sql =
+        "SELECT MAX(id) FROM (SELECT id FROM entries WHERE id > ?1 ORDER BY id LIMIT ?2)";
+
+    static const char *copy_entries_sql =
+        "INSERT OR IGNORE INTO entries_v3 (id, file_id, day, start_minute, end_minute,"
+        "  duration_minutes, description, percentage, line_number, entry_hash, created_at) "
+        "SELECT id, file_id, day, start_minute, end_minute, duration_minutes, description,"
+        "  percentage, line_number,"
+        "  summa_entry_hash(day, start_minute, end_minute, duration_minutes, description,"
+        "                   percentage, NULL),"
+        "  created_at "
+        "FROM (SELECT *,"
+        "        CAST(julianday(date) - 2440587.5 AS INTEGER) AS day,"
+        "        CAST(substr(start_time, 1, 2) AS INTEGER) * 60 +"
+        "          CAST(substr(start_time, 4, 2) AS INTEGER) AS start_minute,"
+        "        CAST(substr(end_time, 1, 2) AS INTEGER) * 60 +"
+        "          CAST(substr(end_time, 4, 2) AS INTEGER) AS end_minute"
+        "      FROM entries WHERE id > ?1 AND id <= ?2 ORDER BY id)";
+
+    static const char *copy_tags_sql =
+        "INSERT OR IGNORE INTO entry_tags_v3 (entry_id, tag_id) "
+        "SELECT et.entry_id, et.tag_id FROM entry_tags et "
+        "JOIN entries_v3 e ON e.id = et.entry_id "
+        "WHERE et.entry_id > ?1 AND et.entry_id <= ?2";
+
+    static const char *progress_sql =
+        "UPDATE metadata SET value = ?1 WHERE key = 'migration_last_id'";
+
+    static const char *swap_sql =
+        "BEGIN IMMEDIATE;"
+        "DROP TABLE entry_tags;"
+        "DROP TABLE entries;"
+        "ALTER TABLE entries_v3 RENAME TO entries;"
+        "ALTER TABLE entry_tags_v3 RENAME TO entry_tags;"
+        "DROP INDEX IF EXISTS idx_tags_name;"
+        ENTRIES_INDEXES
+        "UPDATE files SET entry_count = (SELECT COUNT(*) FROM entries WHERE file_id = files.id);"
+        "DELETE FROM metadata WHERE key = 'migration_last_id';"
+        "UPDATE metadata SET value = '3' WHERE key = 'version';"
+        "COMMIT;";
+
+    if (!exec_sql(db, setup_sql, "preparing database migration")) return false;
+
+    sqlite3_stmt *stmts[4] = { NULL };
+    const char *sqls[4] = { batch_end_sql, copy_entries_sql, copy_tags_sql, progress_sql };
+    for (int i = 0; i < 4; i++) {
+        if (sqlite3_prepare_v2(db->db, sqls[i], -1, &stmts[i], NULL) != SQLITE_OK) {
+            fprintf(stderr, "Error preparing database migration: %s\n", sqlite3_errmsg(db->db));
+            for (int j = 0; j < i; j++) sqlite3_finalize(stmts[j]);
+            return false;
+        }
+    }
+    sqlite3_stmt *batch_end = stmts[0], *copy_entries = stmts[1];
+    sqlite3_stmt *copy_tags = stmts[2], *progress = stmts[3];
+
+    /* Resume point from an interrupted run */
+    sqlite3_int64 last_id = 0;
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db->db, "SELECT value FROM metadata WHERE key = 'migration_last_id'",
+                           -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) last_id = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+
+    bool ok = true;
+    long long copied = 0;
+    while (ok) {
+        if (!exec_sql(db, "BEGIN IMMEDIATE", "migrating database")) {
+            ok = false;
+            break;
+        }
+
+        sqlite3_bind_int64(batch_end, 1, last_id);
+        sqlite3_bind_int(batch_end, 2, MIGRATION_BATCH);
+        sqlite3_int64 batch_last = 0;
+        bool more = sqlite3_step(batch_end) == SQLITE_ROW &&
+                    sqlite3_column_type(batch_end, 0) != SQLITE_NULL;
+        if (more) batch_last = sqlite3_column_int64(batch_end, 0);
+        sqlite3_reset(batch_end);
+
+        if (!more) {
+            ok = exec_sql(db, "COMMIT", "migrating database");
+            break;
+        }
+
+        sqlite3_stmt *steps[3] = { copy_entries, copy_tags, progress };
+        for (int i = 0; i < 3 && ok; i++) {
+            if (steps[i] == progress) {
+                sqlite3_bind_int64(progress, 1, batch_last);
+            } else {
+                sqlite3_bind_int64(steps[i], 1, last_id);
+                sqlite3_bind_int64(steps[i], 2, batch_last);
+            }
+            ok = sqlite3_step(steps[i]) == SQLITE_DONE;
+            sqlite3_reset(steps[i]);
+            if (ok && steps[i] == copy_entries) copied += sqlite3_changes(db->db);
+        }
+
+        if (ok) ok = exec_sql(db, "COMMIT", "migrating database");
+        if (!ok) {
+            fprintf(stderr, "Error migrating database: %s\n", sqlite3_errmsg(db->db));
+            sqlite3_exec(db->db, "ROLLBACK", NULL, NULL, NULL);
+            break;
+        }
+
+        last_id = batch_last;
+        if (verbose) {
+            fprintf(stderr, "Debug: Migrated %lld entries (up to id %lld)\n",
+                   copied, (long long)last_id);
+        }
+    }
+
+    for (int i = 0; i < 4; i++) sqlite3_finalize(stmts[i]);
+    if (!ok) return false;
+
+    /* Dropping the old tables must not cascade into the new link table */
+    sqlite3_exec(db->db, "PRAGMA foreign_keys = OFF", NULL, NULL, NULL);
+    ok = exec_sql(db, swap_sql, "finishing database migration");
+    if (!ok) sqlite3_exec(db->db, "ROLLBACK", NULL, NULL, NULL);
+    sqlite3_exec(db->db, "PRAGMA foreign_keys = ON", NULL, NULL, NULL);
+
+    if (ok && verbose) {
+        fprintf(stderr, "Debug: Database migrated to version 3 (%lld entries)\n", copied);
+    }
+    return ok;
+}
+
+/* Version 5: the full-text index is optional, so the upgrade goes ahead
+ * without it; --db-rebuild-search adds it later */
+static bool migrate_to_v5(summa_db_t *db) {
+    create_search_index(db, false);
+    return exec_sql(db, "UPDATE metadata SET value = '5' WHERE key = 'version'",
+                    "migrating database to version 5");
+}
+
+/* Schema upgrades; migrations[v - 1] takes a version v database to v + 1.
+ * A step either is a script run in one transaction with the version bump,
+ * or manages its own transactions and sets the version itself. */
+typedef struct {
+    const char *sql;
+    bool (*run)(summa_db_t *db);
+} migration_t;
+
+static const migration_t migrations[] = {
+    /* 1 -> 2: content hash column; filled in and made unique by the
+     * version 3 rebuild, which recomputes it from the new columns */
+    { "ALTER TABLE entries ADD COLUMN entry_hash INTEGER;", NULL },
+    /* 2 -> 3: integer dates and times */
+    { NULL, migrate_to_v3 },
+    /* 3 -> 4: trigger-maintained report rollups */
+    { ROLLUP_TABLES ROLLUP_TRIGGERS ROLLUP_REBUILD, NULL },
+    /* 4 -> 5: full-text search index, where FTS5 is available */
+    { NULL, migrate_to_v5 },
+    /* 5 -> 6: entry_hash also covers percentage and tags; files remember
+     * the fingerprint of their last sync */
+    { "ALTER TABLE files ADD COLUMN content_hash INTEGER;"
+      "UPDATE entries SET entry_hash = summa_entry_hash(day, start_minute, end_minute,"
+      "  duration_minutes, description, percentage,"
+      "  (SELECT group_concat(t.name, ' ') FROM entry_tags et"
+      "   JOIN tags t ON t.id = et.tag_id WHERE et.entry_id = entries.id));", NULL }
+};
+
+/* Migrate schema to current version, one version at a time */
 bool db_migrate_schema(summa_db_t *db, int from_version) {
-    (void)db; /* Suppress unused parameter warning - will be used in future migrations */
+    if (!db || !db->db) return false;
 
-    /* Placeholder for future migrations */
-    if (from_version < DB_VERSION) {
+    int count = (int)(sizeof(migrations) / sizeof(migrations[0]));
+    if (from_version < 1 || count + 1 < DB_VERSION) {
         fprintf(stderr, "Database migration from version %d to %d not implemented\n",
                 from_version, DB_VERSION);
         return false;
     }
+
+    sqlite3_create_function(db->db, "summa_entry_hash", 7,
+                            SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL,
+                            sql_entry_hash, NULL, NULL);
+
+    for (int version = from_version; version < DB_VERSION; version++) {
+        if (verbose) {
+            fprintf(stderr, "Debug: Migrating database from version %d to %d\n",
+                   version, version + 1);
+        }
+
+        const migration_t *step = &migrations[version - 1];
+        if (step->run) {
+            if (!step->run(db)) return false;
+            continue;
+        }
+
+        char version_sql[128];
+        snprintf(version_sql, sizeof(version_sql),
+                 "UPDATE metadata SET value = '%d' WHERE key = 'version'", version + 1);
+
+        char *err_msg = NULL;
+        int rc = sqlite3_exec(db->db, "BEGIN IMMEDIATE", NULL, NULL, &err_msg);
+        if (rc == SQLITE_OK) rc = sqlite3_exec(db->db, step->sql, NULL, NULL, &err_msg);
+        if (rc == SQLITE_OK) rc = sqlite3_exec(db->db, version_sql, NULL, NULL, &err_msg);
+        if (rc == SQLITE_OK) rc = sqlite3_exec(db->db, "COMMIT", NULL, NULL, &err_msg);
+
+        if (rc != SQLITE_OK) {
+            fprintf(stderr, "Error migrating database to version %d: %s\n",
+                    version + 1, err_msg ? err_msg : sqlite3_errmsg(db->db));
+            sqlite3_free(err_msg);
+            sqlite3_exec(db->db, "ROLLBACK", NULL, NULL, NULL);
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -364,186 +1046,551 @@ bool db_rollback_transaction(summa_db_t *db) {
         return false;
     }
 
+    /* Tags created inside the transaction are gone again */
+    tag_cache_free(db->tag_cache);
+    db->tag_cache = NULL;
+
     db->in_transaction = false;
     return true;
 }
 
 /* Get or create tag ID */
 static int get_or_create_tag(summa_db_t *db, const char *tag_name) {
-    const char *select_sql = "SELECT id FROM tags WHERE name = ?";
-    sqlite3_stmt *stmt = NULL;
+    int tag_id = tag_cache_get(db->tag_cache, tag_name);
+    if (tag_id > 0) return tag_id;
 
-    int rc = sqlite3_prepare_v2(db->db, select_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return -1;
+    sqlite3_stmt *stmt = db_stmt(db, STMT_TAG_SELECT);
+    if (!stmt) return -1;
 
     sqlite3_bind_text(stmt, 1, tag_name, -1, SQLITE_STATIC);
 
-    int tag_id = -1;
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         tag_id = sqlite3_column_int(stmt, 0);
     }
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
 
-    if (tag_id > 0) return tag_id;
+    if (tag_id > 0) {
+        tag_cache_put(db, tag_name, tag_id);
+        return tag_id;
+    }
 
     /* Create new tag */
-    const char *insert_sql = "INSERT INTO tags (name) VALUES (?)";
-    rc = sqlite3_prepare_v2(db->db, insert_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return -1;
+    stmt = db_stmt(db, STMT_TAG_INSERT);
+    if (!stmt) return -1;
 
     sqlite3_bind_text(stmt, 1, tag_name, -1, SQLITE_STATIC);
 
     if (sqlite3_step(stmt) == SQLITE_DONE) {
         tag_id = (int)sqlite3_last_insert_rowid(db->db);
+        tag_cache_put(db, tag_name, tag_id);
     }
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
 
     return tag_id;
 }
 
-/* Import a single entry */
-bool db_import_entry(summa_db_t *db, const char *filepath, logline_t *entry) {
-    if (!db || !db->db || !entry) return false;
+/* Entry waiting for a multi-row INSERT, in its stored form */
+typedef struct {
+    logline_t *entry;
+    bool has_day;        /* false: stored as NULL */
+    int day;
+    int start_minute;
+    int end_minute;
+    sqlite3_int64 hash;
+    bool inserted;
+    bool matched;        /* Sync: already stored, no insert needed */
+} pending_entry_t;
+
+/* FNV-1a step over the bytes of a 32-bit value */
+static uint64_t hash_int(uint64_t h, int value) {
+    for (int i = 0; i < 4; i++) {
+        h ^= ((unsigned)value >> (i * 8)) & 0xff;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
 
-    /* Get or create file record */
-    const char *file_sql = "INSERT OR IGNORE INTO files (filepath) VALUES (?)";
-    sqlite3_stmt *stmt = NULL;
+/* FNV-1a over len bytes */
+static uint64_t hash_bytes(uint64_t h, const char *s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Order-independent hash of a tag set: the sum of each distinct tag's
+ * hash, so repeated tags count once, as they do in entry_tags */
+static uint64_t tag_set_hash(taglist_t *tags) {
+    uint64_t sum = 0;
+    if (!tags) return sum;
 
-    int rc = sqlite3_prepare_v2(db->db, file_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return false;
+    for (int i = 0; i < tags->count; i++) {
+        const char *tag = tags->tags[i];
+        if (!tag || !*tag) continue;
+
+        bool repeated = false;
+        for (int j = 0; j < i && !repeated; j++) {
+            repeated = tags->tags[j] && strcmp(tags->tags[j], tag) == 0;
+        }
+        if (!repeated) sum += hash_bytes(14695981039346656037ULL, tag, strlen(tag));
+    }
+    return sum;
+}
+
+/* Stable 64-bit FNV-1a fingerprint of everything an entry stores, so an
+ * edited line never matches its old row. Shared with SQL as
+ * summa_entry_hash() for migrations. */
+static sqlite3_int64 entry_hash(bool has_day, int day, int start_minute, int end_minute,
+                                int duration, const char *description,
+                                int percentage, uint64_t tags) {
+    uint64_t h = 14695981039346656037ULL;
+    h = hash_int(h, has_day ? day : INT_MIN);
+    h = hash_int(h, start_minute);
+    h = hash_int(h, end_minute);
+    h = hash_int(h, duration);
+
+    /* Marker so NULL and "" differ */
+    h ^= description ? 0x1f : 0x1e;
+    h *= 1099511628211ULL;
+    if (description) h = hash_bytes(h, description, strlen(description));
+
+    h = hash_int(h, percentage);
+    h = hash_int(h, (int)(tags & 0xffffffffu));
+    h = hash_int(h, (int)(tags >> 32));
+    return (sqlite3_int64)h;
+}
+
+/* SQL: summa_entry_hash(day, start_minute, end_minute, duration_minutes,
+ * description, percentage, tags), tags being space-separated distinct
+ * names in any order, or NULL */
+static void sql_entry_hash(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    uint64_t tags = 0;
+    const char *names = (const char *)sqlite3_value_text(argv[6]);
+    while (names && *names) {
+        size_t len = strcspn(names, " ");
+        if (len > 0) tags += hash_bytes(14695981039346656037ULL, names, len);
+        names += len;
+        if (*names) names++;
+    }
+
+    sqlite3_result_int64(ctx, entry_hash(sqlite3_value_type(argv[0]) != SQLITE_NULL,
+                                         sqlite3_value_int(argv[0]),
+                                         sqlite3_value_int(argv[1]),
+                                         sqlite3_value_int(argv[2]),
+                                         sqlite3_value_int(argv[3]),
+                                         (const char *)sqlite3_value_text(argv[4]),
+                                         sqlite3_value_int(argv[5]),
+                                         tags));
+}
+
+/* Fill in the stored form of an entry */
+static void prepare_pending(pending_entry_t *p, logline_t *entry) {
+    p->entry = entry;
+    p->inserted = false;
+    p->matched = false;
+    p->has_day = validate_date(entry->date.year, entry->date.month, entry->date.day);
+    p->day = p->has_day ? date_to_days(entry->date) : 0;
+    p->start_minute = entry->timespan.start.hour * 60 + entry->timespan.start.minute;
+    p->end_minute = entry->timespan.end.hour * 60 + entry->timespan.end.minute;
+    p->hash = entry_hash(p->has_day, p->day, p->start_minute, p->end_minute,
+                         entry->timespan.duration_minutes, entry->description,
+                         entry->percentage, tag_set_hash(entry->tags));
+}
+
+/* Resolve (creating if needed) the files row for filepath. When given,
+ * content_hash gets the fingerprint of its last sync (0 if none) and
+ * entry_count the number of entries recorded for it. */
+static int get_or_create_file(summa_db_t *db, const char *filepath,
+                              sqlite3_int64 *content_hash, int *entry_count) {
+    sqlite3_stmt *stmt = db_stmt(db, STMT_FILE_INSERT);
+    if (!stmt) return -1;
 
     sqlite3_bind_text(stmt, 1, filepath, -1, SQLITE_STATIC);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
 
-    /* Get file ID */
-    const char *get_file_sql = "SELECT id FROM files WHERE filepath = ?";
-    rc = sqlite3_prepare_v2(db->db, get_file_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return false;
+    stmt = db_stmt(db, STMT_FILE_ID);
+    if (!stmt) return -1;
 
     sqlite3_bind_text(stmt, 1, filepath, -1, SQLITE_STATIC);
 
     int file_id = -1;
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         file_id = sqlite3_column_int(stmt, 0);
+        if (content_hash) *content_hash = sqlite3_column_int64(stmt, 1);
+        if (entry_count) *entry_count = sqlite3_column_int(stmt, 2);
     }
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
 
-    if (file_id < 0) return false;
+    return file_id;
+}
 
-    /* Format date and times */
-    char date_str[16];
-    snprintf(date_str, sizeof(date_str), "%04d-%02d-%02d",
-             entry->date.year, entry->date.month, entry->date.day);
+/* Bind one row of STMT_ENTRY_INSERT(_BATCH) starting at parameter base */
+static void bind_entry_row(sqlite3_stmt *stmt, int base, int file_id, const pending_entry_t *p) {
+    sqlite3_bind_int(stmt, base + 1, file_id);
+    if (p->has_day) {
+        sqlite3_bind_int(stmt, base + 2, p->day);
+    } else {
+        sqlite3_bind_null(stmt, base + 2);
+    }
+    sqlite3_bind_int(stmt, base + 3, p->start_minute);
+    sqlite3_bind_int(stmt, base + 4, p->end_minute);
+    sqlite3_bind_int(stmt, base + 5, p->entry->timespan.duration_minutes);
+    sqlite3_bind_text(stmt, base + 6, p->entry->description, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, base + 7, p->entry->percentage);
+    sqlite3_bind_int(stmt, base + 8, p->entry->line_number);
+    sqlite3_bind_int64(stmt, base + 9, p->hash);
+}
 
-    char start_str[8];
-    snprintf(start_str, sizeof(start_str), "%02d:%02d",
-             entry->timespan.start.hour, entry->timespan.start.minute);
+/* Link an inserted entry to its tags */
+static bool insert_entry_tags(summa_db_t *db, sqlite3_int64 entry_id, logline_t *entry) {
+    if (!entry->tags) return true;
 
-    char end_str[8];
-    snprintf(end_str, sizeof(end_str), "%02d:%02d",
-             entry->timespan.end.hour, entry->timespan.end.minute);
+    for (int i = 0; i < entry->tags->count; i++) {
+        int tag_id = get_or_create_tag(db, entry->tags->tags[i]);
+        if (tag_id <= 0) continue;
 
-    /* Check for duplicate entry */
-    const char *check_sql =
-        "SELECT id FROM entries WHERE file_id = ? AND date = ? AND start_time = ? "
-        "AND end_time = ? AND duration_minutes = ? AND (description = ? OR (description IS NULL AND ? IS NULL))";
+        sqlite3_stmt *stmt = db_stmt(db, STMT_ENTRY_TAG_INSERT);
+        if (!stmt) return false;
+        sqlite3_bind_int64(stmt, 1, entry_id);
+        sqlite3_bind_int(stmt, 2, tag_id);
+        sqlite3_step(stmt);  /* Repeated tag on one line: PK conflict, ignored */
+        sqlite3_reset(stmt);
+    }
+    return true;
+}
 
-    rc = sqlite3_prepare_v2(db->db, check_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return false;
+/* Run an insert statement and attach tags to the rows it returned.
+ * Rows absent from RETURNING were duplicates. */
+static int run_insert(summa_db_t *db, sqlite3_stmt *stmt, pending_entry_t *rows, int count) {
+    sqlite3_int64 ids[DB_INSERT_BATCH];
+    int matched[DB_INSERT_BATCH];
+    int nreturned = 0;
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        sqlite3_int64 hash = sqlite3_column_int64(stmt, 1);
+        for (int i = 0; i < count; i++) {
+            if (!rows[i].inserted && rows[i].hash == hash) {
+                rows[i].inserted = true;
+                ids[nreturned] = sqlite3_column_int64(stmt, 0);
+                matched[nreturned++] = i;
+                break;
+            }
+        }
+    }
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE) return -1;
 
-    sqlite3_bind_int(stmt, 1, file_id);
-    sqlite3_bind_text(stmt, 2, date_str, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, start_str, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 4, end_str, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 5, entry->timespan.duration_minutes);
-    sqlite3_bind_text(stmt, 6, entry->description, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 7, entry->description, -1, SQLITE_STATIC);
-
-    bool duplicate_found = (sqlite3_step(stmt) == SQLITE_ROW);
-    sqlite3_finalize(stmt);
+    for (int i = 0; i < nreturned; i++) {
+        if (!insert_entry_tags(db, ids[i], rows[matched[i]].entry)) return -1;
+    }
 
-    if (duplicate_found) {
-        if (verbose) {
-            fprintf(stderr, "Debug: Skipping duplicate entry: %s %s-%s\n",
-                   date_str, start_str, end_str);
+    if (verbose) {
+        for (int i = 0; i < count; i++) {
+            if (!rows[i].inserted) {
+                logline_t *e = rows[i].entry;
+                fprintf(stderr, "Debug: Skipping duplicate entry: %04d-%02d-%02d %02d:%02d-%02d:%02d\n",
+                       e->date.year, e->date.month, e->date.day,
+                       e->timespan.start.hour, e->timespan.start.minute,
+                       e->timespan.end.hour, e->timespan.end.minute);
+            }
+        }
+    }
+    return nreturned;
+}
+
+/* Insert pending entries: a full batch as one statement, the rest row by
+ * row. Returns the number of rows inserted, or -1 on error. */
+static int flush_pending(summa_db_t *db, int file_id, pending_entry_t *pending, int count) {
+    if (count == 0) return 0;
+
+    sqlite3_stmt *stmt;
+    if (count == DB_INSERT_BATCH) {
+        stmt = db_stmt(db, STMT_ENTRY_INSERT_BATCH);
+        if (!stmt) return -1;
+        for (int i = 0; i < count; i++) {
+            bind_entry_row(stmt, i * ENTRY_INSERT_COLUMNS, file_id, &pending[i]);
+        }
+        return run_insert(db, stmt, pending, count);
+    }
+
+    int inserted = 0;
+    for (int i = 0; i < count; i++) {
+        stmt = db_stmt(db, STMT_ENTRY_INSERT);
+        if (!stmt) return -1;
+        bind_entry_row(stmt, 0, file_id, &pending[i]);
+        int n = run_insert(db, stmt, &pending[i], 1);
+        if (n < 0) return -1;
+        inserted += n;
+    }
+    return inserted;
+}
+
+/* Insert the entries of rows not marked matched, in order, batched.
+ * Returns the number of rows inserted, or -1 on error. */
+static int insert_unmatched(summa_db_t *db, int file_id, pending_entry_t *rows, int count) {
+    pending_entry_t pending[DB_INSERT_BATCH];
+    int npending = 0;
+    int inserted = 0;
+
+    for (int i = 0; i <= count; i++) {
+        if (npending == DB_INSERT_BATCH || (i == count && npending > 0)) {
+            int n = flush_pending(db, file_id, pending, npending);
+            if (n < 0) return -1;
+            inserted += n;
+            npending = 0;
         }
-        return true;  /* Not an error, just skipped */
+        if (i < count && !rows[i].matched) pending[npending++] = rows[i];
     }
+    return inserted;
+}
 
-    /* Insert entry */
-    const char *entry_sql =
-        "INSERT INTO entries (file_id, date, start_time, end_time, "
-        "duration_minutes, description, percentage, line_number) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?, ?)";
+/* Import entries that all belong to one file. The file row is resolved
+ * once, tag IDs come from the handle's cache, and entries go in with
+ * multi-row INSERTs; duplicates are dropped by the unique entry_hash
+ * index. entry_count is written once at the end. */
+bool db_import_entries(summa_db_t *db, const char *filepath,
+                       logline_t **entries, int count) {
+    if (!db || !db->db || !filepath || (!entries && count > 0)) return false;
+    if (count == 0) return true;
 
-    rc = sqlite3_prepare_v2(db->db, entry_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return false;
+    int file_id = get_or_create_file(db, filepath, NULL, NULL);
+    if (file_id < 0) return false;
+
+    pending_entry_t *rows = malloc(sizeof(pending_entry_t) * (size_t)count);
+    if (!rows) return false;
+    for (int i = 0; i < count; i++) {
+        prepare_pending(&rows[i], entries[i]);
+    }
 
+    int inserted = insert_unmatched(db, file_id, rows, count);
+    free(rows);
+    if (inserted < 0) return false;
+
+    /* Update file entry count; the file no longer matches its last sync */
+    if (inserted > 0) {
+        sqlite3_stmt *stmt = db_stmt(db, STMT_FILE_COUNT_UPDATE);
+        if (stmt) {
+            sqlite3_bind_int(stmt, 1, inserted);
+            sqlite3_bind_int(stmt, 2, file_id);
+            sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+        }
+    }
+
+    return true;
+}
+
+/* Entry stored for a file, as loaded for a sync */
+typedef struct {
+    sqlite3_int64 id;
+    sqlite3_int64 hash;
+    int line_number;
+} stored_entry_t;
+
+/* Load the stored entries of a file, ordered by hash */
+static stored_entry_t* load_file_entries(summa_db_t *db, int file_id, int *count) {
+    *count = 0;
+    sqlite3_stmt *stmt = db_stmt(db, STMT_FILE_ENTRIES);
+    if (!stmt) return NULL;
     sqlite3_bind_int(stmt, 1, file_id);
-    sqlite3_bind_text(stmt, 2, date_str, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, start_str, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 4, end_str, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 5, entry->timespan.duration_minutes);
-    sqlite3_bind_text(stmt, 6, entry->description, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 7, entry->percentage);
-    sqlite3_bind_int(stmt, 8, 0);  /* line_number not tracked yet */
-
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
-        return false;
+
+    stored_entry_t *stored = NULL;
+    int capacity = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            stored_entry_t *grown = realloc(stored, sizeof(stored_entry_t) * (size_t)capacity);
+            if (!grown) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            stored = grown;
+        }
+        stored_entry_t *s = &stored[(*count)++];
+        s->id = sqlite3_column_int64(stmt, 0);
+        s->hash = sqlite3_column_int64(stmt, 1);
+        s->line_number = sqlite3_column_int(stmt, 2);
     }
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: Failed to read stored entries: %s\n", sqlite3_errmsg(db->db));
+        free(stored);
+        *count = -1;
+        return NULL;
+    }
+    return stored;
+}
 
-    int entry_id = (int)sqlite3_last_insert_rowid(db->db);
+/* Delete one stored entry; triggers settle rollups, search and tags */
+static bool delete_entry(summa_db_t *db, sqlite3_int64 id) {
+    sqlite3_stmt *stmt = db_stmt(db, STMT_ENTRY_DELETE);
+    if (!stmt) return false;
+    sqlite3_bind_int64(stmt, 1, id);
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE;
+}
+
+/* Record the line an unchanged entry moved to */
+static bool move_entry(summa_db_t *db, sqlite3_int64 id, int line_number) {
+    sqlite3_stmt *stmt = db_stmt(db, STMT_ENTRY_LINE_UPDATE);
+    if (!stmt) return false;
+    sqlite3_bind_int(stmt, 1, line_number);
+    sqlite3_bind_int64(stmt, 2, id);
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE;
+}
+
+/* Number of entries actually stored for a file */
+static int file_entry_count(summa_db_t *db, int file_id) {
+    sqlite3_stmt *stmt = db_stmt(db, STMT_FILE_ENTRY_COUNT);
+    if (!stmt) return -1;
+    sqlite3_bind_int(stmt, 1, file_id);
+    int n = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+    sqlite3_reset(stmt);
+    return n;
+}
+
+/* Sort pending entries by hash, first line first among equal hashes */
+static int compare_pending_hash(const void *a, const void *b) {
+    const pending_entry_t *pa = *(pending_entry_t * const *)a;
+    const pending_entry_t *pb = *(pending_entry_t * const *)b;
+    if (pa->hash != pb->hash) return pa->hash < pb->hash ? -1 : 1;
+    return (pa->entry->line_number > pb->entry->line_number) -
+           (pa->entry->line_number < pb->entry->line_number);
+}
 
-    /* Add tags */
-    if (entry->tags) {
-        const char *tag_sql =
-            "INSERT INTO entry_tags (entry_id, tag_id) VALUES (?, ?)";
+/* Make the stored entries of a file match its complete, freshly parsed
+ * entry set. A file whose fingerprint and row count are those of its
+ * last sync is left alone. Otherwise the new hashes are merged against
+ * the stored ones in hash order: entries on both sides stay untouched
+ * (apart from a moved line number), stored-only entries are deleted and
+ * new-only entries are inserted in file order. The rollup and search
+ * triggers follow the rows. Run inside a transaction. */
+bool db_sync_entries(summa_db_t *db, const char *filepath,
+                     logline_t **entries, int count) {
+    if (!db || !db->db || !filepath || (!entries && count > 0)) return false;
+
+    sqlite3_int64 last_sync = 0;
+    int recorded = 0;
+    int file_id = get_or_create_file(db, filepath, &last_sync, &recorded);
+    if (file_id < 0) return false;
+
+    pending_entry_t *rows = malloc(sizeof(pending_entry_t) * (size_t)(count + 1));
+    if (!rows) return false;
+
+    /* Fingerprint of the whole file: entry hashes and lines, in order */
+    uint64_t h = 14695981039346656037ULL;
+    for (int i = 0; i < count; i++) {
+        prepare_pending(&rows[i], entries[i]);
+        h = hash_int(h, (int)((uint64_t)rows[i].hash & 0xffffffffu));
+        h = hash_int(h, (int)((uint64_t)rows[i].hash >> 32));
+        h = hash_int(h, entries[i]->line_number);
+    }
+    sqlite3_int64 fingerprint = (sqlite3_int64)h;
 
-        rc = sqlite3_prepare_v2(db->db, tag_sql, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) return false;
+    /* Same contents as last time, and no rows removed behind our back */
+    if (last_sync != 0 && last_sync == fingerprint &&
+        file_entry_count(db, file_id) == recorded) {
+        if (verbose) {
+            fprintf(stderr, "Debug: %s: unchanged since last import\n", filepath);
+        }
+        free(rows);
+        return true;
+    }
 
-        for (int i = 0; i < entry->tags->count; i++) {
-            int tag_id = get_or_create_tag(db, entry->tags->tags[i]);
-            if (tag_id > 0) {
-                sqlite3_bind_int(stmt, 1, entry_id);
-                sqlite3_bind_int(stmt, 2, tag_id);
-                sqlite3_step(stmt);
-                sqlite3_reset(stmt);
+    int nstored;
+    stored_entry_t *stored = load_file_entries(db, file_id, &nstored);
+    pending_entry_t **by_hash = malloc(sizeof(pending_entry_t *) * (size_t)(count + 1));
+    if (nstored < 0 || !by_hash) {
+        free(stored);
+        free(rows);
+        free(by_hash);
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        by_hash[i] = &rows[i];
+    }
+    qsort(by_hash, (size_t)count, sizeof(pending_entry_t *), compare_pending_hash);
+
+    bool success = true;
+    int deleted = 0;
+    int moved = 0;
+    int i = 0, j = 0;
+    while (success && j < nstored) {
+        if (i < count && by_hash[i]->hash < stored[j].hash) {
+            i++;                              /* New entry */
+        } else if (i == count || stored[j].hash < by_hash[i]->hash) {
+            success = delete_entry(db, stored[j].id);
+            deleted++;
+            j++;
+        } else {
+            pending_entry_t *p = by_hash[i++];
+            p->matched = true;
+            if (p->entry->line_number != stored[j].line_number) {
+                success = move_entry(db, stored[j].id, p->entry->line_number);
+                moved++;
             }
+            j++;
         }
-        sqlite3_finalize(stmt);
     }
 
-    /* Update file entry count */
-    const char *update_sql =
-        "UPDATE files SET entry_count = entry_count + 1 WHERE id = ?";
+    int inserted = success ? insert_unmatched(db, file_id, rows, count) : -1;
+    if (inserted < 0) success = false;
 
-    rc = sqlite3_prepare_v2(db->db, update_sql, -1, &stmt, NULL);
-    if (rc == SQLITE_OK) {
-        sqlite3_bind_int(stmt, 1, file_id);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
+    if (success) {
+        sqlite3_stmt *stmt = db_stmt(db, STMT_FILE_SYNC_UPDATE);
+        if (stmt) {
+            sqlite3_bind_int(stmt, 1, nstored - deleted + inserted);
+            sqlite3_bind_int64(stmt, 2, fingerprint);
+            sqlite3_bind_int(stmt, 3, file_id);
+            sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+        }
+        if (verbose) {
+            fprintf(stderr, "Debug: %s: %d added, %d removed, %d moved, %d unchanged\n",
+                    filepath, inserted, deleted, moved, nstored - deleted);
+        }
+    } else {
+        fprintf(stderr, "Error: Failed to sync entries for %s: %s\n",
+                filepath, sqlite3_errmsg(db->db));
     }
 
-    return true;
+    free(stored);
+    free(rows);
+    free(by_hash);
+    return success;
+}
+
+/* Import a single entry */
+bool db_import_entry(summa_db_t *db, const char *filepath, logline_t *entry) {
+    if (!entry) return false;
+    return db_import_entries(db, filepath, &entry, 1);
+}
+
+/* Store a parsed file: a complete parse replaces what was stored for it,
+ * one narrowed by --from, --to or --tag can only add entries */
+static bool store_file_entries(summa_db_t *db, const char *filepath,
+                               logline_t **entries, int count) {
+    if (entry_filters_active()) {
+        return db_import_entries(db, filepath, entries, count);
+    }
+    return db_sync_entries(db, filepath, entries, count);
 }
 
-/* Import entire logfile */
+/* Import an entire logfile, replacing what was stored for it before */
 bool db_import_file(summa_db_t *db, const char *filepath, logfile_t *logfile) {
     if (!db || !logfile) return false;
 
-    bool success = true;
     db_begin_transaction(db);
-
-    for (int i = 0; i < logfile->count; i++) {
-        if (!db_import_entry(db, filepath, logfile->entries[i])) {
-            success = false;
-            break;
-        }
-    }
+    bool success = store_file_entries(db, filepath, logfile->entries, logfile->count);
 
     if (success) {
         db_commit_transaction(db);
@@ -554,352 +1601,831 @@ bool db_import_file(summa_db_t *db, const char *filepath, logfile_t *logfile) {
     return success;
 }
 
-/* Import scan results */
-bool db_import_scan_results(summa_db_t *db, scan_result_t *results) {
-    if (!db || !results) return false;
+/* Scan imports commit every IMPORT_COMMIT_ENTRIES entries */
+#define IMPORT_COMMIT_ENTRIES 50000
 
-    bool success = true;
-    db_begin_transaction(db);
+/* State of a scan import between files */
+typedef struct {
+    summa_db_t *db;
+    int uncommitted;       /* Entries stored since the last commit */
+} scan_import_t;
 
-    /* Process each scanned file */
-    file_info_t *file_info = results->files;
-    while (file_info && success) {
-        if (file_info->has_time_entries) {
-            /* Parse the file and import its entries */
-            FILE *fp = fopen(file_info->path, "r");
-            if (fp) {
-                logfile_t *temp_logfile = create_logfile();
-
-                /* Save current globals for parsing */
-                extern logfile_t *current_logfile;
-                extern date_t current_date;
-                logfile_t *saved_logfile = current_logfile;
-                date_t saved_date = current_date;
-
-                /* Set up parsing context */
-                current_logfile = temp_logfile;
-                current_date = file_info->inferred_date;
-
-                /* Parse the file */
-                extern int parse_two_phase(FILE* input);
-                if (parse_two_phase(fp) == 0 && temp_logfile->count > 0) {
-                    /* Import all entries from this file */
-                    for (int i = 0; i < temp_logfile->count; i++) {
-                        if (!db_import_entry(db, file_info->path, temp_logfile->entries[i])) {
-                            success = false;
-                            break;
-                        }
-                    }
-                } else {
-                    if (verbose) {
-                        fprintf(stderr, "Debug: Failed to parse or no entries in %s\n", file_info->path);
-                    }
-                }
+/* Scan sink: store one parsed file, committing once enough entries are
+ * pending */
+static bool store_scanned_file(file_info_t *file, logfile_t *parsed, void *ctx) {
+    scan_import_t *import = ctx;
 
-                /* Restore globals */
-                current_logfile = saved_logfile;
-                current_date = saved_date;
+    if (parsed->count == 0) {
+        if (verbose) fprintf(stderr, "Debug: Failed to parse or no entries in %s\n", file->path);
+        return true;
+    }
 
-                /* Clean up */
-                extern void free_logfile(logfile_t *file);
-                free_logfile(temp_logfile);
-                fclose(fp);
-            } else if (verbose) {
-                fprintf(stderr, "Warning: Could not open file %s for import\n", file_info->path);
-            }
-        }
-        file_info = file_info->next;
+    /* Bring the file's stored entries in line with it */
+    if (!store_file_entries(import->db, file->path, parsed->entries, parsed->count)) {
+        return false;
+    }
+
+    import->uncommitted += parsed->count;
+    if (import->uncommitted >= IMPORT_COMMIT_ENTRIES) {
+        import->uncommitted = 0;
+        return db_commit_transaction(import->db) && db_begin_transaction(import->db);
     }
+    return true;
+}
+
+/* Import scan results. Files are parsed on worker threads while this
+ * thread, the only writer, stores them in scan order. With merged given,
+ * the parsed entries are also kept there, so a report over the scan needs
+ * no second parse. */
+bool db_import_scan_results(summa_db_t *db, scan_result_t *results,
+                            scan_config_t *config, logfile_t *merged) {
+    if (!db || !results || !config) return false;
+
+    if (!db_begin_transaction(db)) {
+        if (merged) scan_parse_files(results, config, NULL, NULL, merged);
+        return false;
+    }
+
+    scan_import_t import = { db, 0 };
+    bool success = scan_parse_files(results, config, store_scanned_file, &import, merged);
 
     if (success) {
-        db_commit_transaction(db);
-    } else {
+        success = db_commit_transaction(db);
+    } else if (db->in_transaction) {
         db_rollback_transaction(db);
     }
-
     return success;
 }
 
-/* Query entries by date range */
-logfile_t* db_query_by_date_range(summa_db_t *db, date_t from, date_t to) {
+/* Fill date and times from day, start_minute, end_minute at column col */
+static void decode_entry_times(sqlite3_stmt *stmt, int col, logline_t *entry) {
+    if (sqlite3_column_type(stmt, col) != SQLITE_NULL) {
+        entry->date = days_to_date(sqlite3_column_int(stmt, col));
+    }
+    int start = sqlite3_column_int(stmt, col + 1);
+    int end = sqlite3_column_int(stmt, col + 2);
+    entry->timespan.start.hour = start / 60;
+    entry->timespan.start.minute = start % 60;
+    entry->timespan.end.hour = end / 60;
+    entry->timespan.end.minute = end % 60;
+}
+
+/* Rows (entry, tag pairs) fetched per keyset page; between pages the
+ * statement is reset, so long listings do not pin a read transaction */
+#define DB_QUERY_PAGE 4096
+
+/* Streaming query state */
+struct db_cursor {
+    sqlite3_stmt *stmt;
+    int limit;              /* Entries still to return, -1 = unlimited */
+    int offset;             /* Entries still to skip */
+    int page_limit;         /* Rows requested for the current page */
+    int page_rows;          /* Rows stepped on the current page */
+    int page_entries;       /* Entries completed on the current page */
+    bool row_ready;         /* stmt is on a row not yet consumed */
+    bool finished;
+    sqlite3_int64 key[4];   /* (day, start_minute, duration_minutes, id) of last entry */
+    sqlite3_int64 next_key[4];
+};
+
+/* Bind keyset position and page size, then reset page counters */
+static void cursor_bind_page(db_cursor_t *c) {
+    for (int i = 0; i < 4; i++) {
+        sqlite3_bind_int64(c->stmt, 7 + i, c->key[i]);
+    }
+    sqlite3_bind_int(c->stmt, 11, c->page_limit);
+    c->page_rows = 0;
+    c->page_entries = 0;
+    c->row_ready = false;
+}
+
+/* Turn search words into an FTS5 query: each word becomes a quoted string,
+ * so punctuation is taken literally and all words must match. Without the
+ * index, a LIKE pattern for the text as typed. Caller frees. */
+static char* search_pattern(const char *text, bool fts) {
+    size_t len = strlen(text);
+    char *out = malloc(len * 3 + 3);  /* Worst case: every char quoted */
+    if (!out) return NULL;
+
+    char *p = out;
+    if (fts) {
+        bool in_word = false;
+        for (const char *c = text; *c; c++) {
+            if (isspace((unsigned char)*c)) {
+                if (in_word) *p++ = '"';
+                in_word = false;
+                continue;
+            }
+            if (!in_word) {
+                if (p > out) *p++ = ' ';
+                *p++ = '"';
+                in_word = true;
+            }
+            if (*c == '"') *p++ = '"';
+            *p++ = *c;
+        }
+        if (in_word) *p++ = '"';
+    } else {
+        *p++ = '%';
+        for (const char *c = text; *c; c++) {
+            if (*c == '%' || *c == '_' || *c == '\\') *p++ = '\\';
+            *p++ = *c;
+        }
+        *p++ = '%';
+    }
+    *p = '\0';
+    return out;
+}
+
+/* Prepare head + WHERE + tail, where the WHERE clause applies every
+ * query_options_t filter to entries aliased "e". day_from is the lower day
+ * bound expression; parameters ?1-?6 are bound here, later numbers are the
+ * caller's. Entries without a valid date never match.
+ *
+ * When ordered, the caller walks idx_entries_day in order and the tag test
+ * is a primary key probe on entry_tags, so it cannot force a sort. Otherwise
+ * the tag is an IN list the planner may drive from idx_entry_tags_tag. */
+static void bind_entry_filters(sqlite3_stmt *stmt, const query_options_t *options);
+
+static sqlite3_stmt* prepare_entry_query(summa_db_t *db, const char *head,
+                                         const char *day_from, const char *tail,
+                                         const query_options_t *options, bool ordered) {
+    char sql[4096];
+    int len = snprintf(sql, sizeof(sql), "%s WHERE e.day BETWEEN %s AND ?2", head, day_from);
+    if (options->tag && ordered) {
+        len += snprintf(sql + len, sizeof(sql) - len,
+            "  AND EXISTS (SELECT 1 FROM entry_tags m WHERE m.entry_id = e.id"
+            "              AND m.tag_id = (SELECT id FROM tags WHERE name = ?3))");
+    } else if (options->tag) {
+        len += snprintf(sql + len, sizeof(sql) - len,
+            "  AND e.id IN (SELECT m.entry_id FROM entry_tags m"
+            "               WHERE m.tag_id = (SELECT id FROM tags WHERE name = ?3))");
+    }
+    if (options->file_pattern) {
+        len += snprintf(sql + len, sizeof(sql) - len,
+            "  AND e.file_id IN (SELECT id FROM files WHERE instr(filepath, ?4) > 0)");
+    }
+    if (options->description_pattern) {
+        len += snprintf(sql + len, sizeof(sql) - len,
+            "  AND instr(e.description, ?5) > 0");
+    }
+    if (options->search && db->has_search) {
+        len += snprintf(sql + len, sizeof(sql) - len,
+            "  AND e.id IN (SELECT rowid FROM entries_fts WHERE entries_fts MATCH ?6)");
+    } else if (options->search) {
+        len += snprintf(sql + len, sizeof(sql) - len,
+            "  AND e.description LIKE ?6 ESCAPE '\\'");
+    }
+    snprintf(sql + len, sizeof(sql) - len, " %s", tail);
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db->db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Error preparing query: %s\n", sqlite3_errmsg(db->db));
+        return NULL;
+    }
+
+    bind_entry_filters(stmt, options);
+    if (options->search) {
+        char *pattern = search_pattern(options->search, db->has_search);
+        sqlite3_bind_text(stmt, 6, pattern, -1, SQLITE_TRANSIENT);
+        free(pattern);
+    }
+    return stmt;
+}
+
+/* Bind the date, tag and pattern filters to parameters ?1-?5 */
+static void bind_entry_filters(sqlite3_stmt *stmt, const query_options_t *options) {
+    sqlite3_bind_int(stmt, 1, options->from_date.year > 0 ? date_to_days(options->from_date) : INT_MIN);
+    sqlite3_bind_int(stmt, 2, options->to_date.year > 0 ? date_to_days(options->to_date) : INT_MAX);
+    if (options->tag) sqlite3_bind_text(stmt, 3, options->tag, -1, SQLITE_TRANSIENT);
+    if (options->file_pattern) sqlite3_bind_text(stmt, 4, options->file_pattern, -1, SQLITE_TRANSIENT);
+    if (options->description_pattern) {
+        sqlite3_bind_text(stmt, 5, options->description_pattern, -1, SQLITE_TRANSIENT);
+    }
+}
+
+/* Open a cursor over entries matching options. Pages follow the
+ * idx_entries_day order by keyset, and the key's day is folded into the
+ * lower day bound so each page seeks straight to its start. */
+db_cursor_t* db_query_open(summa_db_t *db, const query_options_t *options) {
     if (!db || !db->db) return NULL;
 
-    char from_str[16], to_str[16];
-    snprintf(from_str, sizeof(from_str), "%04d-%02d-%02d",
-             from.year, from.month, from.day);
-    snprintf(to_str, sizeof(to_str), "%04d-%02d-%02d",
-             to.year, to.month, to.day);
+    query_options_t none = { 0 };
+    if (!options) options = &none;
 
-    const char *query_sql =
-        "SELECT e.id, e.date, e.start_time, e.end_time, e.duration_minutes, "
-        "       e.description, e.percentage, f.filepath "
+    sqlite3_stmt *stmt = prepare_entry_query(db,
+        "SELECT e.id, e.day, e.start_minute, e.end_minute, e.duration_minutes,"
+        "       e.description, e.percentage, t.name "
         "FROM entries e "
-        "JOIN files f ON e.file_id = f.id "
-        "WHERE e.date >= ? AND e.date <= ? "
-        "ORDER BY e.date, e.start_time";
-
-    sqlite3_stmt *stmt = NULL;
-    int rc = sqlite3_prepare_v2(db->db, query_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return NULL;
+        "LEFT JOIN entry_tags et ON et.entry_id = e.id "
+        "LEFT JOIN tags t ON t.id = et.tag_id",
+        "max(?1, ?7)",
+        "AND (e.day, e.start_minute, e.duration_minutes, e.id) > (?7, ?8, ?9, ?10) "
+        "ORDER BY e.day, e.start_minute, e.duration_minutes, e.id "
+        "LIMIT ?11",
+        options, true);
+    if (!stmt) return NULL;
+
+    db_cursor_t *c = calloc(1, sizeof(db_cursor_t));
+    if (!c) {
+        sqlite3_finalize(stmt);
+        return NULL;
+    }
 
-    sqlite3_bind_text(stmt, 1, from_str, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, to_str, -1, SQLITE_STATIC);
+    c->stmt = stmt;
+    for (int i = 0; i < 4; i++) c->key[i] = INT64_MIN;
+    c->limit = options->limit > 0 ? options->limit : -1;
+    c->offset = options->offset > 0 ? options->offset : 0;
+    /* Search results come from the full-text index, not in page order, so
+     * they are sorted once in a single page instead of once per page */
+    c->page_limit = options->search ? INT_MAX : DB_QUERY_PAGE;
+    cursor_bind_page(c);
+    return c;
+}
 
-    logfile_t *result = create_logfile();
+/* Make a row current; false once the page is exhausted */
+static bool cursor_step(db_cursor_t *c) {
+    if (c->row_ready) return true;
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        logline_t entry = {0};
+    int rc = sqlite3_step(c->stmt);
+    if (rc == SQLITE_ROW) {
+        c->page_rows++;
+        c->row_ready = true;
+        return true;
+    }
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error reading entries: %s\n", sqlite3_errmsg(sqlite3_db_handle(c->stmt)));
+        c->finished = true;
+    }
+    return false;
+}
 
-        /* Parse date */
-        const char *date_str = (const char *)sqlite3_column_text(stmt, 1);
-        if (date_str) {
-            sscanf(date_str, "%d-%d-%d",
-                   &entry.date.year, &entry.date.month, &entry.date.day);
-        } else {
-            /* Set default date if NULL */
-            entry.date.year = 1900; entry.date.month = 1; entry.date.day = 1;
+/* Read one entry with its tags from the rows sharing an id */
+static logline_t* cursor_read_entry(db_cursor_t *c) {
+    logline_t *entry = NULL;
+    sqlite3_int64 entry_id = 0;
+
+    while (cursor_step(c)) {
+        sqlite3_int64 id = sqlite3_column_int64(c->stmt, 0);
+        if (entry && id != entry_id) break;  /* Row belongs to the next entry */
+
+        if (!entry) {
+            entry = calloc(1, sizeof(logline_t));
+            if (!entry) break;
+            entry_id = id;
+
+            /* Day and minute-of-day columns */
+            decode_entry_times(c->stmt, 1, entry);
+            entry->timespan.duration_minutes = sqlite3_column_int(c->stmt, 4);
+            /* Handle NULL description safely */
+            const char *desc = (const char *)sqlite3_column_text(c->stmt, 5);
+            entry->description = desc ? strdup(desc) : NULL;
+            entry->percentage = sqlite3_column_int(c->stmt, 6);
+
+            c->next_key[0] = sqlite3_column_int64(c->stmt, 1);
+            c->next_key[1] = sqlite3_column_int64(c->stmt, 2);
+            c->next_key[2] = sqlite3_column_int64(c->stmt, 4);
+            c->next_key[3] = id;
         }
 
-        /* Parse times */
-        const char *start_str = (const char *)sqlite3_column_text(stmt, 2);
-        if (start_str) {
-            sscanf(start_str, "%d:%d", &entry.timespan.start.hour, &entry.timespan.start.minute);
-        } else {
-            entry.timespan.start.hour = 0; entry.timespan.start.minute = 0;
+        const char *tag_name = (const char *)sqlite3_column_text(c->stmt, 7);
+        if (tag_name) {
+            if (!entry->tags) entry->tags = create_taglist();
+            add_tag(entry->tags, tag_name);
         }
+        c->row_ready = false;
+    }
 
-        const char *end_str = (const char *)sqlite3_column_text(stmt, 3);
-        if (end_str) {
-            sscanf(end_str, "%d:%d", &entry.timespan.end.hour, &entry.timespan.end.minute);
-        } else {
-            entry.timespan.end.hour = 0; entry.timespan.end.minute = 0;
-        }
+    return entry;
+}
 
-        entry.timespan.duration_minutes = sqlite3_column_int(stmt, 4);
-        /* Handle NULL description safely */
-        const char *desc = (const char *)sqlite3_column_text(stmt, 5);
-        entry.description = desc ? strdup(desc) : NULL;
-        entry.percentage = sqlite3_column_int(stmt, 6);
+/* Next entry with all its tags, or NULL when done */
+logline_t* db_cursor_next(db_cursor_t *c) {
+    while (c && !c->finished && c->limit != 0) {
+        logline_t *entry = cursor_read_entry(c);
+
+        if (!c->row_ready && !c->finished) {
+            /* Page exhausted. A short page is the end of the results; a
+             * full one may have cut the last entry's tags, so it is read
+             * again from the start of the next page. */
+            sqlite3_reset(c->stmt);
+            if (c->page_rows < c->page_limit) {
+                c->finished = true;
+            } else {
+                free_logline(entry);
+                entry = NULL;
+                /* One entry filled the page: widen it to make progress */
+                if (c->page_entries == 0) c->page_limit *= 2;
+                cursor_bind_page(c);
+            }
+        }
+        if (!entry) continue;
 
-        int entry_id = sqlite3_column_int(stmt, 0);
+        memcpy(c->key, c->next_key, sizeof(c->key));
+        c->page_entries++;
 
-        /* Get tags for this entry */
-        const char *tags_sql =
-            "SELECT t.name FROM tags t "
-            "JOIN entry_tags et ON t.id = et.tag_id "
-            "WHERE et.entry_id = ?";
+        if (c->offset > 0) {
+            c->offset--;
+            free_logline(entry);
+            continue;
+        }
+        if (c->limit > 0) c->limit--;
+        return entry;
+    }
 
-        sqlite3_stmt *tag_stmt = NULL;
-        rc = sqlite3_prepare_v2(db->db, tags_sql, -1, &tag_stmt, NULL);
-        if (rc == SQLITE_OK) {
-            sqlite3_bind_int(tag_stmt, 1, entry_id);
+    return NULL;
+}
 
-            taglist_t *tags = NULL;
+/* Release a cursor */
+void db_cursor_close(db_cursor_t *c) {
+    if (!c) return;
+    sqlite3_finalize(c->stmt);
+    free(c);
+}
 
-            while (sqlite3_step(tag_stmt) == SQLITE_ROW) {
-                if (!tags) {
-                    tags = malloc(sizeof(taglist_t));
-                    tags->tags = malloc(10 * sizeof(char*));
-                    tags->count = 0;
-                    tags->capacity = 10;
-                    tags->capacity = 10;
-                }
+/* Run a query, handing each entry to callback (which must not keep it).
+ * Returns the number of entries delivered, or -1 on error. */
+int db_query_each(summa_db_t *db, const query_options_t *options,
+                  db_entry_callback_t callback, void *ctx) {
+    db_cursor_t *c = db_query_open(db, options);
+    if (!c) return -1;
+
+    int count = 0;
+    logline_t *entry;
+    while ((entry = db_cursor_next(c)) != NULL) {
+        bool more = callback(entry, ctx);
+        free_logline(entry);
+        count++;
+        if (!more) break;
+    }
 
-                const char *tag_name = (const char *)sqlite3_column_text(tag_stmt, 0);
-                if (tag_name) {
-                    /* Check if we need to expand the array */
-                    if (tags->count >= tags->capacity) {
-                        /* Check for integer overflow before doubling capacity */
-                        if (tags->capacity > INT_MAX / 2) {
-                            break;  /* Cannot expand further */
-                        }
-                        tags->capacity *= 2;
-                        char **new_tags = realloc(tags->tags, tags->capacity * sizeof(char*));
-                        if (!new_tags) {
-                            /* Memory allocation failed - skip this tag */
-                            break;
-                        }
-                        tags->tags = new_tags;
-                    }
-                    tags->tags[tags->count++] = strdup(tag_name);
-                }
-            }
+    db_cursor_close(c);
+    return count;
+}
 
-            entry.tags = tags;
-            sqlite3_finalize(tag_stmt);
+/* An entry's duration and its tag names, space-separated */
+#define TAG_SET_COLUMNS \
+    "SELECT e.duration_minutes," \
+    "       (SELECT group_concat(t.name, ' ') FROM entry_tags et" \
+    "        JOIN tags t ON t.id = et.tag_id WHERE et.entry_id = e.id) "
+
+/* Hand the tags of each matching entry with two or more tags to
+ * callback, one row per entry in no particular order, so nothing is
+ * sorted. Returns the number of entries delivered, or -1 on error.
+ *
+ * Without a date range the entries with several tags are found by one
+ * pass over entry_tags in key order. A date range walks idx_entries_day
+ * instead and probes each entry's tag count, which costs in proportion
+ * to the range rather than to the database. */
+int db_query_tag_sets(summa_db_t *db, const query_options_t *options,
+                      db_tags_callback_t callback, void *ctx) {
+    if (!db || !db->db) return -1;
+
+    query_options_t none = { 0 };
+    if (!options) options = &none;
+
+    sqlite3_stmt *stmt;
+    if (options->from_date.year > 0 || options->to_date.year > 0) {
+        stmt = prepare_entry_query(db,
+            TAG_SET_COLUMNS "FROM entries e",
+            "?1",
+            "AND (SELECT count(*) FROM entry_tags n WHERE n.entry_id = e.id) > 1",
+            options, false);
+    } else {
+        stmt = prepare_entry_query(db,
+            TAG_SET_COLUMNS
+            "FROM (SELECT entry_id FROM entry_tags GROUP BY entry_id HAVING count(*) > 1) s "
+            "JOIN entries e ON e.id = s.entry_id",
+            "?1", "", options, false);
+    }
+    if (!stmt) return -1;
+
+    int count = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        count++;
+        if (!callback((const char *)sqlite3_column_text(stmt, 1),
+                      sqlite3_column_int(stmt, 0), ctx)) {
+            rc = SQLITE_DONE;
+            break;
         }
+    }
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error reading entries: %s\n", sqlite3_errmsg(db->db));
+        count = -1;
+    }
 
-        /* Create a heap-allocated copy for the logfile */
-        logline_t *entry_copy = malloc(sizeof(logline_t));
-        *entry_copy = entry;
-        add_entry(result, entry_copy);
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+/* Hand the time span of each matching dated entry to callback, in no
+ * particular order. Returns the number delivered, or -1 on error. */
+int db_query_spans(summa_db_t *db, const query_options_t *options,
+                   db_span_callback_t callback, void *ctx) {
+    if (!db || !db->db) return -1;
+
+    query_options_t none = { 0 };
+    if (!options) options = &none;
+
+    sqlite3_stmt *stmt = prepare_entry_query(db,
+        "SELECT e.day, e.start_minute, e.duration_minutes FROM entries e",
+        "?1", "", options, false);
+    if (!stmt) return -1;
+
+    int count = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        count++;
+        if (!callback(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1),
+                      sqlite3_column_int(stmt, 2), ctx)) {
+            rc = SQLITE_DONE;
+            break;
+        }
+    }
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error reading entries: %s\n", sqlite3_errmsg(db->db));
+        count = -1;
     }
 
     sqlite3_finalize(stmt);
+    return count;
+}
+
+/* Query entries into a logfile */
+logfile_t* db_query_entries(summa_db_t *db, const query_options_t *options) {
+    db_cursor_t *c = db_query_open(db, options);
+    if (!c) return NULL;
+
+    logfile_t *result = create_logfile();
+    logline_t *entry;
+    while ((entry = db_cursor_next(c)) != NULL) {
+        add_entry(result, entry);
+    }
+
+    db_cursor_close(c);
     return result;
 }
 
+/* Query entries by date range */
+logfile_t* db_query_by_date_range(summa_db_t *db, date_t from, date_t to) {
+    query_options_t options = { .from_date = from, .to_date = to };
+    return db_query_entries(db, &options);
+}
+
 /* Query entries by tag */
 logfile_t* db_query_by_tag(summa_db_t *db, const char *tag) {
-    if (!db || !db->db || !tag) return NULL;
+    if (!tag) return NULL;
+    query_options_t options = { .tag = (char *)tag };
+    return db_query_entries(db, &options);
+}
 
-    const char *query_sql =
-        "SELECT e.id, e.date, e.start_time, e.end_time, e.duration_minutes, "
-        "       e.description, e.percentage, f.filepath "
-        "FROM entries e "
-        "JOIN files f ON e.file_id = f.id "
-        "JOIN entry_tags et ON e.id = et.entry_id "
-        "JOIN tags t ON et.tag_id = t.id "
-        "WHERE t.name = ? "
-        "ORDER BY e.date, e.start_time";
+/* Statistics without scanning entries: totals and the date range come
+ * from the daily rollups (one row per day), plus an index range over the
+ * few entries without a day, which the rollups leave out. Files and tags
+ * in use take one index probe per row of files and tags, so that part
+ * grows with the number of files and tags but not with entries. */
+static const char *stats_sql =
+    "WITH d AS (SELECT TOTAL(entries) AS entries, TOTAL(minutes) AS minutes,"
+    "             MIN(day) AS min_day, MAX(day) AS max_day FROM daily_totals),"
+    "     u AS (SELECT COUNT(*) AS entries, TOTAL(duration_minutes) AS minutes"
+    "             FROM entries WHERE day IS NULL) "
+    "SELECT CAST(d.entries + u.entries AS INTEGER),"
+    "  (SELECT COUNT(*) FROM files f"
+    "    WHERE EXISTS (SELECT 1 FROM entries e WHERE e.file_id = f.id)),"
+    "  (SELECT COUNT(*) FROM tags t"
+    "    WHERE EXISTS (SELECT 1 FROM entry_tags et WHERE et.tag_id = t.id)),"
+    "  CAST(d.minutes + u.minutes AS INTEGER), d.min_day, d.max_day "
+    "FROM d, u";
+
+db_stats_t* db_get_stats(summa_db_t *db) {
+    if (!db || !db->db) return NULL;
 
     sqlite3_stmt *stmt = NULL;
-    int rc = sqlite3_prepare_v2(db->db, query_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return NULL;
+    if (sqlite3_prepare_v2(db->db, stats_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Error reading database statistics: %s\n", sqlite3_errmsg(db->db));
+        return NULL;
+    }
 
-    sqlite3_bind_text(stmt, 1, tag, -1, SQLITE_STATIC);
+    db_stats_t *stats = calloc(1, sizeof(db_stats_t));
+    if (stats && sqlite3_step(stmt) == SQLITE_ROW) {
+        stats->total_entries = sqlite3_column_int64(stmt, 0);
+        stats->total_files = sqlite3_column_int(stmt, 1);
+        stats->total_tags = sqlite3_column_int(stmt, 2);
+        stats->total_minutes = sqlite3_column_int64(stmt, 3);
+
+        if (sqlite3_column_type(stmt, 4) != SQLITE_NULL) {
+            stats->earliest_date = days_to_date(sqlite3_column_int(stmt, 4));
+        }
+        if (sqlite3_column_type(stmt, 5) != SQLITE_NULL) {
+            stats->latest_date = days_to_date(sqlite3_column_int(stmt, 5));
+        }
+    } else if (stats) {
+        fprintf(stderr, "Error reading database statistics: %s\n", sqlite3_errmsg(db->db));
+        free(stats);
+        stats = NULL;
+    }
+    sqlite3_finalize(stmt);
 
-    logfile_t *result = create_logfile();
+    return stats;
+}
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        logline_t entry = {0};
+/* Aggregates. Reports read the daily rollups: at most one row per day,
+ * or per (tag, day) with --tag, whatever the number of entries. Filters
+ * the rollups cannot answer (file and description patterns, searches, or
+ * per-tag totals within a tag) fall back to a GROUP BY over the matching
+ * entries. Either way only aggregate rows leave SQLite. */
+
+/* Per-day totals computed from entries */
+#define DAILY_TOTALS_HEAD \
+    "SELECT e.day AS day, SUM(e.duration_minutes) AS minutes, COUNT(*) AS entries " \
+    "FROM entries e"
+#define DAILY_TOTALS_TAIL "GROUP BY e.day"
+
+/* Days since 1970-01-01 as a julian day number for strftime() */
+#define SQL_JULIAN(day) "(" day " + 2440587.5)"
+
+/* Prepare head + "(per-day totals) d" + tail for options */
+static sqlite3_stmt* prepare_daily_query(summa_db_t *db, const char *head,
+                                         const char *tail, const query_options_t *options) {
+    char sql[2048];
+
+    if (options->file_pattern || options->description_pattern || options->search) {
+        char inner_head[1024], inner_tail[1024];
+        snprintf(inner_head, sizeof(inner_head), "%s (" DAILY_TOTALS_HEAD, head);
+        snprintf(inner_tail, sizeof(inner_tail), DAILY_TOTALS_TAIL ") d %s", tail);
+        return prepare_entry_query(db, inner_head, "?1", inner_tail, options, false);
+    }
 
-        /* Parse date */
-        const char *date_str = (const char *)sqlite3_column_text(stmt, 1);
-        if (date_str) {
-            sscanf(date_str, "%d-%d-%d",
-                   &entry.date.year, &entry.date.month, &entry.date.day);
-        } else {
-            /* Set default date if NULL */
-            entry.date.year = 1900; entry.date.month = 1; entry.date.day = 1;
-        }
+    if (options->tag) {
+        snprintf(sql, sizeof(sql),
+                 "%s (SELECT day, minutes, entries FROM daily_tag_totals"
+                 "    WHERE tag_id = (SELECT id FROM tags WHERE name = ?3)"
+                 "      AND day BETWEEN ?1 AND ?2) d %s", head, tail);
+    } else {
+        snprintf(sql, sizeof(sql),
+                 "%s (SELECT day, minutes, entries FROM daily_totals"
+                 "    WHERE day BETWEEN ?1 AND ?2) d %s", head, tail);
+    }
 
-        /* Parse times */
-        const char *start_str = (const char *)sqlite3_column_text(stmt, 2);
-        if (start_str) {
-            sscanf(start_str, "%d:%d", &entry.timespan.start.hour, &entry.timespan.start.minute);
-        } else {
-            entry.timespan.start.hour = 0; entry.timespan.start.minute = 0;
-        }
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db->db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Error preparing query: %s\n", sqlite3_errmsg(db->db));
+        return NULL;
+    }
+    bind_entry_filters(stmt, options);
+    return stmt;
+}
 
-        const char *end_str = (const char *)sqlite3_column_text(stmt, 3);
-        if (end_str) {
-            sscanf(end_str, "%d:%d", &entry.timespan.end.hour, &entry.timespan.end.minute);
-        } else {
-            entry.timespan.end.hour = 0; entry.timespan.end.minute = 0;
-        }
+/* Grow a result array of element size before appending row count */
+static bool grow_rows(void **rows, int *capacity, int count, size_t size) {
+    if (count < *capacity) return true;
 
-        entry.timespan.duration_minutes = sqlite3_column_int(stmt, 4);
-        /* Handle NULL description safely */
-        const char *desc = (const char *)sqlite3_column_text(stmt, 5);
-        entry.description = desc ? strdup(desc) : NULL;
-        entry.percentage = sqlite3_column_int(stmt, 6);
+    int new_capacity = *capacity ? *capacity * 2 : 64;
+    void *grown = realloc(*rows, size * new_capacity);
+    if (!grown) {
+        fprintf(stderr, "Error: Failed to expand summary rows\n");
+        return false;
+    }
+    *rows = grown;
+    *capacity = new_capacity;
+    return true;
+}
 
-        int entry_id = sqlite3_column_int(stmt, 0);
+/* Entry count and total minutes matching options */
+bool db_get_totals(summa_db_t *db, const query_options_t *options,
+                   int *entry_count, int *total_minutes) {
+    if (!db || !db->db) return false;
 
-        /* Get all tags for this entry */
-        const char *tags_sql =
-            "SELECT t.name FROM tags t "
-            "JOIN entry_tags et ON t.id = et.tag_id "
-            "WHERE et.entry_id = ?";
+    query_options_t none = { 0 };
+    sqlite3_stmt *stmt = prepare_daily_query(db,
+        "SELECT COALESCE(SUM(d.entries), 0), COALESCE(SUM(d.minutes), 0) FROM", "",
+        options ? options : &none);
+    if (!stmt) return false;
 
-        sqlite3_stmt *tag_stmt = NULL;
-        rc = sqlite3_prepare_v2(db->db, tags_sql, -1, &tag_stmt, NULL);
-        if (rc == SQLITE_OK) {
-            sqlite3_bind_int(tag_stmt, 1, entry_id);
+    bool success = (sqlite3_step(stmt) == SQLITE_ROW);
+    if (success) {
+        *entry_count = sqlite3_column_int(stmt, 0);
+        *total_minutes = sqlite3_column_int(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+    return success;
+}
 
-            taglist_t *tags = NULL;
+/* Minutes and entries per tag, unsorted; tag names are malloc'd */
+tag_summary_t* db_get_tag_summary(summa_db_t *db, const query_options_t *options, int *count) {
+    return db_get_top_tags(db, options, SORT_ALPHA, 0, count);
+}
 
-            while (sqlite3_step(tag_stmt) == SQLITE_ROW) {
-                if (!tags) {
-                    tags = malloc(sizeof(taglist_t));
-                    tags->tags = malloc(10 * sizeof(char*));
-                    tags->count = 0;
-                    tags->capacity = 10;
-                    tags->capacity = 10;
-                }
+/* The top tags in order, ranked by SQLite with a bounded sort; top 0
+ * returns every tag unordered */
+tag_summary_t* db_get_top_tags(summa_db_t *db, const query_options_t *options,
+                               tag_sort_t order, int top, int *count) {
+    *count = 0;
+    if (!db || !db->db) return NULL;
 
-                const char *tag_name = (const char *)sqlite3_column_text(tag_stmt, 0);
-                if (tag_name) {
-                    /* Check if we need to expand the array */
-                    if (tags->count >= tags->capacity) {
-                        /* Check for integer overflow before doubling capacity */
-                        if (tags->capacity > INT_MAX / 2) {
-                            break;  /* Cannot expand further */
-                        }
-                        tags->capacity *= 2;
-                        char **new_tags = realloc(tags->tags, tags->capacity * sizeof(char*));
-                        if (!new_tags) {
-                            /* Memory allocation failed - skip this tag */
-                            break;
-                        }
-                        tags->tags = new_tags;
-                    }
-                    tags->tags[tags->count++] = strdup(tag_name);
-                }
-            }
+    query_options_t none = { 0 };
+    if (!options) options = &none;
 
-            entry.tags = tags;
-            sqlite3_finalize(tag_stmt);
+    /* Columns are name, minutes, entries; ties go to the name, as in
+     * compare_tags_by_time and compare_tags_by_count */
+    char order_by[64] = "";
+    if (top > 0) {
+        snprintf(order_by, sizeof(order_by), " ORDER BY %s LIMIT %d",
+                 order == SORT_TIME ? "2 DESC, 1" :
+                 order == SORT_COUNT ? "3 DESC, 1" : "1", top);
+    }
+
+    sqlite3_stmt *stmt;
+    if (options->tag || options->file_pattern || options->description_pattern ||
+        options->search) {
+        /* Every tag of the matching entries: not in the rollups */
+        char tail[128];
+        snprintf(tail, sizeof(tail), "GROUP BY et.tag_id) s JOIN tags t ON t.id = s.tag_id%s", order_by);
+        stmt = prepare_entry_query(db,
+            "SELECT t.name, s.minutes, s.entries "
+            "FROM (SELECT et.tag_id AS tag_id, SUM(e.duration_minutes) AS minutes,"
+            "             COUNT(*) AS entries"
+            "      FROM entries e JOIN entry_tags et ON et.entry_id = e.id",
+            "?1", tail, options, false);
+    } else {
+        char sql[256];
+        snprintf(sql, sizeof(sql),
+                 "SELECT t.name, SUM(r.minutes), SUM(r.entries) "
+                 "FROM daily_tag_totals r JOIN tags t ON t.id = r.tag_id "
+                 "WHERE r.day BETWEEN ?1 AND ?2 "
+                 "GROUP BY r.tag_id%s", order_by);
+        stmt = NULL;
+        if (sqlite3_prepare_v2(db->db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+            fprintf(stderr, "Error preparing query: %s\n", sqlite3_errmsg(db->db));
+            return NULL;
         }
+        bind_entry_filters(stmt, options);
+    }
+    if (!stmt) return NULL;
 
-        /* Create a heap-allocated copy for the logfile */
-        logline_t *entry_copy = malloc(sizeof(logline_t));
-        *entry_copy = entry;
-        add_entry(result, entry_copy);
+    tag_summary_t *rows = NULL;
+    int capacity = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (!grow_rows((void **)&rows, &capacity, *count, sizeof(tag_summary_t))) break;
+        tag_summary_t *row = &rows[(*count)++];
+        row->tag = strdup((const char *)sqlite3_column_text(stmt, 0));
+        row->total_minutes = sqlite3_column_int(stmt, 1);
+        row->entry_count = sqlite3_column_int(stmt, 2);
     }
 
     sqlite3_finalize(stmt);
-    return result;
+    return rows;
 }
 
-/* Get database statistics */
-db_stats_t* db_get_stats(summa_db_t *db) {
+/* Names of the tags on at least one entry, in name order; malloc'd
+ * array of malloc'd strings */
+char** db_get_tag_names(summa_db_t *db, int *count) {
+    *count = 0;
     if (!db || !db->db) return NULL;
 
-    db_stats_t *stats = calloc(1, sizeof(db_stats_t));
-    if (!stats) return NULL;
-
-    /* Count entries */
-    const char *count_sql =
-        "SELECT COUNT(*) as entries, "
-        "       COUNT(DISTINCT file_id) as files, "
-        "       COUNT(DISTINCT tag_id) as tags, "
-        "       SUM(duration_minutes) as minutes, "
-        "       MIN(date) as min_date, "
-        "       MAX(date) as max_date "
-        "FROM entries e "
-        "LEFT JOIN entry_tags et ON e.id = et.entry_id";
-
     sqlite3_stmt *stmt = NULL;
-    int rc = sqlite3_prepare_v2(db->db, count_sql, -1, &stmt, NULL);
-    if (rc == SQLITE_OK) {
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            stats->total_entries = sqlite3_column_int(stmt, 0);
-            stats->total_files = sqlite3_column_int(stmt, 1);
-            stats->total_tags = sqlite3_column_int(stmt, 2);
-            stats->total_minutes = sqlite3_column_int(stmt, 3);
-
-            const char *min_date = (const char *)sqlite3_column_text(stmt, 4);
-            if (min_date) {
-                sscanf(min_date, "%d-%d-%d",
-                       &stats->earliest_date.year,
-                       &stats->earliest_date.month,
-                       &stats->earliest_date.day);
-            }
+    if (sqlite3_prepare_v2(db->db,
+            "SELECT name FROM tags t "
+            "WHERE EXISTS (SELECT 1 FROM entry_tags et WHERE et.tag_id = t.id) "
+            "ORDER BY name", -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Error preparing query: %s\n", sqlite3_errmsg(db->db));
+        return NULL;
+    }
 
-            const char *max_date = (const char *)sqlite3_column_text(stmt, 5);
-            if (max_date) {
-                sscanf(max_date, "%d-%d-%d",
-                       &stats->latest_date.year,
-                       &stats->latest_date.month,
-                       &stats->latest_date.day);
-            }
-        }
-        sqlite3_finalize(stmt);
+    char **names = NULL;
+    int capacity = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (!grow_rows((void **)&names, &capacity, *count, sizeof(char *))) break;
+        names[(*count)++] = strdup((const char *)sqlite3_column_text(stmt, 0));
     }
 
-    return stats;
+    sqlite3_finalize(stmt);
+    return names;
+}
+
+/* Totals per day, in date order */
+daily_summary_t* db_get_daily_summary(summa_db_t *db, const query_options_t *options, int *count) {
+    *count = 0;
+    if (!db || !db->db) return NULL;
+
+    query_options_t none = { 0 };
+    sqlite3_stmt *stmt = prepare_daily_query(db,
+        "SELECT d.day, d.minutes, d.entries FROM", "ORDER BY d.day",
+        options ? options : &none);
+    if (!stmt) return NULL;
+
+    daily_summary_t *rows = NULL;
+    int capacity = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (!grow_rows((void **)&rows, &capacity, *count, sizeof(daily_summary_t))) break;
+        daily_summary_t *row = &rows[(*count)++];
+        row->date = days_to_date(sqlite3_column_int(stmt, 0));
+        row->total_minutes = sqlite3_column_int(stmt, 1);
+        row->entry_count = sqlite3_column_int(stmt, 2);
+    }
+
+    sqlite3_finalize(stmt);
+    return rows;
+}
+
+/* Totals per Monday-based week, split at year boundaries, in date order */
+weekly_summary_t* db_get_weekly_summary(summa_db_t *db, const query_options_t *options, int *count) {
+    *count = 0;
+    if (!db || !db->db) return NULL;
+
+    /* 1970-01-01 was a Thursday, so (day + 3) mod 7 is days since Monday */
+    query_options_t none = { 0 };
+    sqlite3_stmt *stmt = prepare_daily_query(db,
+        "SELECT CAST(strftime('%Y', " SQL_JULIAN("d.day") ") AS INTEGER) AS year,"
+        "       MIN(d.day), MAX(d.day), SUM(d.minutes), SUM(d.entries) FROM",
+        "GROUP BY year, d.day - ((d.day % 7 + 10) % 7) "
+        "ORDER BY MIN(d.day)",
+        options ? options : &none);
+    if (!stmt) return NULL;
+
+    weekly_summary_t *rows = NULL;
+    int capacity = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (!grow_rows((void **)&rows, &capacity, *count, sizeof(weekly_summary_t))) break;
+        weekly_summary_t *row = &rows[(*count)++];
+        row->year = sqlite3_column_int(stmt, 0);
+        row->first_day = days_to_date(sqlite3_column_int(stmt, 1));
+        row->last_day = days_to_date(sqlite3_column_int(stmt, 2));
+        row->week = get_iso_week(row->first_day.year, row->first_day.month, row->first_day.day);
+        row->total_minutes = sqlite3_column_int(stmt, 3);
+        row->entry_count = sqlite3_column_int(stmt, 4);
+    }
+
+    sqlite3_finalize(stmt);
+    return rows;
+}
+
+/* Totals per calendar month, in date order */
+monthly_summary_t* db_get_monthly_summary(summa_db_t *db, const query_options_t *options, int *count) {
+    *count = 0;
+    if (!db || !db->db) return NULL;
+
+    query_options_t none = { 0 };
+    sqlite3_stmt *stmt = prepare_daily_query(db,
+        "SELECT CAST(strftime('%Y', " SQL_JULIAN("d.day") ") AS INTEGER) AS year,"
+        "       CAST(strftime('%m', " SQL_JULIAN("d.day") ") AS INTEGER) AS month,"
+        "       SUM(d.minutes), SUM(d.entries), COUNT(*) FROM",
+        "GROUP BY year, month "
+        "ORDER BY MIN(d.day)",
+        options ? options : &none);
+    if (!stmt) return NULL;
+
+    monthly_summary_t *rows = NULL;
+    int capacity = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (!grow_rows((void **)&rows, &capacity, *count, sizeof(monthly_summary_t))) break;
+        monthly_summary_t *row = &rows[(*count)++];
+        row->year = sqlite3_column_int(stmt, 0);
+        row->month = sqlite3_column_int(stmt, 1);
+        row->total_minutes = sqlite3_column_int(stmt, 2);
+        row->entry_count = sqlite3_column_int(stmt, 3);
+        row->days_with_entries = sqlite3_column_int(stmt, 4);
+    }
+
+    sqlite3_finalize(stmt);
+    return rows;
+}
+
+/* Create the full-text index if missing, and refill it from the entries */
+bool db_rebuild_search(summa_db_t *db) {
+    if (!db || !db->db) return false;
+
+    bool success = create_search_index(db, true);
+    db->has_search = search_index_exists(db);
+    return success;
+}
+
+/* Recompute the report rollups from the entries */
+bool db_rebuild_rollups(summa_db_t *db) {
+    if (!db || !db->db) return false;
+
+    if (!exec_sql(db, "BEGIN IMMEDIATE;" ROLLUP_REBUILD "COMMIT;", "rebuilding rollups")) {
+        sqlite3_exec(db->db, "ROLLBACK", NULL, NULL, NULL);
+        return false;
+    }
+    return true;
+}
+
+/* PRAGMA data_version: lets a long-lived connection tell when cached
+ * results are stale */
+long long db_data_version(summa_db_t *db) {
+    if (!db || !db->db) return -1;
+
+    sqlite3_stmt *stmt = db_stmt(db, STMT_DATA_VERSION);
+    if (!stmt) return -1;
+
+    long long version = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_reset(stmt);
+    return version;
 }
 
 /* Vacuum database */
@@ -918,31 +2444,128 @@ bool db_vacuum(summa_db_t *db) {
     return true;
 }
 
-/* Backup database */
-bool db_backup(summa_db_t *db, const char *backup_path) {
+/* Online backups copy DB_BACKUP_PAGES pages per step and pause
+ * DB_BACKUP_PAUSE_MS between steps, holding the source's read lock only
+ * while a step runs. A write through another connection restarts the
+ * copy; after DB_BACKUP_RESTARTS restarts the rest goes in one step so a
+ * busy database still gets backed up. Backup steps skip the busy
+ * handler, so a source that stays locked for the profile's busy timeout
+ * fails the backup instead of stalling it. */
+#define DB_BACKUP_PAGES 1024
+#define DB_BACKUP_PAUSE_MS 10
+#define DB_BACKUP_RESTARTS 3
+
+/* Copy the database page by page into path */
+static bool backup_pages(summa_db_t *db, const char *path, const db_backup_options_t *options) {
+    int pages = options->pages_per_step > 0 ? options->pages_per_step : DB_BACKUP_PAGES;
+    int pause_ms = options->pause_ms > 0 ? options->pause_ms : DB_BACKUP_PAUSE_MS;
+
+    sqlite3 *backup_db;
+    if (sqlite3_open(path, &backup_db) != SQLITE_OK) {
+        fprintf(stderr, "Error opening backup %s: %s\n", path, sqlite3_errmsg(backup_db));
+        sqlite3_close(backup_db);
+        return false;
+    }
+
+    sqlite3_backup *backup = sqlite3_backup_init(backup_db, "main", db->db, "main");
+    if (!backup) {
+        fprintf(stderr, "Error starting backup: %s\n", sqlite3_errmsg(backup_db));
+        sqlite3_close(backup_db);
+        return false;
+    }
+
+    int max_waits = db->busy_timeout_ms / pause_ms;
+    if (max_waits < 1) max_waits = 1;
+
+    int rc;
+    int restarts = 0;
+    int waits = 0;
+    int last_remaining = -1;
+    do {
+        rc = sqlite3_backup_step(backup, restarts >= DB_BACKUP_RESTARTS ? -1 : pages);
+
+        int remaining = sqlite3_backup_remaining(backup);
+        int total = sqlite3_backup_pagecount(backup);
+        if (last_remaining >= 0 && remaining > last_remaining) restarts++;
+        last_remaining = remaining;
+        if (options->progress) options->progress(remaining, total, options->progress_ctx);
+
+        if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            if (++waits > max_waits) break;
+        } else {
+            waits = 0;
+        }
+        if (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            sqlite3_sleep(pause_ms);
+        }
+    } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+
+    bool timed_out = waits > max_waits;
+
+    /* finish reports the first error of any step; the destination
+     * connection's error code need not carry it. BUSY and LOCKED are not
+     * errors to it, so a timed-out backup is reported here. */
+    rc = sqlite3_backup_finish(backup);
+    if (timed_out) {
+        fprintf(stderr, "Error backing up database: source still locked after %d retries %d ms apart\n",
+                max_waits, pause_ms);
+    } else if (rc != SQLITE_OK) {
+        fprintf(stderr, "Error backing up database: %s\n", sqlite3_errstr(rc));
+    }
+    sqlite3_close(backup_db);
+
+    return !timed_out && rc == SQLITE_OK;
+}
+
+/* Write a compacted copy with VACUUM INTO, in one read transaction (no
+ * progress reports) */
+static bool backup_vacuum(summa_db_t *db, const char *path) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db->db, "VACUUM INTO ?", -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Error preparing compact backup: %s\n", sqlite3_errmsg(db->db));
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+
+    int rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error writing compact backup: %s\n", sqlite3_errmsg(db->db));
+    }
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE;
+}
+
+/* Backup database. The copy is written next to backup_path and renamed
+ * over it once complete, so a failed backup never replaces a good one. */
+bool db_backup(summa_db_t *db, const char *backup_path,
+               const db_backup_options_t *options) {
     if (!db || !db->db || !backup_path) return false;
 
+    static const db_backup_options_t defaults = { 0 };
+    if (!options) options = &defaults;
+
     char *expanded_path = db_expand_path(backup_path);
+    if (!expanded_path) return false;
 
-    /* Open backup database */
-    sqlite3 *backup_db;
-    int rc = sqlite3_open(expanded_path, &backup_db);
-    if (rc != SQLITE_OK) {
+    size_t len = strlen(expanded_path) + sizeof(".partial");
+    char *partial_path = malloc(len);
+    if (!partial_path) {
         free(expanded_path);
         return false;
     }
+    snprintf(partial_path, len, "%s.partial", expanded_path);
+    unlink(partial_path);   /* Left over from an interrupted backup */
+
+    bool success = options->compact ? backup_vacuum(db, partial_path)
+                                    : backup_pages(db, partial_path, options);
 
-    /* Perform backup */
-    sqlite3_backup *backup = sqlite3_backup_init(backup_db, "main",
-                                                 db->db, "main");
-    if (backup) {
-        sqlite3_backup_step(backup, -1);
-        sqlite3_backup_finish(backup);
+    if (success && rename(partial_path, expanded_path) != 0) {
+        fprintf(stderr, "Error replacing %s: %s\n", expanded_path, strerror(errno));
+        success = false;
     }
+    if (!success) unlink(partial_path);
 
-    rc = sqlite3_errcode(backup_db);
-    sqlite3_close(backup_db);
+    free(partial_path);
     free(expanded_path);
-
-    return rc == SQLITE_OK;
+    return success;
 }
@@ -11,42 +11,107 @@
 #include "summa_scan.h"
 
 /* Database version for schema migrations */
-#define DB_VERSION 1
+#define DB_VERSION 6
 
 /* Default database path */
 #define DEFAULT_DB_PATH "~/.summa/summa.db"
 
+/* Connection tuning profiles (see db_apply_profile) */
+typedef enum {
+    DB_PROFILE_INTERACTIVE,  /* WAL, readers never wait on imports (default) */
+    DB_PROFILE_BULK,         /* WAL, large caches, no fsync; for big imports */
+    DB_PROFILE_SAFE          /* Rollback journal, full fsync; network filesystems */
+} db_profile_t;
+
+/* Statements prepared once per connection and reused (see db_stmt) */
+typedef enum {
+    STMT_FILE_INSERT,
+    STMT_FILE_ID,
+    STMT_FILE_COUNT_UPDATE,
+    STMT_ENTRY_INSERT,
+    STMT_ENTRY_INSERT_BATCH,
+    STMT_ENTRY_TAG_INSERT,
+    STMT_TAG_SELECT,
+    STMT_TAG_INSERT,
+    STMT_FILE_ENTRIES,
+    STMT_FILE_ENTRY_COUNT,
+    STMT_FILE_SYNC_UPDATE,
+    STMT_ENTRY_DELETE,
+    STMT_ENTRY_LINE_UPDATE,
+    STMT_DATA_VERSION,
+    STMT_COUNT
+} db_stmt_id_t;
+
+/* Rows per multi-row INSERT in bulk imports */
+#define DB_INSERT_BATCH 64
+
+/* Tag name -> ID cache used by imports (defined in summa_db.c) */
+typedef struct db_tag_cache db_tag_cache_t;
+
 /* Database connection handle */
 typedef struct {
     sqlite3 *db;
     char *path;
     bool in_transaction;
+    sqlite3_stmt *stmts[STMT_COUNT];  /* Lazily prepared, finalized in db_close */
+    db_tag_cache_t *tag_cache;        /* Dropped on rollback */
+    bool has_search;                  /* entries_fts exists (SQLite has FTS5) */
+    int busy_timeout_ms;              /* From the profile; bounds waits SQLite does not time */
 } summa_db_t;
 
 /* Statistics structure */
 typedef struct {
-    int total_entries;
-    int total_files;
-    int total_tags;
-    int total_minutes;
+    long long total_entries;
+    int total_files;             /* Files with at least one entry */
+    int total_tags;              /* Tags on at least one entry */
+    long long total_minutes;
     date_t earliest_date;
     date_t latest_date;
 } db_stats_t;
 
-/* Query options */
+/* Query options; zero/NULL fields do not filter */
 typedef struct {
-    date_t from_date;
+    date_t from_date;            /* Inclusive; year 0 = unbounded */
     date_t to_date;
-    char *tag;
-    char *file_pattern;
-    char *description_pattern;
-    int limit;
-    int offset;
+    char *tag;                   /* Entries carrying this tag (without #) */
+    char *file_pattern;          /* Substring of the source file path */
+    char *description_pattern;   /* Substring of the description */
+    char *search;                /* Words that must all occur in the description */
+    int limit;                   /* Maximum entries, 0 = all */
+    int offset;                  /* Entries to skip before the first */
 } query_options_t;
 
+/* Backup progress: pages still to copy out of the source's total */
+typedef void (*db_backup_progress_t)(int remaining, int total, void *ctx);
+
+/* Backup options; zero/NULL fields take the defaults */
+typedef struct {
+    int pages_per_step;          /* Pages copied per step [DB_BACKUP_PAGES] */
+    int pause_ms;                /* Pause between steps [DB_BACKUP_PAUSE_MS] */
+    bool compact;                /* VACUUM INTO a compacted snapshot instead */
+    db_backup_progress_t progress;
+    void *progress_ctx;
+} db_backup_options_t;
+
+/* Streaming query cursor (see db_query_open) */
+typedef struct db_cursor db_cursor_t;
+
+/* Per-entry callback for db_query_each; return false to stop early */
+typedef bool (*db_entry_callback_t)(logline_t *entry, void *ctx);
+
+/* Per-entry callback for db_query_tag_sets: the entry's tag names,
+ * space-separated, and its duration */
+typedef bool (*db_tags_callback_t)(const char *tags, int minutes, void *ctx);
+
+/* Per-entry callback for db_query_spans: day number, start minute of the
+ * day and duration */
+typedef bool (*db_span_callback_t)(int day, int start_minute, int duration, void *ctx);
+
 /* Database initialization and management */
-summa_db_t* db_open(const char *path);
+summa_db_t* db_open(const char *path, db_profile_t profile);
 void db_close(summa_db_t *db);
+bool db_apply_profile(summa_db_t *db, db_profile_t profile);
+bool db_parse_profile(const char *name, db_profile_t *profile);
 bool db_init_schema(summa_db_t *db);
 bool db_check_schema(summa_db_t *db);
 bool db_migrate_schema(summa_db_t *db, int from_version);
@@ -56,23 +121,46 @@ bool db_begin_transaction(summa_db_t *db);
 bool db_commit_transaction(summa_db_t *db);
 bool db_rollback_transaction(summa_db_t *db);
 
-/* Import operations */
+/* Import operations. db_import_entries only adds entries; db_sync_entries
+ * takes the complete entry set of a file and also drops stored entries
+ * that are no longer in it. db_import_file and db_import_scan_results
+ * sync, unless the parse was narrowed by --from, --to or --tag. */
 bool db_import_file(summa_db_t *db, const char *filepath, logfile_t *logfile);
 bool db_import_entry(summa_db_t *db, const char *filepath, logline_t *entry);
-bool db_import_scan_results(summa_db_t *db, scan_result_t *results);
+bool db_import_entries(summa_db_t *db, const char *filepath,
+                       logline_t **entries, int count);
+bool db_sync_entries(summa_db_t *db, const char *filepath,
+                     logline_t **entries, int count);
+bool db_import_scan_results(summa_db_t *db, scan_result_t *results,
+                            scan_config_t *config, logfile_t *merged);
 
 /* Query operations */
-logfile_t* db_query_entries(summa_db_t *db, query_options_t *options);
+db_cursor_t* db_query_open(summa_db_t *db, const query_options_t *options);
+logline_t* db_cursor_next(db_cursor_t *cursor);  /* Caller frees the entry */
+void db_cursor_close(db_cursor_t *cursor);
+int db_query_each(summa_db_t *db, const query_options_t *options,
+                  db_entry_callback_t callback, void *ctx);
+logfile_t* db_query_entries(summa_db_t *db, const query_options_t *options);
+int db_query_tag_sets(summa_db_t *db, const query_options_t *options,
+                      db_tags_callback_t callback, void *ctx);  /* Entries with 2+ tags */
+int db_query_spans(summa_db_t *db, const query_options_t *options,
+                   db_span_callback_t callback, void *ctx);
 logfile_t* db_query_by_date_range(summa_db_t *db, date_t from, date_t to);
 logfile_t* db_query_by_tag(summa_db_t *db, const char *tag);
 logfile_t* db_query_by_file(summa_db_t *db, const char *filepath);
 
 /* Statistics and aggregation */
 db_stats_t* db_get_stats(summa_db_t *db);
-/* tag_summary_t* db_get_tag_summary(summa_db_t *db, query_options_t *options); */
-logfile_t* db_get_daily_summary(summa_db_t *db, query_options_t *options);
-logfile_t* db_get_weekly_summary(summa_db_t *db, query_options_t *options);
-logfile_t* db_get_monthly_summary(summa_db_t *db, query_options_t *options);
+char** db_get_tag_names(summa_db_t *db, int *count);
+/* Summary rows are malloc'd arrays of *count rows (NULL when empty) */
+bool db_get_totals(summa_db_t *db, const query_options_t *options,
+                   int *entry_count, int *total_minutes);
+tag_summary_t* db_get_tag_summary(summa_db_t *db, const query_options_t *options, int *count);
+tag_summary_t* db_get_top_tags(summa_db_t *db, const query_options_t *options,
+                               tag_sort_t order, int top, int *count);  /* Ordered, at most top */
+daily_summary_t* db_get_daily_summary(summa_db_t *db, const query_options_t *options, int *count);
+weekly_summary_t* db_get_weekly_summary(summa_db_t *db, const query_options_t *options, int *count);
+monthly_summary_t* db_get_monthly_summary(summa_db_t *db, const query_options_t *options, int *count);
 
 /* Cache operations for scan results */
 bool db_cache_file_scan(summa_db_t *db, const char *filepath,
@@ -87,6 +175,11 @@ bool db_export_to_file(summa_db_t *db, const char *filepath,
 /* Utility functions */
 char* db_expand_path(const char *path);
 bool db_vacuum(summa_db_t *db);
-bool db_backup(summa_db_t *db, const char *backup_path);
+/* Changes whenever another connection commits; -1 on error */
+long long db_data_version(summa_db_t *db);
+bool db_rebuild_rollups(summa_db_t *db);
+bool db_rebuild_search(summa_db_t *db);
+bool db_backup(summa_db_t *db, const char *backup_path,
+               const db_backup_options_t *options);
 
 #endif /* SUMMA_DB_H */
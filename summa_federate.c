@@ -0,0 +1,350 @@
+/*
+ * summa_federate.c - Reports across several Summa databases
+ *
+ * Each database in a set keeps its own connection, so the aggregate
+ * queries of a report run at the same time, one thread per database, and
+ * only their result rows are merged here: tag rows by name, day rows by
+ * date. Weeks and months are rebuilt from the merged days rather than
+ * added up, because "days with entries" must count a day worked in two
+ * databases once. Entry listings are merged from one cursor per database.
+ *
+ * A set of one database goes straight to the db_get_* functions, so a
+ * single --db reports exactly as before.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "summa.h"
+#include "summa_db.h"
+#include "summa_federate.h"
+
+/* Defined in summa.c */
+extern void free_logline(logline_t *entry);
+extern int compare_dates(date_t *d1, date_t *d2);
+
+/* What one database contributed to a merged result */
+typedef struct {
+    void *rows;
+    int count;
+    int entries;
+    int minutes;
+    db_stats_t *stats;
+    bool ok;
+} db_set_result_t;
+
+typedef void (*db_set_job_t)(summa_db_t *db, const query_options_t *options,
+                             db_set_result_t *result);
+
+typedef struct {
+    summa_db_t *db;
+    const query_options_t *options;
+    db_set_job_t job;
+    db_set_result_t *result;
+} db_set_task_t;
+
+static void* run_task(void *arg) {
+    db_set_task_t *task = arg;
+    task->job(task->db, task->options, task->result);
+    return NULL;
+}
+
+/* Run job against every database at once; results[i] belongs to dbs[i].
+ * A database whose thread cannot be started runs on this one. */
+static db_set_result_t* db_set_run(const db_set_t *set, const query_options_t *options,
+                                   db_set_job_t job) {
+    db_set_result_t *results = calloc(set->count, sizeof(db_set_result_t));
+    db_set_task_t *tasks = calloc(set->count, sizeof(db_set_task_t));
+    pthread_t *threads = calloc(set->count, sizeof(pthread_t));
+    bool *started = calloc(set->count, sizeof(bool));
+    if (!results || !tasks || !threads || !started) {
+        fprintf(stderr, "Error: Out of memory querying %d databases\n", set->count);
+        free(results);
+        results = NULL;
+        goto done;
+    }
+
+    for (int i = 0; i < set->count; i++) {
+        tasks[i] = (db_set_task_t){ set->dbs[i], options, job, &results[i] };
+        started[i] = pthread_create(&threads[i], NULL, run_task, &tasks[i]) == 0;
+        if (!started[i]) run_task(&tasks[i]);
+    }
+    for (int i = 0; i < set->count; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+
+done:
+    free(tasks);
+    free(threads);
+    free(started);
+    return results;
+}
+
+/* Per-database jobs */
+
+static void totals_job(summa_db_t *db, const query_options_t *options, db_set_result_t *result) {
+    result->ok = db_get_totals(db, options, &result->entries, &result->minutes);
+}
+
+static void tags_job(summa_db_t *db, const query_options_t *options, db_set_result_t *result) {
+    result->rows = db_get_tag_summary(db, options, &result->count);
+    result->ok = true;
+}
+
+static void daily_job(summa_db_t *db, const query_options_t *options, db_set_result_t *result) {
+    result->rows = db_get_daily_summary(db, options, &result->count);
+    result->ok = true;
+}
+
+static void stats_job(summa_db_t *db, const query_options_t *options, db_set_result_t *result) {
+    (void)options;
+    result->stats = db_get_stats(db);
+    result->rows = db_get_tag_names(db, &result->count);
+    result->ok = result->stats != NULL;
+}
+
+/* Concatenate the rows of every result into one malloc'd array, freeing
+ * the per-database arrays */
+static void* gather_rows(const db_set_t *set, db_set_result_t *results, size_t size, int *count) {
+    *count = 0;
+    for (int i = 0; i < set->count; i++) *count += results[i].count;
+
+    char *all = *count > 0 ? malloc(size * *count) : NULL;
+    int at = 0;
+    for (int i = 0; i < set->count; i++) {
+        if (all && results[i].count > 0) {
+            memcpy(all + size * at, results[i].rows, size * results[i].count);
+            at += results[i].count;
+        }
+        free(results[i].rows);
+        results[i].rows = NULL;
+    }
+    if (!all) *count = 0;
+    return all;
+}
+
+bool db_set_get_totals(const db_set_t *set, const query_options_t *options,
+                       int *entry_count, int *total_minutes,
+                       int *db_entries, int *db_minutes) {
+    *entry_count = 0;
+    *total_minutes = 0;
+    if (set->count == 1) {
+        bool ok = db_get_totals(set->dbs[0], options, entry_count, total_minutes);
+        if (db_entries) db_entries[0] = *entry_count;
+        if (db_minutes) db_minutes[0] = *total_minutes;
+        return ok;
+    }
+
+    db_set_result_t *results = db_set_run(set, options, totals_job);
+    if (!results) return false;
+
+    bool ok = true;
+    for (int i = 0; i < set->count; i++) {
+        ok = ok && results[i].ok;
+        *entry_count += results[i].entries;
+        *total_minutes += results[i].minutes;
+        if (db_entries) db_entries[i] = results[i].entries;
+        if (db_minutes) db_minutes[i] = results[i].minutes;
+    }
+    free(results);
+    return ok;
+}
+
+static int compare_tag_names(const void *a, const void *b) {
+    return strcmp(((const tag_summary_t *)a)->tag, ((const tag_summary_t *)b)->tag);
+}
+
+tag_summary_t* db_set_get_tag_summary(const db_set_t *set, const query_options_t *options, int *count) {
+    *count = 0;
+    if (set->count == 1) return db_get_tag_summary(set->dbs[0], options, count);
+
+    db_set_result_t *results = db_set_run(set, options, tags_job);
+    if (!results) return NULL;
+
+    int total = 0;
+    tag_summary_t *rows = gather_rows(set, results, sizeof(tag_summary_t), &total);
+    free(results);
+    if (total == 0) return rows;
+
+    /* Same tag from several databases: sum into the first */
+    qsort(rows, total, sizeof(tag_summary_t), compare_tag_names);
+    for (int i = 0; i < total; i++) {
+        if (*count > 0 && strcmp(rows[*count - 1].tag, rows[i].tag) == 0) {
+            rows[*count - 1].total_minutes += rows[i].total_minutes;
+            rows[*count - 1].entry_count += rows[i].entry_count;
+            free(rows[i].tag);
+        } else {
+            rows[(*count)++] = rows[i];
+        }
+    }
+    return rows;
+}
+
+static int compare_day_rows(const void *a, const void *b) {
+    int day_a = date_to_days(((const daily_summary_t *)a)->date);
+    int day_b = date_to_days(((const daily_summary_t *)b)->date);
+    return (day_a > day_b) - (day_a < day_b);
+}
+
+daily_summary_t* db_set_get_daily_summary(const db_set_t *set, const query_options_t *options, int *count) {
+    *count = 0;
+    if (set->count == 1) return db_get_daily_summary(set->dbs[0], options, count);
+
+    db_set_result_t *results = db_set_run(set, options, daily_job);
+    if (!results) return NULL;
+
+    int total = 0;
+    daily_summary_t *rows = gather_rows(set, results, sizeof(daily_summary_t), &total);
+    free(results);
+    if (total == 0) return rows;
+
+    qsort(rows, total, sizeof(daily_summary_t), compare_day_rows);
+    for (int i = 0; i < total; i++) {
+        if (*count > 0 && compare_day_rows(&rows[*count - 1], &rows[i]) == 0) {
+            rows[*count - 1].total_minutes += rows[i].total_minutes;
+            rows[*count - 1].entry_count += rows[i].entry_count;
+        } else {
+            rows[(*count)++] = rows[i];
+        }
+    }
+    return rows;
+}
+
+weekly_summary_t* db_set_get_weekly_summary(const db_set_t *set, const query_options_t *options, int *count) {
+    *count = 0;
+    if (set->count == 1) return db_get_weekly_summary(set->dbs[0], options, count);
+
+    int day_count = 0;
+    daily_summary_t *days = db_set_get_daily_summary(set, options, &day_count);
+    weekly_summary_t *weeks = weeks_from_days(days, day_count, count);
+    free(days);
+    return weeks;
+}
+
+monthly_summary_t* db_set_get_monthly_summary(const db_set_t *set, const query_options_t *options, int *count) {
+    *count = 0;
+    if (set->count == 1) return db_get_monthly_summary(set->dbs[0], options, count);
+
+    int day_count = 0;
+    daily_summary_t *days = db_set_get_daily_summary(set, options, &day_count);
+    monthly_summary_t *months = months_from_days(days, day_count, count);
+    free(days);
+    return months;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Sums, the overall date range, and tags counted once however many
+ * databases use them */
+db_stats_t* db_set_get_stats(const db_set_t *set) {
+    if (set->count == 1) return db_get_stats(set->dbs[0]);
+
+    db_set_result_t *results = db_set_run(set, NULL, stats_job);
+    if (!results) return NULL;
+
+    db_stats_t *merged = calloc(1, sizeof(db_stats_t));
+    bool ok = merged != NULL;
+    for (int i = 0; i < set->count; i++) {
+        db_stats_t *stats = results[i].stats;
+        ok = ok && results[i].ok;
+        if (!ok || !stats) continue;
+
+        merged->total_entries += stats->total_entries;
+        merged->total_files += stats->total_files;
+        merged->total_minutes += stats->total_minutes;
+        if (stats->earliest_date.year > 0 &&
+            (merged->earliest_date.year == 0 ||
+             compare_dates(&stats->earliest_date, &merged->earliest_date) < 0)) {
+            merged->earliest_date = stats->earliest_date;
+        }
+        if (stats->latest_date.year > 0 &&
+            compare_dates(&stats->latest_date, &merged->latest_date) > 0) {
+            merged->latest_date = stats->latest_date;
+        }
+    }
+
+    int name_count = 0;
+    char **names = gather_rows(set, results, sizeof(char *), &name_count);
+    if (name_count > 1) qsort(names, name_count, sizeof(char *), compare_names);
+    for (int i = 0; i < name_count; i++) {
+        if (merged && (i == 0 || strcmp(names[i - 1], names[i]) != 0)) {
+            merged->total_tags++;
+        }
+    }
+    for (int i = 0; i < name_count; i++) free(names[i]);
+    free(names);
+
+    for (int i = 0; i < set->count; i++) free(results[i].stats);
+    free(results);
+    if (!ok) {
+        free(merged);
+        return NULL;
+    }
+    return merged;
+}
+
+/* Listing order of db_query_open: date, start time, then duration */
+static int compare_listed(const logline_t *a, const logline_t *b) {
+    int order = compare_dates((date_t *)&a->date, (date_t *)&b->date);
+    if (order != 0) return order;
+
+    int start_a = a->timespan.start.hour * 60 + a->timespan.start.minute;
+    int start_b = b->timespan.start.hour * 60 + b->timespan.start.minute;
+    if (start_a != start_b) return start_a < start_b ? -1 : 1;
+    return (a->timespan.duration_minutes > b->timespan.duration_minutes) -
+           (a->timespan.duration_minutes < b->timespan.duration_minutes);
+}
+
+int db_set_query_each(const db_set_t *set, const query_options_t *options,
+                      db_set_entry_callback_t callback, void *ctx) {
+    db_cursor_t *cursors[DB_SET_MAX] = {0};
+    logline_t *heads[DB_SET_MAX] = {0};
+    if (set->count > DB_SET_MAX) return -1;
+
+    /* Offset and limit apply to the merged listing, so each database is
+     * read from its start; its cursor is lazy, so a limited listing still
+     * reads only about offset + limit rows in all */
+    query_options_t each = *options;
+    each.limit = 0;
+    each.offset = 0;
+    int skip = options->offset > 0 ? options->offset : 0;
+
+    int delivered = -1;
+    for (int i = 0; i < set->count; i++) {
+        cursors[i] = db_query_open(set->dbs[i], &each);
+        if (!cursors[i]) goto done;
+        heads[i] = db_cursor_next(cursors[i]);
+    }
+
+    /* Ties go to the database listed first */
+    delivered = 0;
+    for (;;) {
+        int next = -1;
+        for (int i = 0; i < set->count; i++) {
+            if (heads[i] && (next < 0 || compare_listed(heads[i], heads[next]) < 0)) next = i;
+        }
+        if (next < 0 || (options->limit > 0 && delivered == options->limit)) break;
+
+        bool more = true;
+        if (skip > 0) {
+            skip--;
+        } else {
+            more = callback(heads[next], next, ctx);
+            delivered++;
+        }
+        free_logline(heads[next]);
+        heads[next] = db_cursor_next(cursors[next]);
+        if (!more) break;
+    }
+
+done:
+    for (int i = 0; i < set->count; i++) {
+        if (heads[i]) free_logline(heads[i]);
+        db_cursor_close(cursors[i]);
+    }
+    return delivered;
+}
@@ -0,0 +1,44 @@
+/*
+ * summa_federate.h - Reports across several Summa databases
+ */
+
+#ifndef SUMMA_FEDERATE_H
+#define SUMMA_FEDERATE_H
+
+#include <stdbool.h>
+#include "summa.h"
+#include "summa_db.h"
+
+/* Most databases one report can read */
+#define DB_SET_MAX 64
+
+/* Open databases reported on together; names label them in the output */
+typedef struct {
+    summa_db_t **dbs;
+    const char **names;
+    int count;
+} db_set_t;
+
+/* Per-entry callback for db_set_query_each; db is the entry's index in
+ * the set. Return false to stop early. */
+typedef bool (*db_set_entry_callback_t)(logline_t *entry, int db, void *ctx);
+
+/* The db_get_* aggregates over every database in the set, merged. Each
+ * database is queried on its own thread. Weeks and months are rebuilt
+ * from the merged days, so a day in several databases counts once. */
+bool db_set_get_totals(const db_set_t *set, const query_options_t *options,
+                       int *entry_count, int *total_minutes,
+                       int *db_entries, int *db_minutes);  /* Per database, may be NULL */
+tag_summary_t* db_set_get_tag_summary(const db_set_t *set, const query_options_t *options, int *count);
+daily_summary_t* db_set_get_daily_summary(const db_set_t *set, const query_options_t *options, int *count);
+weekly_summary_t* db_set_get_weekly_summary(const db_set_t *set, const query_options_t *options, int *count);
+monthly_summary_t* db_set_get_monthly_summary(const db_set_t *set, const query_options_t *options, int *count);
+db_stats_t* db_set_get_stats(const db_set_t *set);
+
+/* Entries from every database, merged in date and start time order,
+ * with the options' offset and limit applied to the merged listing;
+ * returns the number delivered or -1 on error */
+int db_set_query_each(const db_set_t *set, const query_options_t *options,
+                      db_set_entry_callback_t callback, void *ctx);
+
+#endif /* SUMMA_FEDERATE_H */
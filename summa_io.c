@@ -0,0 +1,717 @@
+/*
+ * summa_io.c - Input stream helpers for Summa
+ *
+ * Compressed logs (.gz, .zst) are detected by magic number and exposed
+ * to the parser as ordinary stdio streams, so everything downstream of
+ * io_open() keeps using fgets() and never sees the compressed bytes.
+ *
+ * io_read_batch() loads many small files at once. With liburing it keeps
+ * a window of statx/openat/read/close operations in flight on one ring;
+ * otherwise (or when the kernel refuses io_uring, or predates its file
+ * operations in Linux 5.6) a small thread pool issues the same reads
+ * concurrently. A read that fails on the ring is retried with plain
+ * syscalls before its error is reported.
+ */
+
+#define _GNU_SOURCE  /* fopencookie, statx */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+#include "summa_io.h"
+
+/* Size of the compressed input window */
+#define IO_CHUNK (64 * 1024)
+
+/* Read window for files streamed from disk; memory use stays bounded by
+ * this no matter how large the file is */
+#define IO_STREAM_BUFFER (256 * 1024)
+
+/* Upper bound on reader threads for the fallback backend */
+#define IO_MAX_THREADS 16
+
+/* Decoder state attached to a cookie stream */
+typedef struct {
+    FILE *raw;
+    compression_t type;
+    bool input_eof;     /* raw stream exhausted */
+    bool done;          /* no more output will be produced */
+    unsigned char *in;
+#ifdef HAVE_ZLIB
+    z_stream zs;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zds;
+    ZSTD_inBuffer zin;
+#endif
+} io_decoder_t;
+
+/* Detect compression format from the first bytes of a file */
+compression_t io_detect_compression(const unsigned char *buf, size_t len) {
+    if (len >= 2 && buf[0] == 0x1f && buf[1] == 0x8b) {
+        return COMPRESSION_GZIP;
+    }
+    if (len >= 4 && buf[0] == 0x28 && buf[1] == 0xb5 &&
+        buf[2] == 0x2f && buf[3] == 0xfd) {
+        return COMPRESSION_ZSTD;
+    }
+    return COMPRESSION_NONE;
+}
+
+/* Check whether this build can decode the given format */
+bool io_compression_supported(compression_t type) {
+    switch (type) {
+        case COMPRESSION_NONE:
+            return true;
+        case COMPRESSION_GZIP:
+#ifdef HAVE_ZLIB
+            return true;
+#else
+            return false;
+#endif
+        case COMPRESSION_ZSTD:
+#ifdef HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+/* Human readable format name */
+const char* io_compression_name(compression_t type) {
+    switch (type) {
+        case COMPRESSION_GZIP: return "gzip";
+        case COMPRESSION_ZSTD: return "zstd";
+        case COMPRESSION_NONE:
+        default:               return "none";
+    }
+}
+
+/* Refill the compressed input window; returns bytes read */
+static size_t refill_input(io_decoder_t *dec) {
+    if (dec->input_eof) return 0;
+
+    size_t n = fread(dec->in, 1, IO_CHUNK, dec->raw);
+    if (n == 0) dec->input_eof = true;
+    return n;
+}
+
+#ifdef HAVE_ZLIB
+/* Inflate into buf; handles concatenated gzip members */
+static ssize_t gzip_read(io_decoder_t *dec, char *buf, size_t size) {
+    z_stream *zs = &dec->zs;
+    zs->next_out = (Bytef *)buf;
+    zs->avail_out = (uInt)size;
+
+    while (zs->avail_out > 0 && !dec->done) {
+        if (zs->avail_in == 0) {
+            size_t n = refill_input(dec);
+            zs->next_in = dec->in;
+            zs->avail_in = (uInt)n;
+        }
+
+        int rc = inflate(zs, Z_NO_FLUSH);
+        if (rc == Z_STREAM_END) {
+            /* Another member may follow (e.g. cat a.gz b.gz) */
+            if (zs->avail_in == 0) {
+                size_t n = refill_input(dec);
+                zs->next_in = dec->in;
+                zs->avail_in = (uInt)n;
+            }
+            if (zs->avail_in == 0) {
+                dec->done = true;
+            } else {
+                inflateReset(zs);
+            }
+        } else if (rc == Z_BUF_ERROR) {
+            /* No progress possible: truncated input */
+            if (dec->input_eof && zs->avail_in == 0) dec->done = true;
+        } else if (rc != Z_OK) {
+            /* Corrupt data or trailing garbage: keep what we have */
+            dec->done = true;
+            if (zs->avail_out == size) {
+                errno = EIO;
+                return -1;
+            }
+        }
+    }
+
+    return (ssize_t)(size - zs->avail_out);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/* Decompress into buf; ZSTD_decompressStream handles multiple frames */
+static ssize_t zstd_read(io_decoder_t *dec, char *buf, size_t size) {
+    ZSTD_outBuffer out = { buf, size, 0 };
+
+    while (out.pos < out.size && !dec->done) {
+        if (dec->zin.pos == dec->zin.size) {
+            dec->zin.size = refill_input(dec);
+            dec->zin.pos = 0;
+            if (dec->zin.size == 0) {
+                dec->done = true;
+                break;
+            }
+        }
+
+        size_t rc = ZSTD_decompressStream(dec->zds, &out, &dec->zin);
+        if (ZSTD_isError(rc)) {
+            dec->done = true;
+            if (out.pos == 0) {
+                errno = EIO;
+                return -1;
+            }
+        }
+    }
+
+    return (ssize_t)out.pos;
+}
+#endif
+
+/* Cookie read callback */
+static ssize_t decoder_read(void *cookie, char *buf, size_t size) {
+    io_decoder_t *dec = cookie;
+    if (dec->done || size == 0) return 0;
+
+    switch (dec->type) {
+#ifdef HAVE_ZLIB
+        case COMPRESSION_GZIP:
+            return gzip_read(dec, buf, size);
+#endif
+#ifdef HAVE_ZSTD
+        case COMPRESSION_ZSTD:
+            return zstd_read(dec, buf, size);
+#endif
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+}
+
+/* Cookie close callback */
+static int decoder_close(void *cookie) {
+    io_decoder_t *dec = cookie;
+
+#ifdef HAVE_ZLIB
+    if (dec->type == COMPRESSION_GZIP) inflateEnd(&dec->zs);
+#endif
+#ifdef HAVE_ZSTD
+    if (dec->type == COMPRESSION_ZSTD) ZSTD_freeDStream(dec->zds);
+#endif
+
+    int rc = fclose(dec->raw);
+    free(dec->in);
+    free(dec);
+    return rc;
+}
+
+#if defined(__GLIBC__)
+static FILE* open_cookie_stream(io_decoder_t *dec) {
+    cookie_io_functions_t funcs = {
+        .read = decoder_read,
+        .write = NULL,
+        .seek = NULL,
+        .close = decoder_close
+    };
+    return fopencookie(dec, "r", funcs);
+}
+#else
+/* BSD/macOS funopen uses int-sized callbacks */
+static int funopen_read(void *cookie, char *buf, int size) {
+    return (int)decoder_read(cookie, buf, (size_t)size);
+}
+
+static FILE* open_cookie_stream(io_decoder_t *dec) {
+    return funopen(dec, funopen_read, NULL, NULL, decoder_close);
+}
+#endif
+
+/* Create a decoding stream on top of raw (positioned at offset 0) */
+static FILE* open_decoder(FILE *raw, compression_t type) {
+    io_decoder_t *dec = calloc(1, sizeof(io_decoder_t));
+    if (!dec) return NULL;
+
+    dec->in = malloc(IO_CHUNK);
+    if (!dec->in) {
+        free(dec);
+        return NULL;
+    }
+    dec->raw = raw;
+    dec->type = type;
+
+    bool ok = false;
+#ifdef HAVE_ZLIB
+    if (type == COMPRESSION_GZIP) {
+        /* 15 + 32: maximum window, auto-detect gzip/zlib header */
+        ok = (inflateInit2(&dec->zs, 15 + 32) == Z_OK);
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (type == COMPRESSION_ZSTD) {
+        dec->zds = ZSTD_createDStream();
+        ok = dec->zds && !ZSTD_isError(ZSTD_initDStream(dec->zds));
+        dec->zin.src = dec->in;
+        dec->zin.size = 0;
+        dec->zin.pos = 0;
+    }
+#endif
+
+    if (!ok) {
+        free(dec->in);
+        free(dec);
+        return NULL;
+    }
+
+    FILE *fp = open_cookie_stream(dec);
+    if (!fp) {
+        dec->raw = NULL;
+#ifdef HAVE_ZLIB
+        if (type == COMPRESSION_GZIP) inflateEnd(&dec->zs);
+#endif
+#ifdef HAVE_ZSTD
+        if (type == COMPRESSION_ZSTD) ZSTD_freeDStream(dec->zds);
+#endif
+        free(dec->in);
+        free(dec);
+    }
+    return fp;
+}
+
+/* Wrap a seekable stream, decompressing if it starts with a known magic */
+FILE* io_wrap_stream(FILE *raw) {
+    if (!raw) return NULL;
+
+    unsigned char magic[4];
+    size_t n = fread(magic, 1, sizeof(magic), raw);
+    rewind(raw);
+
+    compression_t type = io_detect_compression(magic, n);
+    if (type == COMPRESSION_NONE || !io_compression_supported(type)) {
+        /* Plain text, or a format this build cannot decode: hand back as-is */
+        return raw;
+    }
+
+    FILE *fp = open_decoder(raw, type);
+    if (!fp) {
+        fclose(raw);
+        return NULL;
+    }
+    return fp;
+}
+
+/* Open a file for reading with transparent decompression */
+FILE* io_open(const char *path) {
+    FILE *raw = fopen(path, "rb");
+    if (!raw) return NULL;
+
+    /* Large sequential reads: fewer syscalls and more kernel readahead */
+    setvbuf(raw, NULL, _IOFBF, IO_STREAM_BUFFER);
+    posix_fadvise(fileno(raw), 0, 0, POSIX_FADV_SEQUENTIAL);
+    return io_wrap_stream(raw);
+}
+
+/* Open an in-memory file image as a (possibly decompressing) stream */
+FILE* io_open_buffer(const char *data, size_t size) {
+    if (!data || size == 0) return NULL;  /* fmemopen rejects empty buffers */
+
+    FILE *raw = fmemopen((void *)data, size, "rb");
+    if (!raw) return NULL;
+    return io_wrap_stream(raw);
+}
+
+/* Finish a request: NUL-terminate on success, release buffer on error */
+static void finish_request(io_request_t *req) {
+    if (req->error) {
+        free(req->data);
+        req->data = NULL;
+        req->size = 0;
+    } else if (req->data) {
+        req->data[req->size] = '\0';
+    }
+}
+
+/* Read one whole file with plain syscalls */
+static void read_file_sync(io_request_t *req) {
+    int fd = open(req->path, O_RDONLY);
+    if (fd < 0) {
+        req->error = errno;
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        req->error = errno;
+        close(fd);
+        return;
+    }
+
+    req->size = (size_t)st.st_size;
+    req->data = malloc(req->size + 1);
+    if (!req->data) {
+        req->error = ENOMEM;
+        close(fd);
+        return;
+    }
+
+    size_t offset = 0;
+    while (offset < req->size) {
+        ssize_t n = read(fd, req->data + offset, req->size - offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            req->error = errno;
+            break;
+        }
+        if (n == 0) {
+            /* File shrank since fstat */
+            req->size = offset;
+            break;
+        }
+        offset += (size_t)n;
+    }
+
+    close(fd);
+    finish_request(req);
+}
+
+#ifdef HAVE_LIBURING
+/* Per-request state machine: STATX -> OPEN -> READ* -> CLOSE */
+typedef enum {
+    URING_STATX,
+    URING_OPEN,
+    URING_READ,
+    URING_CLOSE
+} uring_op_t;
+
+typedef struct {
+    io_request_t *req;
+    uring_op_t op;
+    int fd;
+    size_t offset;
+    struct statx stx;
+} uring_slot_t;
+
+/* Queue the next operation for a slot */
+static void uring_queue(struct io_uring *ring, uring_slot_t *slot) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+    io_request_t *req = slot->req;
+
+    switch (slot->op) {
+        case URING_STATX:
+            io_uring_prep_statx(sqe, AT_FDCWD, req->path, 0, STATX_SIZE, &slot->stx);
+            break;
+        case URING_OPEN:
+            io_uring_prep_openat(sqe, AT_FDCWD, req->path, O_RDONLY, 0);
+            break;
+        case URING_READ:
+            io_uring_prep_read(sqe, slot->fd, req->data + slot->offset,
+                               (unsigned)(req->size - slot->offset), slot->offset);
+            break;
+        case URING_CLOSE:
+            io_uring_prep_close(sqe, slot->fd);
+            break;
+    }
+    io_uring_sqe_set_data(sqe, slot);
+}
+
+/* Handle a completion; returns true when the request is finished */
+static bool uring_advance(struct io_uring *ring, uring_slot_t *slot, int res) {
+    io_request_t *req = slot->req;
+
+    switch (slot->op) {
+        case URING_STATX:
+            if (res < 0) {
+                req->error = -res;
+                return true;
+            }
+            req->size = (size_t)slot->stx.stx_size;
+            req->data = malloc(req->size + 1);
+            if (!req->data) {
+                req->error = ENOMEM;
+                return true;
+            }
+            slot->op = URING_OPEN;
+            break;
+
+        case URING_OPEN:
+            if (res < 0) {
+                req->error = -res;
+                finish_request(req);
+                return true;
+            }
+            slot->fd = res;
+            slot->op = req->size > 0 ? URING_READ : URING_CLOSE;
+            break;
+
+        case URING_READ:
+            if (res == -EINTR || res == -EAGAIN) {
+                break;  /* Retry the same read */
+            }
+            if (res < 0) {
+                req->error = -res;
+                slot->op = URING_CLOSE;
+            } else if (res == 0) {
+                req->size = slot->offset;  /* File shrank since statx */
+                slot->op = URING_CLOSE;
+            } else {
+                slot->offset += (size_t)res;
+                if (slot->offset >= req->size) slot->op = URING_CLOSE;
+            }
+            break;
+
+        case URING_CLOSE:
+            finish_request(req);
+            return true;
+    }
+
+    uring_queue(ring, slot);
+    return false;
+}
+
+/* Start a new request in a free slot */
+static void uring_start(struct io_uring *ring, uring_slot_t *slot, io_request_t *req) {
+    slot->req = req;
+    slot->op = URING_STATX;
+    slot->fd = -1;
+    slot->offset = 0;
+    uring_queue(ring, slot);
+}
+
+/* After a ring failure: cancel the operation each busy slot still has in
+ * flight and wait for its completion, so the kernel no longer writes into
+ * the slots or request buffers. Returns false if the ring cannot be
+ * drained, in which case that memory must be left alone. */
+static bool uring_drain(struct io_uring *ring, uring_slot_t *slots, int queue_depth) {
+    int pending = 0;
+    for (int i = 0; i < queue_depth; i++) {
+        if (!slots[i].req) continue;
+        struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+        if (!sqe) {
+            io_uring_submit(ring);
+            sqe = io_uring_get_sqe(ring);
+        }
+        if (sqe) {
+            io_uring_prep_cancel(sqe, &slots[i], 0);
+            io_uring_sqe_set_data(sqe, NULL);
+        }
+        pending++;
+    }
+    if (pending > 0 && io_uring_submit(ring) < 0) return false;
+
+    /* One completion per busy slot, cancelled or not; those of the cancel
+     * requests themselves carry no slot */
+    while (pending > 0) {
+        struct io_uring_cqe *cqe;
+        int ret = io_uring_wait_cqe(ring, &cqe);
+        if (ret == -EINTR) continue;
+        if (ret < 0) return false;
+
+        uring_slot_t *slot = io_uring_cqe_get_data(cqe);
+        int res = cqe->res;
+        io_uring_cqe_seen(ring, cqe);
+        if (!slot) continue;
+
+        if (slot->op == URING_OPEN && res >= 0) slot->fd = res;
+        if (slot->op == URING_CLOSE && res != -ECANCELED) slot->fd = -1;
+        pending--;
+    }
+    return true;
+}
+
+/* Whether the kernel supports every operation the batch uses. Rings
+ * exist from Linux 5.1, but statx, openat and close only arrived in 5.6
+ * (as did the probe itself); older kernels fail them with EINVAL. */
+static bool uring_supported(void) {
+    static int supported = -1;
+    if (supported < 0) {
+        struct io_uring_probe *probe = io_uring_get_probe();
+        supported = probe &&
+                    io_uring_opcode_supported(probe, IORING_OP_STATX) &&
+                    io_uring_opcode_supported(probe, IORING_OP_OPENAT) &&
+                    io_uring_opcode_supported(probe, IORING_OP_READ) &&
+                    io_uring_opcode_supported(probe, IORING_OP_CLOSE) &&
+                    io_uring_opcode_supported(probe, IORING_OP_ASYNC_CANCEL);
+        if (probe) io_uring_free_probe(probe);
+    }
+    return supported;
+}
+
+/* Batched reads on one ring; returns false if io_uring is unavailable */
+static bool uring_read_batch(io_request_t *reqs, int count, int queue_depth) {
+    if (!uring_supported()) return false;
+
+    struct io_uring ring;
+    if (io_uring_queue_init((unsigned)queue_depth, &ring, 0) < 0) {
+        return false;
+    }
+
+    uring_slot_t *slots = calloc((size_t)queue_depth, sizeof(uring_slot_t));
+    if (!slots) {
+        io_uring_queue_exit(&ring);
+        return false;
+    }
+
+    int next = 0;
+    int active = 0;
+    for (int i = 0; i < queue_depth && next < count; i++) {
+        uring_start(&ring, &slots[i], &reqs[next++]);
+        active++;
+    }
+    io_uring_submit(&ring);
+
+    bool failed = false;
+    while (active > 0) {
+        struct io_uring_cqe *cqe;
+        int ret = io_uring_wait_cqe(&ring, &cqe);
+        if (ret == -EINTR) continue;
+        if (ret < 0) {
+            failed = true;
+            break;
+        }
+
+        uring_slot_t *slot = io_uring_cqe_get_data(cqe);
+        int res = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+
+        if (uring_advance(&ring, slot, res)) {
+            slot->req = NULL;
+            if (next < count) {
+                uring_start(&ring, slot, &reqs[next++]);
+            } else {
+                active--;
+            }
+        }
+        io_uring_submit(&ring);
+    }
+
+    /* Operations still in flight may yet write into the slots and the
+     * request buffers: if they cannot be drained, that memory is leaked
+     * rather than freed under the kernel */
+    bool drained = !failed || uring_drain(&ring, slots, queue_depth);
+    io_uring_queue_exit(&ring);
+
+    /* Ring failure: finish whatever is left synchronously */
+    for (int i = 0; i < queue_depth; i++) {
+        io_request_t *req = slots[i].req;
+        if (!req) continue;
+        if (drained) {
+            if (slots[i].fd >= 0) close(slots[i].fd);
+            free(req->data);
+        }
+        req->data = NULL;
+        req->size = 0;
+        req->error = 0;
+        read_file_sync(req);
+    }
+    while (next < count) {
+        read_file_sync(&reqs[next++]);
+    }
+
+    /* A failed operation may be the ring's rather than the file's: read
+     * it again with plain syscalls, which report the file's own error */
+    for (int i = 0; i < count; i++) {
+        if (!reqs[i].error) continue;
+        reqs[i].data = NULL;
+        reqs[i].size = 0;
+        reqs[i].error = 0;
+        read_file_sync(&reqs[i]);
+    }
+
+    if (drained) free(slots);
+    return true;
+}
+#endif
+
+/* Shared work queue for the thread fallback */
+typedef struct {
+    io_request_t *reqs;
+    int count;
+    int next;
+} io_batch_work_t;
+
+static void* io_batch_worker(void *arg) {
+    io_batch_work_t *work = arg;
+
+    for (;;) {
+        int i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+        if (i >= work->count) break;
+        read_file_sync(&work->reqs[i]);
+    }
+    return NULL;
+}
+
+/* Batched reads on a pool of plain threads */
+static void thread_read_batch(io_request_t *reqs, int count, int queue_depth) {
+    int nthreads = queue_depth < count ? queue_depth : count;
+    if (nthreads > IO_MAX_THREADS) nthreads = IO_MAX_THREADS;
+
+    io_batch_work_t work = { reqs, count, 0 };
+    pthread_t threads[IO_MAX_THREADS];
+    int started = 0;
+
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&threads[i], NULL, io_batch_worker, &work) != 0) break;
+        started++;
+    }
+
+    /* The calling thread helps too (and does everything if no thread started) */
+    io_batch_worker(&work);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/* Read many whole files, keeping up to queue_depth reads in flight */
+void io_read_batch(io_request_t *reqs, int count, int queue_depth) {
+    if (!reqs || count <= 0) return;
+
+    for (int i = 0; i < count; i++) {
+        reqs[i].data = NULL;
+        reqs[i].size = 0;
+        reqs[i].error = 0;
+    }
+
+    if (queue_depth <= 1 || count == 1) {
+        for (int i = 0; i < count; i++) read_file_sync(&reqs[i]);
+        return;
+    }
+
+#ifdef HAVE_LIBURING
+    if (uring_read_batch(reqs, count, queue_depth)) return;
+#endif
+
+    thread_read_batch(reqs, count, queue_depth);
+}
+
+/* Report which batched read backend this process will use */
+const char* io_batch_backend(void) {
+#ifdef HAVE_LIBURING
+    static int available = -1;
+    if (available < 0) {
+        struct io_uring ring;
+        available = uring_supported() && io_uring_queue_init(2, &ring, 0) == 0;
+        if (available) io_uring_queue_exit(&ring);
+    }
+    if (available) return "io_uring";
+#endif
+    return "threads";
+}
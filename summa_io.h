@@ -0,0 +1,47 @@
+/*
+ * summa_io.h - Input stream helpers for Summa (transparent decompression)
+ */
+
+#ifndef SUMMA_IO_H
+#define SUMMA_IO_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Compression formats recognized by magic number */
+typedef enum {
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,       /* 1f 8b */
+    COMPRESSION_ZSTD        /* 28 b5 2f fd */
+} compression_t;
+
+/* Format detection */
+compression_t io_detect_compression(const unsigned char *buf, size_t len);
+bool io_compression_supported(compression_t type);
+const char* io_compression_name(compression_t type);
+
+/* Open a file for reading, decompressing it on the fly if needed */
+FILE* io_open(const char *path);
+
+/* Wrap an already open, seekable stream; takes ownership of raw */
+FILE* io_wrap_stream(FILE *raw);
+
+/* Open an in-memory file image (e.g. from io_read_batch) as a stream */
+FILE* io_open_buffer(const char *data, size_t size);
+
+/* Whole-file read request for batched I/O */
+typedef struct {
+    const char *path;
+    char *data;          /* File contents, malloc'd (caller frees) */
+    size_t size;
+    int error;           /* 0 on success, errno otherwise */
+} io_request_t;
+
+/* Read many files, keeping up to queue_depth requests in flight */
+void io_read_batch(io_request_t *reqs, int count, int queue_depth);
+
+/* Name of the batched read backend in use ("io_uring" or "threads") */
+const char* io_batch_backend(void);
+
+#endif /* SUMMA_IO_H */
@@ -0,0 +1,275 @@
+/*
+ * summa_minutes.c - Minute-of-day bitmaps: covered time, overlaps, gaps;
+ * and the weekday by time-of-day heatmap
+ *
+ * Each day is 1440 bits in 64-bit words. An entry is OR'd in with one
+ * mask per word it spans; minutes it shares with earlier entries are
+ * first AND'd into a second bitmap of overlaps. Covered time is then a
+ * popcount, and gaps and overlaps are runs found a word at a time, so
+ * the cost is linear in entries and days however long the entries are.
+ *
+ * Days live in an array found through an open-addressed index by day
+ * number, so entries may arrive in any order; the array is sorted once
+ * when read.
+ *
+ * The heatmap needs no bitmaps: an entry is cut at slot boundaries with
+ * integer arithmetic on its minute of day, one add per slot it touches.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "summa.h"
+#include "summa_minutes.h"
+
+struct minute_days {
+    day_minutes_t *days;
+    int count;
+    int capacity;
+    int *index;                  /* Positions in days by day number, -1 = empty */
+    int index_size;              /* Power of two */
+    bool sorted;
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+#define popcount64(x) __builtin_popcountll(x)
+#define ctz64(x) __builtin_ctzll(x)
+#define clz64(x) __builtin_clzll(x)
+#else
+static int popcount64(uint64_t x) {
+    int n = 0;
+    for (; x; x &= x - 1) n++;
+    return n;
+}
+
+static int ctz64(uint64_t x) {
+    int n = 0;
+    for (; !(x & 1); x >>= 1) n++;
+    return n;
+}
+
+static int clz64(uint64_t x) {
+    int n = 0;
+    for (; !(x >> 63); x <<= 1) n++;
+    return n;
+}
+#endif
+
+static unsigned int day_slot(int day, int size) {
+    return ((unsigned int)day * 2654435761u) & (unsigned int)(size - 1);
+}
+
+minute_days_t* minute_days_create(void) {
+    minute_days_t *m = calloc(1, sizeof(minute_days_t));
+    if (!m) return NULL;
+
+    m->index_size = 64;
+    m->index = malloc(sizeof(int) * m->index_size);
+    if (!m->index) {
+        free(m);
+        return NULL;
+    }
+    for (int i = 0; i < m->index_size; i++) m->index[i] = -1;
+    m->sorted = true;
+    return m;
+}
+
+void minute_days_free(minute_days_t *m) {
+    if (!m) return;
+    free(m->days);
+    free(m->index);
+    free(m);
+}
+
+/* Rebuild the index at size slots from the days array */
+static bool build_day_index(minute_days_t *m, int size) {
+    int *index = malloc(sizeof(int) * size);
+    if (!index) return false;
+    for (int i = 0; i < size; i++) index[i] = -1;
+    for (int i = 0; i < m->count; i++) {
+        unsigned int slot = day_slot(m->days[i].day, size);
+        while (index[slot] >= 0) slot = (slot + 1) & (size - 1);
+        index[slot] = i;
+    }
+    free(m->index);
+    m->index = index;
+    m->index_size = size;
+    return true;
+}
+
+/* The bitmaps of a day, added empty if new; NULL if out of memory */
+static day_minutes_t* find_day(minute_days_t *m, int day) {
+    if (m->count >= m->index_size / 2 && !build_day_index(m, m->index_size * 2)) return NULL;
+
+    unsigned int mask = (unsigned int)m->index_size - 1;
+    unsigned int slot = day_slot(day, m->index_size);
+    while (m->index[slot] >= 0) {
+        if (m->days[m->index[slot]].day == day) return &m->days[m->index[slot]];
+        slot = (slot + 1) & mask;
+    }
+
+    if (m->count >= m->capacity) {
+        int capacity = m->capacity ? m->capacity * 2 : 64;
+        day_minutes_t *days = realloc(m->days, sizeof(day_minutes_t) * capacity);
+        if (!days) return NULL;
+        m->days = days;
+        m->capacity = capacity;
+    }
+    day_minutes_t *d = &m->days[m->count];
+    memset(d, 0, sizeof(*d));
+    d->day = day;
+    if (m->count > 0 && m->days[m->count - 1].day > day) m->sorted = false;
+    m->index[slot] = m->count++;
+    return d;
+}
+
+/* Mark minutes [from, to) of one day, noting those already covered */
+static void mark_minutes(day_minutes_t *d, int from, int to) {
+    int first = from / 64;
+    int last = (to - 1) / 64;
+    for (int w = first; w <= last; w++) {
+        uint64_t mask = ~0ULL;
+        if (w == first) mask &= ~0ULL << (from % 64);
+        if (w == last) mask &= ~0ULL >> (63 - (to - 1) % 64);
+        d->overlap[w] |= d->covered[w] & mask;
+        d->covered[w] |= mask;
+    }
+}
+
+bool minute_days_add(minute_days_t *m, int day, int start_minute, int duration) {
+    day_minutes_t *d = find_day(m, day);
+    if (!d) {
+        fprintf(stderr, "Error: Failed to expand minute bitmaps\n");
+        return false;
+    }
+    d->entry_count++;
+    d->logged_minutes += duration;
+
+    int end = start_minute + duration;
+    if (duration > 0) mark_minutes(d, start_minute, end < DAY_MINUTES ? end : DAY_MINUTES);
+    if (end > DAY_MINUTES) {
+        /* Crosses midnight: the rest belongs to the next day, which this
+         * entry did not start on */
+        day_minutes_t *next = find_day(m, day + 1);
+        if (!next) {
+            fprintf(stderr, "Error: Failed to expand minute bitmaps\n");
+            return false;
+        }
+        mark_minutes(next, 0, end - DAY_MINUTES);
+    }
+    return true;
+}
+
+bool minute_days_add_entry(minute_days_t *m, const logline_t *entry) {
+    if (entry->date.year == 0) return true;  /* No date to place it on */
+    int start = entry->timespan.start.hour * 60 + entry->timespan.start.minute;
+    return minute_days_add(m, date_to_days(entry->date), start,
+                           entry->timespan.duration_minutes);
+}
+
+static int compare_day_minutes(const void *a, const void *b) {
+    int day_a = ((const day_minutes_t *)a)->day;
+    int day_b = ((const day_minutes_t *)b)->day;
+    return (day_a > day_b) - (day_a < day_b);
+}
+
+const day_minutes_t* minute_days_sorted(minute_days_t *m, int *count) {
+    if (!m->sorted) {
+        qsort(m->days, m->count, sizeof(day_minutes_t), compare_day_minutes);
+        m->sorted = build_day_index(m, m->index_size);
+        if (!m->sorted) {
+            *count = 0;
+            return NULL;
+        }
+    }
+    *count = m->count;
+    return m->days;
+}
+
+int minutes_count(const uint64_t *bits) {
+    int count = 0;
+    for (int w = 0; w < DAY_WORDS; w++) {
+        count += popcount64(bits[w]);
+    }
+    return count;
+}
+
+bool minutes_span(const uint64_t *bits, int *first, int *end) {
+    int w = 0;
+    while (w < DAY_WORDS && !bits[w]) w++;
+    if (w == DAY_WORDS) return false;
+    *first = w * 64 + ctz64(bits[w]);
+
+    w = DAY_WORDS - 1;
+    while (!bits[w]) w--;
+    *end = w * 64 + 64 - clz64(bits[w]);
+    return true;
+}
+
+/* First minute at or after from whose bit equals set, or limit */
+static int next_minute(const uint64_t *bits, bool set, int from, int limit) {
+    int w = from / 64;
+    if (w >= DAY_WORDS) return limit;
+    uint64_t word = (set ? bits[w] : ~bits[w]) & (~0ULL << (from % 64));
+    for (;;) {
+        if (word) {
+            int minute = w * 64 + ctz64(word);
+            return minute < limit ? minute : limit;
+        }
+        if (++w >= DAY_WORDS || w * 64 >= limit) return limit;
+        word = set ? bits[w] : ~bits[w];
+    }
+}
+
+bool minutes_next_run(const uint64_t *bits, bool set, int from, int limit,
+                      int *run_start, int *run_end) {
+    int start = next_minute(bits, set, from, limit);
+    if (start >= limit) return false;
+    *run_start = start;
+    *run_end = next_minute(bits, !set, start, limit);
+    return true;
+}
+
+void heatmap_init(heatmap_t *h, int slot_minutes) {
+    memset(h, 0, sizeof(*h));
+    h->slot_minutes = slot_minutes;
+    h->slot_count = DAY_MINUTES / slot_minutes;
+}
+
+bool heatmap_parse_slot(const char *text, int *slot_minutes) {
+    if (strcmp(text, "15") == 0) {
+        *slot_minutes = 15;
+    } else if (strcmp(text, "30") == 0) {
+        *slot_minutes = 30;
+    } else if (strcmp(text, "60") == 0) {
+        *slot_minutes = 60;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void heatmap_add(heatmap_t *h, int day, int start_minute, int duration) {
+    int weekday = ((day % 7) + 10) % 7;  /* 1970-01-01 was a Thursday */
+    int minute = start_minute;
+    while (duration > 0) {
+        /* The rest of this slot, or all that is left */
+        int slot = minute / h->slot_minutes;
+        int take = h->slot_minutes - minute % h->slot_minutes;
+        if (take > duration) take = duration;
+
+        h->minutes[weekday][slot] += take;
+        duration -= take;
+        minute += take;
+        if (minute == DAY_MINUTES) {
+            minute = 0;
+            weekday = (weekday + 1) % 7;
+        }
+    }
+}
+
+void heatmap_add_entry(heatmap_t *h, const logline_t *entry) {
+    if (entry->date.year == 0) return;  /* No weekday to place it on */
+    int start = entry->timespan.start.hour * 60 + entry->timespan.start.minute;
+    heatmap_add(h, date_to_days(entry->date), start, entry->timespan.duration_minutes);
+}
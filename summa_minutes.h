@@ -0,0 +1,68 @@
+/*
+ * summa_minutes.h - Minute-of-day bitmaps: covered time, overlaps, gaps;
+ * and the weekday by time-of-day heatmap
+ */
+
+#ifndef SUMMA_MINUTES_H
+#define SUMMA_MINUTES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "summa.h"
+
+#define DAY_MINUTES 1440
+#define DAY_WORDS ((DAY_MINUTES + 63) / 64)
+
+/* One calendar day, one bit per minute */
+typedef struct {
+    int day;                          /* Days since 1970-01-01 */
+    int entry_count;                  /* Entries starting on this day */
+    int logged_minutes;               /* Their durations, overlaps and all */
+    uint64_t covered[DAY_WORDS];      /* Minutes with at least one entry */
+    uint64_t overlap[DAY_WORDS];      /* Minutes with two or more */
+} day_minutes_t;
+
+/* The days a set of entries touches */
+typedef struct minute_days minute_days_t;
+
+minute_days_t* minute_days_create(void);
+void minute_days_free(minute_days_t *m);
+
+/* Mark duration minutes from start_minute on day. Time past midnight is
+ * marked on the following day. */
+bool minute_days_add(minute_days_t *m, int day, int start_minute, int duration);
+bool minute_days_add_entry(minute_days_t *m, const logline_t *entry);
+
+/* The days in date order; valid until the next add */
+const day_minutes_t* minute_days_sorted(minute_days_t *m, int *count);
+
+/* Minutes set in a day's bitmap */
+int minutes_count(const uint64_t *bits);
+
+/* First set minute and one past the last; false if none are set */
+bool minutes_span(const uint64_t *bits, int *first, int *end);
+
+/* The next run of minutes at or after from that are set (or clear, with
+ * set false) in bits, stopping at limit; false when there is none */
+bool minutes_next_run(const uint64_t *bits, bool set, int from, int limit,
+                      int *run_start, int *run_end);
+
+/* Minutes worked by weekday, Monday first, and time-of-day slot */
+#define HEATMAP_MAX_SLOTS (DAY_MINUTES / 15)
+typedef struct {
+    int slot_minutes;            /* 15, 30 or 60 */
+    int slot_count;              /* Slots per day */
+    long long minutes[7][HEATMAP_MAX_SLOTS];
+} heatmap_t;
+
+void heatmap_init(heatmap_t *h, int slot_minutes);
+
+/* Parse a slot length option; false unless 15, 30 or 60 */
+bool heatmap_parse_slot(const char *text, int *slot_minutes);
+
+/* Split duration minutes from start_minute on day across the slots they
+ * touch, carrying on into the next weekday past midnight */
+void heatmap_add(heatmap_t *h, int day, int start_minute, int duration);
+void heatmap_add_entry(heatmap_t *h, const logline_t *entry);
+
+#endif /* SUMMA_MINUTES_H */
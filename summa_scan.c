@@ -6,39 +6,124 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <ctype.h>
 #include <time.h>
 #include <regex.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
 #include "summa.h"
 #include "summa_scan.h"
+#include "summa_io.h"
 
 /* Maximum path length */
 #ifndef PATH_MAX
 #define PATH_MAX 4096
 #endif
 
-/* File size limits */
-#define MAX_FILE_SIZE (10 * 1024 * 1024)  /* 10MB */
+/* File sampling */
 #define SAMPLE_LINES 50                    /* Lines to check for time entries */
 
+/* Batched I/O: small files are read SCAN_BATCH_FILES at a time with up to
+ * SCAN_IO_DEPTH reads in flight; anything larger is streamed from disk */
+#define SCAN_BATCH_FILES 64
+#define SCAN_IO_DEPTH 32
+#define SCAN_BATCH_MAX_SIZE (256 * 1024)
+
 /* Type definitions are in summa_scan.h */
 
+/* File contents, either preloaded by a batched read or left on disk */
+typedef struct {
+    const char *path;
+    const char *data;    /* NULL: stream from path */
+    size_t size;
+} scan_source_t;
+
+/* Files accepted by the directory walk, waiting for content analysis */
+typedef struct {
+    char *paths[SCAN_BATCH_FILES];
+    size_t sizes[SCAN_BATCH_FILES];
+    int count;
+} scan_batch_t;
+
+/* Set of visited (st_dev, st_ino) pairs, open addressing */
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    bool used;
+} inode_slot_t;
+
+typedef struct {
+    inode_slot_t *slots;
+    size_t capacity;     /* Power of two */
+    size_t count;
+} inode_set_t;
+
+/* State shared by one directory walk */
+typedef struct {
+    scan_batch_t batch;
+    inode_set_t seen;    /* Directories and files already reached */
+} scan_walk_t;
+
 /* Function prototypes */
-static bool is_text_file(const char *path);
-static bool has_time_entries(const char *path, int *count, bool *has_dates);
-static bool should_process_file(const char *path, scan_config_t *config);
+static FILE* open_source(const scan_source_t *src);
+static bool is_text_file(const scan_source_t *src);
+static bool has_time_entries(const scan_source_t *src, int *count, bool *has_dates);
+static bool should_process_file(const char *path, scan_config_t *config, size_t *size);
 /* These are exported in summa_scan.h */
 static void scan_directory_recursive(const char *path, scan_result_t *result,
-                                    scan_config_t *config, int depth);
-static file_info_t* analyze_file(const char *path, scan_config_t *config);
+                                    scan_config_t *config, int depth,
+                                    scan_walk_t *walk);
+static file_info_t* analyze_file(const scan_source_t *src, scan_config_t *config);
+static void flush_batch(scan_batch_t *batch, scan_result_t *result, scan_config_t *config);
+static void add_file_result(scan_result_t *result, file_info_t *info, scan_config_t *config);
 static bool validate_path(const char *path, char *validated_path, size_t max_len);
 
-/* Check if file is likely a text file */
-static bool is_text_file(const char *path) {
-    FILE *fp = fopen(path, "rb");
+/* Record a (dev, ino) pair; returns false if it was already present */
+static bool inode_set_add(inode_set_t *set, dev_t dev, ino_t ino) {
+    if ((set->count + 1) * 4 > set->capacity * 3) {
+        size_t new_capacity = set->capacity ? set->capacity * 2 : 256;
+        inode_slot_t *slots = calloc(new_capacity, sizeof(inode_slot_t));
+        if (!slots) return true;  /* Out of memory: stop deduplicating */
+        for (size_t i = 0; i < set->capacity; i++) {
+            if (!set->slots[i].used) continue;
+            uint64_t h = ((uint64_t)set->slots[i].ino * 0x9E3779B97F4A7C15ULL) ^
+                         (uint64_t)set->slots[i].dev;
+            size_t j = (size_t)(h ^ (h >> 29)) & (new_capacity - 1);
+            while (slots[j].used) j = (j + 1) & (new_capacity - 1);
+            slots[j] = set->slots[i];
+        }
+        free(set->slots);
+        set->slots = slots;
+        set->capacity = new_capacity;
+    }
+
+    uint64_t h = ((uint64_t)ino * 0x9E3779B97F4A7C15ULL) ^ (uint64_t)dev;
+    size_t i = (size_t)(h ^ (h >> 29)) & (set->capacity - 1);
+    while (set->slots[i].used) {
+        if (set->slots[i].ino == ino && set->slots[i].dev == dev) return false;
+        i = (i + 1) & (set->capacity - 1);
+    }
+    set->slots[i].dev = dev;
+    set->slots[i].ino = ino;
+    set->slots[i].used = true;
+    set->count++;
+    return true;
+}
+
+/* Open a source as a stream, decompressing if needed */
+static FILE* open_source(const scan_source_t *src) {
+    if (src->data) return io_open_buffer(src->data, src->size);
+    return io_open(src->path);
+}
+
+/* Check if file is likely a text file (compressed files are checked after decoding) */
+static bool is_text_file(const scan_source_t *src) {
+    FILE *fp = open_source(src);
     if (!fp) return false;
 
     /* Check first 512 bytes for binary data */
@@ -62,8 +147,8 @@ static bool is_text_file(const char *path) {
 }
 
 /* Check if file contains time entries */
-static bool has_time_entries(const char *path, int *count, bool *has_dates) {
-    FILE *fp = fopen(path, "r");
+static bool has_time_entries(const scan_source_t *src, int *count, bool *has_dates) {
+    FILE *fp = open_source(src);
     if (!fp) return false;
 
     char line[1024];
@@ -102,8 +187,8 @@ static bool has_time_entries(const char *path, int *count, bool *has_dates) {
     return entries_found >= 1;
 }
 
-/* Check if file should be processed */
-static bool should_process_file(const char *path, scan_config_t *config) {
+/* Check if file should be processed (content checks happen in analyze_file) */
+static bool should_process_file(const char *path, scan_config_t *config, size_t *size) {
     struct stat st;
     if (stat(path, &st) != 0) return false;
 
@@ -113,8 +198,13 @@ static bool should_process_file(const char *path, scan_config_t *config) {
     /* Skip symlinks if not following */
     if (S_ISLNK(st.st_mode) && !config->follow_symlinks) return false;
 
-    /* Check file size */
-    if ((size_t)st.st_size > config->max_file_size) return false;
+    /* Check file size (0 = no limit; large files are streamed) */
+    if (config->max_file_size > 0 && (size_t)st.st_size > config->max_file_size) {
+        if (config->verbose) {
+            fprintf(stderr, "Debug: Skipping %s (larger than --max-file-size)\n", path);
+        }
+        return false;
+    }
 
     /* Check file extension if include patterns specified */
     if (config->include_count > 0) {
@@ -139,9 +229,7 @@ static bool should_process_file(const char *path, scan_config_t *config) {
         }
     }
 
-    /* Check if it's a text file */
-    if (!is_text_file(path)) return false;
-
+    if (size) *size = (size_t)st.st_size;
     return true;
 }
 
@@ -230,18 +318,23 @@ date_t extract_date_from_path(const char *path) {
 }
 
 /* Analyze a single file */
-static file_info_t* analyze_file(const char *path, scan_config_t *config) {
+static file_info_t* analyze_file(const scan_source_t *src, scan_config_t *config) {
+    const char *path = src->path;
     int entry_count = 0;
     bool has_dates = false;
 
+    /* Check if it's a text file */
+    if (!is_text_file(src)) return NULL;
+
     /* Check if file has time entries */
-    if (!has_time_entries(path, &entry_count, &has_dates)) {
+    if (!has_time_entries(src, &entry_count, &has_dates)) {
         return NULL;
     }
 
-    /* Create file info */
-    file_info_t *info = malloc(sizeof(file_info_t));
+    /* Create file info (zeroed so inferred_date starts out empty) */
+    file_info_t *info = calloc(1, sizeof(file_info_t));
     info->path = strdup(path);
+    info->size = src->size;
 
     /* Extract filename */
     const char *filename = strrchr(path, '/');
@@ -295,9 +388,86 @@ static file_info_t* analyze_file(const char *path, scan_config_t *config) {
     return info;
 }
 
+/* Record an analyzed file in the scan results */
+static void add_file_result(scan_result_t *result, file_info_t *info, scan_config_t *config) {
+    info->next = result->files;
+    result->files = info;
+    result->file_count++;
+    result->entries_total += info->entry_count;
+
+    if (info->has_date_headers || info->date_source != DATE_SOURCE_NONE) {
+        result->files_with_dates++;
+    } else {
+        result->files_without_dates++;
+    }
+
+    if (config->verbose) {
+        printf("Found: %s (%d entries", info->path, info->entry_count);
+        if (!info->has_date_headers && info->date_source != DATE_SOURCE_NONE) {
+            printf(", date from %s: %04d-%02d-%02d",
+                   info->date_source == DATE_SOURCE_FILENAME ? "filename" :
+                   info->date_source == DATE_SOURCE_PATH ? "path" : "metadata",
+                   info->inferred_date.year,
+                   info->inferred_date.month,
+                   info->inferred_date.day);
+        }
+        printf(")\n");
+    }
+}
+
+/* Read the pending candidates in one batch and analyze them in walk order */
+static void flush_batch(scan_batch_t *batch, scan_result_t *result, scan_config_t *config) {
+    if (batch->count == 0) return;
+
+    io_request_t reqs[SCAN_BATCH_FILES];
+    int req_index[SCAN_BATCH_FILES];
+    int nreqs = 0;
+
+    for (int i = 0; i < batch->count; i++) {
+        req_index[i] = -1;
+        if (batch->sizes[i] <= SCAN_BATCH_MAX_SIZE) {
+            req_index[i] = nreqs;
+            reqs[nreqs++].path = batch->paths[i];
+        }
+    }
+    io_read_batch(reqs, nreqs, SCAN_IO_DEPTH);
+
+    for (int i = 0; i < batch->count; i++) {
+        scan_source_t src = { batch->paths[i], NULL, batch->sizes[i] };
+        if (req_index[i] >= 0) {
+            io_request_t *req = &reqs[req_index[i]];
+            if (req->error) {
+                if (config->verbose) {
+                    fprintf(stderr, "Warning: Cannot read %s: %s\n",
+                            req->path, strerror(req->error));
+                }
+                free(batch->paths[i]);
+                continue;
+            }
+            if (req->size == 0) {
+                /* Empty file: nothing to analyze */
+                free(req->data);
+                free(batch->paths[i]);
+                continue;
+            }
+            src.data = req->data;
+            src.size = req->size;
+        }
+
+        file_info_t *info = analyze_file(&src, config);
+        if (info) add_file_result(result, info, config);
+
+        if (req_index[i] >= 0) free(reqs[req_index[i]].data);
+        free(batch->paths[i]);
+    }
+
+    batch->count = 0;
+}
+
 /* Recursively scan directory */
 static void scan_directory_recursive(const char *path, scan_result_t *result,
-                                    scan_config_t *config, int depth) {
+                                    scan_config_t *config, int depth,
+                                    scan_walk_t *walk) {
     if (!config->recursive && depth > 0) return;
     if (depth > config->max_depth) return;
 
@@ -321,6 +491,16 @@ static void scan_directory_recursive(const char *path, scan_result_t *result,
         char full_path[PATH_MAX];
         snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
 
+        /* Skip symlinks if not following (validate_path resolves them) */
+        struct stat st;
+        if (lstat(full_path, &st) != 0) continue;
+        if (S_ISLNK(st.st_mode) && !config->follow_symlinks) {
+            if (config->verbose) {
+                fprintf(stderr, "Debug: Skipping symlink: %s\n", full_path);
+            }
+            continue;
+        }
+
         /* Validate the constructed path */
         char validated_full_path[PATH_MAX];
         if (!validate_path(full_path, validated_full_path, sizeof(validated_full_path))) {
@@ -330,42 +510,39 @@ static void scan_directory_recursive(const char *path, scan_result_t *result,
             continue;
         }
 
-        struct stat st;
         if (stat(validated_full_path, &st) != 0) continue;
 
+        /* Each physical file and directory is processed once, whichever
+         * hard link, symlink or bind mount reached it first. Directories
+         * are marked before descending, which stops cycles; files only
+         * once they pass the filters, so a link the filters reject does
+         * not hide one they accept. */
         if (S_ISDIR(st.st_mode)) {
+            if (!inode_set_add(&walk->seen, st.st_dev, st.st_ino)) {
+                if (config->verbose) {
+                    fprintf(stderr, "Debug: Skipping already visited directory: %s\n", full_path);
+                }
+                continue;
+            }
             /* Recurse into directory */
-            scan_directory_recursive(validated_full_path, result, config, depth + 1);
+            scan_directory_recursive(validated_full_path, result, config, depth + 1, walk);
         } else {
-            /* Process file */
-            if (!should_process_file(validated_full_path, config)) continue;
-
-            file_info_t *info = analyze_file(validated_full_path, config);
-            if (info) {
-                /* Add to results */
-                info->next = result->files;
-                result->files = info;
-                result->file_count++;
-                result->entries_total += info->entry_count;
-
-                if (info->has_date_headers || info->date_source != DATE_SOURCE_NONE) {
-                    result->files_with_dates++;
-                } else {
-                    result->files_without_dates++;
-                }
-
+            /* Queue file for batched analysis */
+            size_t size = 0;
+            if (!should_process_file(validated_full_path, config, &size)) continue;
+            if (!inode_set_add(&walk->seen, st.st_dev, st.st_ino)) {
                 if (config->verbose) {
-                    printf("Found: %s (%d entries", validated_full_path, info->entry_count);
-                    if (!info->has_date_headers && info->date_source != DATE_SOURCE_NONE) {
-                        printf(", date from %s: %04d-%02d-%02d",
-                               info->date_source == DATE_SOURCE_FILENAME ? "filename" :
-                               info->date_source == DATE_SOURCE_PATH ? "path" : "metadata",
-                               info->inferred_date.year,
-                               info->inferred_date.month,
-                               info->inferred_date.day);
-                    }
-                    printf(")\n");
+                    fprintf(stderr, "Debug: Skipping already visited file: %s\n", full_path);
                 }
+                continue;
+            }
+
+            scan_batch_t *batch = &walk->batch;
+            batch->paths[batch->count] = strdup(validated_full_path);
+            batch->sizes[batch->count] = size;
+            batch->count++;
+            if (batch->count == SCAN_BATCH_FILES) {
+                flush_batch(batch, result, config);
             }
         }
     }
@@ -426,11 +603,24 @@ scan_result_t* scan_directory(const char *path, scan_config_t *config) {
 
     if (S_ISDIR(st.st_mode)) {
         /* Scan directory */
-        scan_directory_recursive(validated_path, result, config, 0);
+        if (config->verbose) {
+            fprintf(stderr, "Debug: Reading files in batches using %s\n", io_batch_backend());
+        }
+        /* Mark the root before descending, as the walk does for every
+         * directory; files are only marked once they pass the filters,
+         * and the single-file branch below needs no set. Being first,
+         * the root cannot already be present. */
+        scan_walk_t walk = { .batch = { .count = 0 } };
+        (void)inode_set_add(&walk.seen, st.st_dev, st.st_ino);
+        scan_directory_recursive(validated_path, result, config, 0, &walk);
+        flush_batch(&walk.batch, result, config);
+        free(walk.seen.slots);
     } else {
         /* Single file */
-        if (should_process_file(validated_path, config)) {
-            file_info_t *info = analyze_file(validated_path, config);
+        size_t size = 0;
+        if (should_process_file(validated_path, config, &size)) {
+            scan_source_t src = { validated_path, NULL, size };
+            file_info_t *info = analyze_file(&src, config);
             if (info) {
                 result->files = info;
                 result->file_count = 1;
@@ -463,48 +653,252 @@ void free_scan_result(scan_result_t *result) {
     free(result);
 }
 
-/* Process files found during scan */
-logfile_t* process_scan_results(scan_result_t *scan_result, scan_config_t *config) {
-    if (!scan_result || scan_result->file_count == 0) {
-        return NULL;
+/* Scanned files are parsed on up to SCAN_MAX_PARSERS threads. A parser
+ * claims a window of SCAN_BATCH_FILES files, batch-reads the small ones
+ * and parses each into its own logfile. The calling thread takes parsed
+ * files from a bounded queue of SCAN_QUEUE_DEPTH and consumes them in
+ * scan order, so a consumer that writes (the database import) runs
+ * alongside the parsing. */
+#define SCAN_MAX_PARSERS 8
+#define SCAN_QUEUE_DEPTH 64
+
+/* One parsed file on its way to the consumer */
+typedef struct {
+    file_info_t *file;     /* NULL: not delivered yet */
+    int index;             /* Position in scan order */
+    logfile_t *parsed;     /* NULL: not opened or not parsed */
+} parsed_file_t;
+
+/* Bounded multi-producer, single-consumer ring. Producers claim a
+ * position with an atomic add and publish the slot by storing its
+ * sequence number; the semaphores only put idle threads to sleep. */
+typedef struct {
+    parsed_file_t item;
+    size_t seq;            /* pos + 1 once the slot holds position pos */
+} parse_slot_t;
+
+typedef struct {
+    parse_slot_t slots[SCAN_QUEUE_DEPTH];
+    size_t tail;           /* Next position to claim (producers) */
+    size_t head;           /* Next position to read (consumer only) */
+    sem_t items;
+    sem_t space;
+} parse_queue_t;
+
+static void parse_queue_push(parse_queue_t *q, parsed_file_t item) {
+    while (sem_wait(&q->space) != 0) { /* EINTR */ }
+
+    size_t pos = __atomic_fetch_add(&q->tail, 1, __ATOMIC_RELAXED);
+    parse_slot_t *slot = &q->slots[pos % SCAN_QUEUE_DEPTH];
+    slot->item = item;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    sem_post(&q->items);
+}
+
+static parsed_file_t parse_queue_pop(parse_queue_t *q) {
+    while (sem_wait(&q->items) != 0) { /* EINTR */ }
+
+    /* The item counted may be a later position published first; this
+     * slot's producer is between its claim and its store */
+    parse_slot_t *slot = &q->slots[q->head % SCAN_QUEUE_DEPTH];
+    while (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != q->head + 1) {
+        sched_yield();
     }
+    parsed_file_t item = slot->item;
+    q->head++;
+    sem_post(&q->space);
+    return item;
+}
 
-    /* Create merged logfile */
-    logfile_t *merged = create_logfile();
+/* Work shared by the parser threads */
+typedef struct {
+    file_info_t **files;
+    int count;
+    int next;              /* First file of the next window to claim */
+    bool stop;             /* Nothing wants more files: deliver them unparsed */
+    scan_config_t *config;
+    parse_queue_t queue;
+} parse_work_t;
+
+/* Parse one scanned file on its own, starting from its inferred date
+ * (none when it has date headers) */
+static logfile_t* parse_scanned_file(file_info_t *file, const scan_source_t *src,
+                                     scan_config_t *config) {
+    FILE *fp = open_source(src);
+    if (!fp) return NULL;
+
+    if (!file->has_date_headers && file->date_source != DATE_SOURCE_NONE && config->verbose) {
+        fprintf(stderr, "Using inferred date %04d-%02d-%02d for %s\n",
+               file->inferred_date.year, file->inferred_date.month,
+               file->inferred_date.day, file->filename);
+    }
 
-    /* Process each file */
-    file_info_t *file = scan_result->files;
-    while (file) {
-        FILE *fp = fopen(file->path, "r");
-        if (!fp) {
-            file = file->next;
-            continue;
+    logfile_t *parsed = create_logfile();
+    date_t date = file->inferred_date;
+    parse_log(fp, &date, parsed);
+    fclose(fp);
+    return parsed;
+}
+
+static void* scan_parser(void *arg) {
+    parse_work_t *work = arg;
+
+    for (;;) {
+        int first = __atomic_fetch_add(&work->next, SCAN_BATCH_FILES, __ATOMIC_RELAXED);
+        if (first >= work->count) break;
+        int count = work->count - first < SCAN_BATCH_FILES ? work->count - first : SCAN_BATCH_FILES;
+        bool stop = __atomic_load_n(&work->stop, __ATOMIC_RELAXED);
+
+        io_request_t reqs[SCAN_BATCH_FILES];
+        int req_index[SCAN_BATCH_FILES];
+        int nreqs = 0;
+        for (int i = 0; i < count; i++) {
+            file_info_t *file = work->files[first + i];
+            req_index[i] = -1;
+            if (!stop && file->size <= SCAN_BATCH_MAX_SIZE) {
+                req_index[i] = nreqs;
+                reqs[nreqs++].path = file->path;
+            }
         }
+        io_read_batch(reqs, nreqs, SCAN_IO_DEPTH);
+
+        for (int i = 0; i < count; i++) {
+            file_info_t *file = work->files[first + i];
+            io_request_t *req = req_index[i] >= 0 ? &reqs[req_index[i]] : NULL;
+            scan_source_t src = { file->path, NULL, file->size };
+            if (req) {
+                src.data = req->data;
+                src.size = req->size;
+            }
 
-        /* Parse file using existing parser with inferred date */
-        date_t saved_date = current_date;
-        if (!file->has_date_headers && file->date_source != DATE_SOURCE_NONE) {
-            current_date = file->inferred_date;
-            if (config->verbose) {
-                fprintf(stderr, "Using inferred date %04d-%02d-%02d for %s\n",
-                       current_date.year, current_date.month, current_date.day,
-                       file->filename);
+            parsed_file_t item = { file, first + i, NULL };
+            if (!stop) item.parsed = parse_scanned_file(file, &src, work->config);
+            if (req) free(req->data);
+            parse_queue_push(&work->queue, item);
+        }
+    }
+    return NULL;
+}
+
+/* Hand one parsed file to the sink, then move its entries to merged */
+static bool consume_parsed_file(parsed_file_t *item, scan_sink_t sink, void *ctx,
+                                bool *sink_ok, logfile_t *merged) {
+    logfile_t *parsed = item->parsed;
+    if (!parsed) return true;
+
+    for (int i = 0; i < parsed->count; i++) {
+        parsed->entries[i]->source = item->file->path;
+    }
+    if (sink && *sink_ok) {
+        *sink_ok = sink(item->file, parsed, ctx);
+    }
+
+    if (merged) {
+        for (int i = 0; i < parsed->count; i++) {
+            add_entry(merged, parsed->entries[i]);
+        }
+        parsed->count = 0;   /* The entries now belong to merged */
+    }
+    free_logfile(parsed);
+
+    /* Keep going only while someone still wants the entries */
+    return merged != NULL || *sink_ok;
+}
+
+/* Parse the scanned files with time entries. Each one goes to sink, on
+ * the calling thread and in scan order; with merged given, its entries
+ * are then appended there, each with its source path (owned by the scan
+ * result). Once sink fails it is not called again, and parsing stops
+ * unless merged still needs the entries. Returns false if sink failed. */
+bool scan_parse_files(scan_result_t *scan_result, scan_config_t *config,
+                      scan_sink_t sink, void *ctx, logfile_t *merged) {
+    if (!scan_result) return false;
+
+    int count = 0;
+    for (file_info_t *f = scan_result->files; f; f = f->next) {
+        if (f->has_time_entries) count++;
+    }
+    if (count == 0) return true;
+
+    parse_work_t *work = calloc(1, sizeof(parse_work_t));
+    file_info_t **files = malloc(sizeof(file_info_t *) * (size_t)count);
+    parsed_file_t *ready = calloc((size_t)count, sizeof(parsed_file_t));
+    if (!work || !files || !ready) {
+        free(work);
+        free(files);
+        free(ready);
+        return false;
+    }
+
+    int n = 0;
+    for (file_info_t *f = scan_result->files; f; f = f->next) {
+        if (f->has_time_entries) files[n++] = f;
+    }
+    work->files = files;
+    work->count = count;
+    work->config = config;
+    sem_init(&work->queue.items, 0, 0);
+    sem_init(&work->queue.space, 0, SCAN_QUEUE_DEPTH);
+
+    /* One core stays with the consumer */
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int windows = (count + SCAN_BATCH_FILES - 1) / SCAN_BATCH_FILES;
+    int nparsers = cpus > 2 ? (int)cpus - 1 : 1;
+    if (nparsers > SCAN_MAX_PARSERS) nparsers = SCAN_MAX_PARSERS;
+    if (nparsers > windows) nparsers = windows;
+
+    pthread_t threads[SCAN_MAX_PARSERS];
+    int started = 0;
+    for (int i = 0; i < nparsers; i++) {
+        if (pthread_create(&threads[i], NULL, scan_parser, work) != 0) break;
+        started++;
+    }
+    if (config->verbose) {
+        fprintf(stderr, "Parsing %d files with %d parser threads\n", count, started);
+    }
+
+    bool sink_ok = true;
+    bool wanted = true;
+    for (int i = 0; i < count; i++) {
+        parsed_file_t item;
+        if (started == 0) {
+            /* No threads: parse in line */
+            scan_source_t src = { files[i]->path, NULL, files[i]->size };
+            item = (parsed_file_t){ files[i], i, wanted ? parse_scanned_file(files[i], &src, config) : NULL };
+        } else {
+            while (!ready[i].file) {
+                parsed_file_t arrived = parse_queue_pop(&work->queue);
+                ready[arrived.index] = arrived;
             }
+            item = ready[i];
         }
 
-        /* Parse the file into the merged logfile */
-        logfile_t *saved_logfile = current_logfile;
-        current_logfile = merged;
+        if (!consume_parsed_file(&item, sink, ctx, &sink_ok, merged) && wanted) {
+            wanted = false;
+            __atomic_store_n(&work->stop, true, __ATOMIC_RELAXED);
+        }
+    }
 
-        parse_two_phase(fp);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
 
-        /* Restore globals */
-        current_logfile = saved_logfile;
-        current_date = saved_date;
+    sem_destroy(&work->queue.items);
+    sem_destroy(&work->queue.space);
+    free(ready);
+    free(files);
+    free(work);
+    return sink_ok;
+}
 
-        fclose(fp);
-        file = file->next;
+/* Process files found during scan */
+logfile_t* process_scan_results(scan_result_t *scan_result, scan_config_t *config) {
+    if (!scan_result || scan_result->file_count == 0) {
+        return NULL;
     }
 
+    /* Create merged logfile */
+    logfile_t *merged = create_logfile();
+    scan_parse_files(scan_result, config, NULL, NULL, merged);
     return merged;
 }
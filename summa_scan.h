@@ -26,7 +26,7 @@ typedef struct {
     bool date_from_path;
     bool verbose;
     int max_depth;
-    size_t max_file_size;
+    size_t max_file_size;    /* 0 = unlimited */
     char **exclude_patterns;
     int exclude_count;
     char **include_patterns;
@@ -37,6 +37,7 @@ typedef struct {
 typedef struct file_info {
     char *path;
     char *filename;
+    size_t size;
     bool has_time_entries;
     bool has_date_headers;
     int entry_count;
@@ -59,6 +60,11 @@ scan_result_t* scan_directory(const char *path, scan_config_t *config);
 void free_scan_result(scan_result_t *result);
 logfile_t* process_scan_results(scan_result_t *scan_result, scan_config_t *config);
 
+/* Receives each parsed file of a scan; returns false to stop */
+typedef bool (*scan_sink_t)(file_info_t *file, logfile_t *parsed, void *ctx);
+bool scan_parse_files(scan_result_t *scan_result, scan_config_t *config,
+                      scan_sink_t sink, void *ctx, logfile_t *merged);
+
 /* Utility functions for external use */
 date_t extract_date_from_filename(const char *filename);
 date_t extract_date_from_path(const char *path);
@@ -0,0 +1,581 @@
+/*
+ * summa_serve.c - Query server for Summa
+ *
+ * summa --serve SOCKET keeps one database connection open and answers
+ * report requests from many clients, so a dashboard pays for a socket
+ * round trip instead of a process start, db_open() and a cold page cache
+ * per query. A single poll() loop multiplexes the clients; queries are
+ * answered from the rollups in well under a millisecond, so they simply
+ * run one after another on the loop's connection.
+ *
+ * Replies are cached by request text until PRAGMA data_version shows a
+ * commit from another connection (an import, say).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "summa.h"
+#include "summa_db.h"
+#include "summa_serve.h"
+#include "summa_minutes.h"
+
+/* Defined in summa.c */
+extern int validate_date(int year, int month, int day);
+
+/* Connected clients beyond this wait in the listen backlog */
+#define SERVE_MAX_CLIENTS 128
+
+/* Reply cache: direct-mapped by request hash; large replies (full JSON
+ * dumps) are not kept */
+#define SERVE_CACHE_SLOTS 64
+#define SERVE_CACHE_MAX_REPLY (256 * 1024)
+
+/* Length prefix of requests and replies */
+#define FRAME_HEADER 4
+
+typedef struct {
+    int fd;
+    unsigned char in[FRAME_HEADER + SERVE_MAX_REQUEST];
+    size_t in_len;
+    char *out;             /* Framed replies not yet written */
+    size_t out_len;
+    size_t out_sent;
+    size_t out_capacity;
+    bool closing;          /* Hang up once out is written */
+} serve_client_t;
+
+typedef struct {
+    uint64_t hash;
+    char *request;
+    size_t request_len;
+    char *reply;           /* Framed, ready to send */
+    size_t reply_len;
+} serve_cache_slot_t;
+
+typedef struct {
+    summa_db_t *db;
+    long long data_version;
+    serve_cache_slot_t cache[SERVE_CACHE_SLOTS];
+    serve_client_t *clients[SERVE_MAX_CLIENTS];
+    int client_count;
+} server_t;
+
+static volatile sig_atomic_t serve_stop = 0;
+
+static void stop_serving(int sig) {
+    (void)sig;
+    serve_stop = 1;
+}
+
+/* FNV-1a over the request bytes */
+static uint64_t request_hash(const char *data, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void cache_clear(server_t *srv) {
+    for (int i = 0; i < SERVE_CACHE_SLOTS; i++) {
+        free(srv->cache[i].request);
+        free(srv->cache[i].reply);
+        memset(&srv->cache[i], 0, sizeof(srv->cache[i]));
+    }
+}
+
+/* Store a copy of reply for request; failures just leave the slot empty */
+static void cache_store(server_t *srv, uint64_t hash, const char *request, size_t request_len,
+                        const char *reply, size_t reply_len) {
+    if (reply_len > SERVE_CACHE_MAX_REPLY) return;
+
+    serve_cache_slot_t *slot = &srv->cache[hash % SERVE_CACHE_SLOTS];
+    free(slot->request);
+    free(slot->reply);
+    memset(slot, 0, sizeof(*slot));
+
+    char *request_copy = malloc(request_len ? request_len : 1);
+    char *reply_copy = malloc(reply_len);
+    if (!request_copy || !reply_copy) {
+        free(request_copy);
+        free(reply_copy);
+        return;
+    }
+    memcpy(request_copy, request, request_len);
+    memcpy(reply_copy, reply, reply_len);
+    *slot = (serve_cache_slot_t){ hash, request_copy, request_len, reply_copy, reply_len };
+}
+
+static const serve_cache_slot_t* cache_find(server_t *srv, uint64_t hash,
+                                            const char *request, size_t request_len) {
+    const serve_cache_slot_t *slot = &srv->cache[hash % SERVE_CACHE_SLOTS];
+    if (slot->reply && slot->hash == hash && slot->request_len == request_len &&
+        memcmp(slot->request, request, request_len) == 0) {
+        return slot;
+    }
+    return NULL;
+}
+
+/* Request options that take a value, as "--name VALUE" or "--name=VALUE" */
+static bool takes_value(const char *name) {
+    static const char *const names[] = {
+        "-f", "--format", "--from", "--to", "--tag", "--search", "--sort-tags",
+        "--top", "--heatmap-slot"
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(name, names[i]) == 0) return true;
+    }
+    return false;
+}
+
+static bool parse_request_date(const char *text, const char *option, date_t *date, FILE *out) {
+    if (sscanf(text, "%d-%d-%d", &date->year, &date->month, &date->day) != 3) {
+        fprintf(out, "Error: Invalid date format for %s (use YYYY-MM-DD)\n", option);
+        return false;
+    }
+    if (!validate_date(date->year, date->month, date->day)) {
+        fprintf(out, "Error: Invalid date for %s\n", option);
+        return false;
+    }
+    return true;
+}
+
+/* Fill report from request options, which use the command line's names.
+ * Strings in report point into args. Errors are written to out. */
+static bool parse_request(char **args, int count, db_report_t *report, FILE *out) {
+    memset(report, 0, sizeof(*report));
+    report->format = FORMAT_TEXT;
+    report->sort = SORT_ALPHA;
+    report->heatmap_slot = 60;
+
+    for (int i = 0; i < count; i++) {
+        char *arg = args[i];
+        const char *value = NULL;
+        char *equals = strncmp(arg, "--", 2) == 0 ? strchr(arg, '=') : NULL;
+        if (equals) {
+            *equals = '\0';
+            value = equals + 1;
+        }
+
+        if (takes_value(arg)) {
+            if (!value) {
+                if (i + 1 >= count) {
+                    fprintf(out, "Error: Option '%s' requires an argument\n", arg);
+                    return false;
+                }
+                value = args[++i];
+            }
+        } else if (value) {
+            fprintf(out, "Error: Option '%s' does not take an argument\n", arg);
+            return false;
+        }
+
+        if (strcmp(arg, "-d") == 0 || strcmp(arg, "--daily") == 0) {
+            report->daily = true;
+        } else if (strcmp(arg, "-w") == 0 || strcmp(arg, "--weekly") == 0) {
+            report->weekly = true;
+        } else if (strcmp(arg, "-m") == 0 || strcmp(arg, "--monthly") == 0) {
+            report->monthly = true;
+        } else if (strcmp(arg, "--cooccurrence") == 0) {
+            report->cooccurrence = true;
+        } else if (strcmp(arg, "--dedupe-overlaps") == 0) {
+            report->dedupe_overlaps = true;
+        } else if (strcmp(arg, "--overlaps") == 0) {
+            report->overlaps = true;
+        } else if (strcmp(arg, "--gaps") == 0) {
+            report->gaps = true;
+        } else if (strcmp(arg, "--heatmap") == 0) {
+            report->heatmap = true;
+        } else if (strcmp(arg, "--db-stats") == 0) {
+            report->stats = true;
+        } else if (strcmp(arg, "-f") == 0 || strcmp(arg, "--format") == 0) {
+            if (strcmp(value, "text") == 0) {
+                report->format = FORMAT_TEXT;
+            } else if (strcmp(value, "csv") == 0) {
+                report->format = FORMAT_CSV;
+            } else if (strcmp(value, "json") == 0) {
+                report->format = FORMAT_JSON;
+            } else {
+                fprintf(out, "Error: Unknown format '%s'\n", value);
+                return false;
+            }
+        } else if (strcmp(arg, "--from") == 0) {
+            if (!parse_request_date(value, "--from", &report->query.from_date, out)) return false;
+        } else if (strcmp(arg, "--to") == 0) {
+            if (!parse_request_date(value, "--to", &report->query.to_date, out)) return false;
+        } else if (strcmp(arg, "--tag") == 0) {
+            report->query.tag = (char *)value;
+        } else if (strcmp(arg, "--search") == 0) {
+            report->query.search = (char *)value;
+        } else if (strcmp(arg, "--sort-tags") == 0) {
+            if (strcmp(value, "alpha") == 0 || strcmp(value, "alphabetical") == 0) {
+                report->sort = SORT_ALPHA;
+            } else if (strcmp(value, "time") == 0) {
+                report->sort = SORT_TIME;
+            } else if (strcmp(value, "count") == 0) {
+                report->sort = SORT_COUNT;
+            } else {
+                fprintf(out, "Error: Invalid sort method '%s'. Valid options: alpha, time, count\n", value);
+                return false;
+            }
+        } else if (strcmp(arg, "--top") == 0) {
+            char *end;
+            long top = strtol(value, &end, 10);
+            if (end == value || *end != '\0' || top < 1 || top > INT_MAX) {
+                fprintf(out, "Error: Invalid tag count for --top (must be at least 1)\n");
+                return false;
+            }
+            report->top = (int)top;
+        } else if (strcmp(arg, "--heatmap-slot") == 0) {
+            if (!heatmap_parse_slot(value, &report->heatmap_slot)) {
+                fprintf(out, "Error: Invalid slot for --heatmap-slot (use 15, 30 or 60)\n");
+                return false;
+            }
+        } else {
+            fprintf(out, "Error: Unsupported option '%s'\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Append a framed reply to the client's output */
+static bool client_queue(serve_client_t *c, const char *data, size_t len) {
+    if (c->out_len + len > c->out_capacity) {
+        size_t capacity = c->out_capacity ? c->out_capacity : 4096;
+        while (capacity < c->out_len + len) capacity *= 2;
+        char *grown = realloc(c->out, capacity);
+        if (!grown) return false;
+        c->out = grown;
+        c->out_capacity = capacity;
+    }
+    memcpy(c->out + c->out_len, data, len);
+    c->out_len += len;
+    return true;
+}
+
+static void put_frame_length(char *frame, uint32_t len) {
+    frame[0] = (char)(len >> 24);
+    frame[1] = (char)(len >> 16);
+    frame[2] = (char)(len >> 8);
+    frame[3] = (char)len;
+}
+
+/* Answer one request (len bytes at payload) into the client's output */
+static bool handle_request(server_t *srv, serve_client_t *c, char *payload, size_t len) {
+    /* Another connection committed: every cached reply may be stale */
+    long long version = db_data_version(srv->db);
+    if (version < 0 || version != srv->data_version) {
+        cache_clear(srv);
+        srv->data_version = version;
+    }
+
+    uint64_t hash = request_hash(payload, len);
+    const serve_cache_slot_t *hit = version < 0 ? NULL : cache_find(srv, hash, payload, len);
+    if (hit) return client_queue(c, hit->reply, hit->reply_len);
+
+    /* Split the NUL-terminated options in place; the cache key was taken
+     * from the bytes as received */
+    char *request = malloc(len + 1);
+    char **args = malloc(sizeof(char *) * (len + 1));
+    char *reply = NULL;
+    size_t reply_len = 0;
+    FILE *out = open_memstream(&reply, &reply_len);
+    if (!request || !args || !out) {
+        if (out) fclose(out);
+        free(reply);
+        free(request);
+        free(args);
+        return false;
+    }
+
+    memcpy(request, payload, len);
+    request[len] = '\0';
+    int count = 0;
+    for (size_t pos = 0; pos < len; pos += strlen(request + pos) + 1) {
+        args[count++] = request + pos;
+    }
+
+    char header[FRAME_HEADER] = {0};
+    fwrite(header, 1, FRAME_HEADER, out);
+
+    bool cacheable = false;
+    db_report_t report;
+    if (len > 0 && payload[len - 1] != '\0') {
+        fprintf(out, "Error: Request options must each end with a NUL byte\n");
+    } else if (parse_request(args, count, &report, out)) {
+        const char *name = "";
+        db_set_t one = { &srv->db, &name, 1 };
+        cacheable = print_db_report(out, &one, &report);
+        if (!cacheable) fprintf(out, "Error: Query failed\n");
+    }
+
+    bool ok = fclose(out) == 0;
+    if (ok) {
+        put_frame_length(reply, (uint32_t)(reply_len - FRAME_HEADER));
+        ok = client_queue(c, reply, reply_len);
+        if (ok && cacheable && version >= 0) {
+            cache_store(srv, hash, payload, len, reply, reply_len);
+        }
+    }
+
+    if (ok && verbose) {
+        fprintf(stderr, "Debug: Answered a %d-option request (%zu bytes)\n",
+                count, reply_len - FRAME_HEADER);
+    }
+
+    free(reply);
+    free(request);
+    free(args);
+    return ok;
+}
+
+/* Queue a reply for a request the server refuses, then hang up */
+static void client_refuse(serve_client_t *c, const char *message) {
+    char frame[FRAME_HEADER + 128];
+    size_t len = strlen(message);
+    if (len > sizeof(frame) - FRAME_HEADER) len = sizeof(frame) - FRAME_HEADER;
+    put_frame_length(frame, (uint32_t)len);
+    memcpy(frame + FRAME_HEADER, message, len);
+    client_queue(c, frame, FRAME_HEADER + len);
+    c->closing = true;
+}
+
+/* Read what the client sent and answer every complete request; false
+ * when the connection should be closed */
+static bool client_read(server_t *srv, serve_client_t *c) {
+    ssize_t n = read(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len);
+    if (n == 0) return false;
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    c->in_len += (size_t)n;
+
+    size_t pos = 0;
+    while (c->in_len - pos >= FRAME_HEADER) {
+        const unsigned char *frame = c->in + pos;
+        uint32_t len = ((uint32_t)frame[0] << 24) | ((uint32_t)frame[1] << 16) |
+                       ((uint32_t)frame[2] << 8) | (uint32_t)frame[3];
+        if (len > SERVE_MAX_REQUEST) {
+            client_refuse(c, "Error: Request too large\n");
+            c->in_len = 0;
+            return true;
+        }
+        if (c->in_len - pos < FRAME_HEADER + len) break;
+
+        if (!handle_request(srv, c, (char *)frame + FRAME_HEADER, len)) {
+            fprintf(stderr, "Error: Out of memory answering a request\n");
+            return false;
+        }
+        pos += FRAME_HEADER + len;
+    }
+
+    memmove(c->in, c->in + pos, c->in_len - pos);
+    c->in_len -= pos;
+    return true;
+}
+
+/* Write pending replies; false when the connection should be closed */
+static bool client_write(serve_client_t *c) {
+    while (c->out_sent < c->out_len) {
+        ssize_t n = write(c->fd, c->out + c->out_sent, c->out_len - c->out_sent);
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        c->out_sent += (size_t)n;
+    }
+    c->out_len = c->out_sent = 0;
+    return !c->closing;
+}
+
+static void client_close(server_t *srv, int index) {
+    serve_client_t *c = srv->clients[index];
+    close(c->fd);
+    free(c->out);
+    free(c);
+    srv->clients[index] = srv->clients[--srv->client_count];
+}
+
+static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static void accept_clients(server_t *srv, int listen_fd) {
+    while (srv->client_count < SERVE_MAX_CLIENTS) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+                errno != ECONNABORTED) {
+                fprintf(stderr, "Error: Failed to accept a connection: %s\n", strerror(errno));
+            }
+            return;
+        }
+
+        serve_client_t *c = calloc(1, sizeof(serve_client_t));
+        if (!c || !set_nonblocking(fd)) {
+            free(c);
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        srv->clients[srv->client_count++] = c;
+    }
+}
+
+/* A socket file nobody is listening on */
+static bool socket_is_stale(const struct sockaddr_un *addr) {
+    struct stat st;
+    if (lstat(addr->sun_path, &st) != 0 || !S_ISSOCK(st.st_mode)) return false;
+
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) return false;
+    bool stale = connect(probe, (const struct sockaddr *)addr, sizeof(*addr)) != 0 &&
+                 errno == ECONNREFUSED;
+    close(probe);
+    return stale;
+}
+
+/* Bind and listen on path, readable and writable by the owner only. A
+ * socket file that refuses connections is left over from a server that
+ * died, and is replaced. */
+static int open_listener(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    /* Only the owner may connect: the socket file is created 0600
+     * whatever the process umask */
+    mode_t old_umask = umask(S_IXUSR | S_IRWXG | S_IRWXO);
+    int rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (rc != 0 && errno == EADDRINUSE && socket_is_stale(&addr)) {
+        unlink(path);
+        rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+    int bind_errno = errno;
+    umask(old_umask);
+    errno = bind_errno;
+    if (rc != 0) {
+        if (errno == EADDRINUSE) {
+            fprintf(stderr, "Error: %s is in use\n", path);
+        } else {
+            fprintf(stderr, "Error: Failed to bind %s: %s\n", path, strerror(errno));
+        }
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, SOMAXCONN) != 0 || !set_nonblocking(fd)) {
+        fprintf(stderr, "Error: Failed to listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    return fd;
+}
+
+bool serve_queries(summa_db_t *db, const char *socket_path) {
+    if (!db || !socket_path) return false;
+
+    int listen_fd = open_listener(socket_path);
+    if (listen_fd < 0) return false;
+
+    /* No SA_RESTART: the signal has to interrupt poll() */
+    struct sigaction stop = {0};
+    stop.sa_handler = stop_serving;
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+    signal(SIGPIPE, SIG_IGN);  /* A client hanging up mid-reply is a write error */
+
+    server_t *srv = calloc(1, sizeof(server_t));
+    struct pollfd *fds = malloc(sizeof(struct pollfd) * (SERVE_MAX_CLIENTS + 1));
+    if (!srv || !fds) {
+        free(srv);
+        free(fds);
+        close(listen_fd);
+        unlink(socket_path);
+        return false;
+    }
+    srv->db = db;
+    srv->data_version = -1;
+
+    if (verbose) {
+        fprintf(stderr, "Debug: Serving queries on %s\n", socket_path);
+    }
+
+    bool ok = true;
+    while (!serve_stop) {
+        /* Stop reading from a client while its replies are pending, and
+         * stop accepting while every slot is taken */
+        fds[0].fd = srv->client_count < SERVE_MAX_CLIENTS ? listen_fd : -1;
+        fds[0].events = POLLIN;
+        int count = srv->client_count;
+        for (int i = 0; i < count; i++) {
+            fds[i + 1].fd = srv->clients[i]->fd;
+            fds[i + 1].events = srv->clients[i]->out_len > 0 ? POLLOUT : POLLIN;
+            fds[i + 1].revents = 0;
+        }
+
+        if (poll(fds, count + 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error: poll failed: %s\n", strerror(errno));
+            ok = false;
+            break;
+        }
+
+        /* Backwards, so closing a client (which moves the last one into
+         * its slot) does not skip anyone polled this round */
+        for (int i = count - 1; i >= 0; i--) {
+            serve_client_t *c = srv->clients[i];
+            short revents = fds[i + 1].revents;
+            bool keep = true;
+
+            if (revents & POLLOUT) {
+                keep = client_write(c);
+            } else if (revents & POLLIN) {
+                keep = client_read(srv, c);
+                if (keep && c->out_len > 0) keep = client_write(c);
+            } else if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                keep = false;
+            }
+            if (!keep) client_close(srv, i);
+        }
+
+        if (fds[0].revents & POLLIN) accept_clients(srv, listen_fd);
+    }
+
+    while (srv->client_count > 0) client_close(srv, srv->client_count - 1);
+    cache_clear(srv);
+    free(srv);
+    free(fds);
+    close(listen_fd);
+    unlink(socket_path);
+
+    if (verbose) {
+        fprintf(stderr, "Debug: Query server on %s stopped\n", socket_path);
+    }
+    return ok;
+}
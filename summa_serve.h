@@ -0,0 +1,45 @@
+/*
+ * summa_serve.h - Query server over a Unix domain socket
+ */
+
+#ifndef SUMMA_SERVE_H
+#define SUMMA_SERVE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "summa.h"
+#include "summa_db.h"
+#include "summa_federate.h"
+
+/* A database report: what to query and how to print it. Filled from the
+ * command line by main() and from each request by the server. */
+typedef struct {
+    query_options_t query;
+    output_format_t format;
+    tag_sort_t sort;
+    int top;                     /* Tags shown in the tag report, 0 = all */
+    bool daily;
+    bool weekly;
+    bool monthly;
+    bool cooccurrence;           /* Tag pairs instead of single tags */
+    bool dedupe_overlaps;        /* Summaries count overlapping time once */
+    bool overlaps;               /* List overlapping periods */
+    bool gaps;                   /* List idle periods within each day */
+    bool heatmap;                /* Minutes by weekday and time of day */
+    int heatmap_slot;            /* Heatmap slot length: 15, 30 or 60 minutes */
+    bool stats;                  /* --db-stats instead of a report */
+} db_report_t;
+
+/* Print a report exactly as the command line would (summa.c); false if
+ * it could not be produced */
+bool print_db_report(FILE *out, const db_set_t *set, const db_report_t *report);
+
+/* Largest request payload the server accepts, in bytes */
+#define SERVE_MAX_REQUEST 4096
+
+/* Answer requests on socket_path until SIGINT or SIGTERM. A request is a
+ * 4-byte big-endian length followed by that many bytes of report options,
+ * each terminated by a NUL; the reply is a length and the report text. */
+bool serve_queries(summa_db_t *db, const char *socket_path);
+
+#endif /* SUMMA_SERVE_H */
@@ -878,6 +878,939 @@ test_scan_aggregation() {
   fi
 }
 
+# Test 23: Compressed log scanning
+test_compressed_scanning() {
+  print_test "Compressed log scanning (.gz, .zst)"
+
+  if ! $SUMMA --version | grep -q "gzip yes"; then
+    test_warn "Built without zlib, skipping compressed scan tests"
+    return
+  fi
+
+  local tmpdir=$(mktemp -d)
+  cp -p testdata/scan_test/logs/* "$tmpdir"/
+  gzip "$tmpdir"/*
+
+  local plain=$($SUMMA --scan testdata/scan_test/logs --date-from-filename 2>&1)
+  local compressed=$($SUMMA --scan "$tmpdir" --date-from-filename 2>&1)
+  if [ "$plain" == "$compressed" ]; then
+    test_pass "Gzip-compressed scan matches uncompressed scan"
+  else
+    test_fail "Gzip-compressed scan output differs from uncompressed scan"
+  fi
+
+  # Concatenated gzip members decode as one stream
+  cat "$tmpdir/2024-01-15.md.gz" "$tmpdir/2024-01-15.md.gz" >"$tmpdir/double.md.gz"
+  if $SUMMA "$tmpdir/double.md.gz" 2>&1 | grep -q "Total entries: 10"; then
+    test_pass "Multi-member gzip files are fully decoded"
+  else
+    test_fail "Multi-member gzip file not fully decoded"
+  fi
+
+  if $SUMMA --version | grep -q "zstd yes" && command -v zstd >/dev/null 2>&1; then
+    local zstdir=$(mktemp -d)
+    cp -p testdata/scan_test/logs/* "$zstdir"/
+    zstd -q --rm "$zstdir"/*
+    local zstd_out=$($SUMMA --scan "$zstdir" --date-from-filename 2>&1)
+    if [ "$plain" == "$zstd_out" ]; then
+      test_pass "Zstd-compressed scan matches uncompressed scan"
+    else
+      test_fail "Zstd-compressed scan output differs from uncompressed scan"
+    fi
+    rm -rf "$zstdir"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 24: Batched reads over many small files
+test_batched_scanning() {
+  print_test "Batched scanning of many small files"
+
+  local tmpdir=$(mktemp -d)
+  for i in $(seq 1 150); do
+    printf "# 2024-01-%02d\n0900-1000 Task %d #batch\n1000-1030 Review #review\n" \
+      $(((i % 28) + 1)) $i >"$tmpdir/day_$i.log"
+  done
+  # One file above the batch size limit goes through the streaming path
+  for i in $(seq 1 12000); do
+    echo "0800-0815 Large file entry number $i padding padding #big"
+  done >"$tmpdir/large.log"
+
+  local output=$($SUMMA --scan "$tmpdir" 2>&1)
+  if echo "$output" | grep -q "Found 151 time log files"; then
+    test_pass "All small and large files discovered"
+  else
+    test_fail "Batched scan missed files"
+  fi
+
+  if echo "$output" | grep -q "Total entries: 12300"; then
+    test_pass "Entries from batched and streamed files all parsed"
+  else
+    test_fail "Batched scan entry count incorrect"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 25: Files reachable through several links are scanned once
+test_inode_dedup() {
+  print_test "Hard link and symlink deduplication"
+
+  local tmpdir=$(mktemp -d)
+  mkdir -p "$tmpdir/notes"
+  printf "# 2024-01-15\n0900-1000 Planning #plan\n1000-1100 Coding #dev\n" >"$tmpdir/notes/day.log"
+  ln "$tmpdir/notes/day.log" "$tmpdir/notes/copy.log"
+  ln -s notes "$tmpdir/linked"
+  ln -s .. "$tmpdir/notes/loop"
+
+  local output=$(timeout 10 $SUMMA --scan "$tmpdir" -R 2>&1)
+  if echo "$output" | grep -q "Found 1 time log file" &&
+    echo "$output" | grep -q "Total entries: 2"; then
+    test_pass "Hard-linked copy, symlinked directory and loop counted once"
+  else
+    test_fail "Linked files or directories counted more than once"
+  fi
+
+  output=$($SUMMA --scan "$tmpdir" -R --no-follow-symlinks 2>&1)
+  if echo "$output" | grep -q "Found 1 time log file" &&
+    echo "$output" | grep -q "Total entries: 2"; then
+    test_pass "Hard-linked copy counted once with symlinks skipped"
+  else
+    test_fail "Hard-linked copies counted more than once"
+  fi
+
+  # Links the filters reject must not hide the one they accept
+  local name
+  for name in b c d e f g; do
+    ln "$tmpdir/notes/day.log" "$tmpdir/notes/$name.txt"
+  done
+  output=$($SUMMA --scan "$tmpdir/notes" --include .log --exclude copy 2>&1 || true)
+  if echo "$output" | grep -q "Total entries: 2"; then
+    test_pass "Filtered-out hard links do not hide an accepted one"
+  else
+    test_fail "Accepted file skipped after a filtered-out hard link"
+  fi
+
+  # A tree reachable only through a link is scanned unless links are skipped
+  mkdir -p "$tmpdir/elsewhere"
+  printf "# 2024-01-16\n0900-1000 Review #review\n" >"$tmpdir/elsewhere/more.md"
+  ln -s ../elsewhere "$tmpdir/notes/more"
+  output=$(timeout 10 $SUMMA --scan "$tmpdir/notes" -R --include .md 2>&1 || true)
+  local skipped=$($SUMMA --scan "$tmpdir/notes" -R --include .md --no-follow-symlinks 2>&1 || true)
+  if echo "$output" | grep -q "Total entries: 1$" &&
+     echo "$skipped" | grep -q "No time log files found"; then
+    test_pass "Linked-only trees are followed by default"
+  else
+    test_fail "Linked-only tree not followed: $(echo "$output" | tr '\n' ' ')"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 26: Files above the old 10MB cap are streamed; the cap is an option
+test_large_file_scanning() {
+  print_test "Large file streaming and --max-file-size"
+
+  local tmpdir=$(mktemp -d)
+  printf "# 2024-01-15\n0900-1000 Small file #small\n" >"$tmpdir/small.log"
+  awk 'BEGIN { print "# 2024-01-01"; for (i = 1; i <= 160000; i++)
+    printf "0800-0815 Consolidated yearly log entry number %d #year\n", i }' >"$tmpdir/year.log"
+
+  local output=$($SUMMA --scan "$tmpdir" 2>&1)
+  if echo "$output" | grep -q "Total entries: 160001"; then
+    test_pass "File larger than 10MB scanned by default"
+  else
+    test_fail "Large file dropped from scan"
+  fi
+
+  output=$($SUMMA --scan "$tmpdir" --max-file-size 1M 2>&1)
+  if echo "$output" | grep -q "Total entries: 1$"; then
+    test_pass "--max-file-size skips larger files"
+  else
+    test_fail "--max-file-size not applied"
+  fi
+
+  if ! $SUMMA --scan "$tmpdir" --max-file-size 10Q >/dev/null 2>&1; then
+    test_pass "Invalid size rejected"
+  else
+    test_fail "Invalid size accepted"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 27: Re-importing a file stores each entry once
+test_db_import_dedup() {
+  print_test "Database import deduplication"
+
+  local tmpdir=$(mktemp -d)
+  local db="$tmpdir/summa.db"
+  awk 'BEGIN { for (d = 1; d <= 5; d++) { printf "# 2024-03-%02d\n", d
+    for (i = 0; i < 40; i++) printf "%02d00-%02d30 Task %d #dedup\n", 8 + i % 10, 8 + i % 10, i } }' >"$tmpdir/log.md"
+
+  $SUMMA "$tmpdir/log.md" --db="$db" --import >/dev/null 2>&1
+  $SUMMA "$tmpdir/log.md" --db="$db" --import >/dev/null 2>&1
+  local output=$($SUMMA --db="$db" --tag dedup 2>&1)
+  if echo "$output" | grep -q "Total entries: 200$"; then
+    test_pass "Second import added no duplicates"
+  else
+    test_fail "Re-import duplicated entries"
+  fi
+
+  # A version 1 database (TEXT dates, no entry_hash) is upgraded on open
+  if command -v sqlite3 >/dev/null 2>&1; then
+    local old="$tmpdir/v1.db"
+    sqlite3 "$old" "CREATE TABLE metadata (key TEXT PRIMARY KEY, value TEXT);
+      INSERT INTO metadata VALUES ('version', '1');
+      CREATE TABLE files (id INTEGER PRIMARY KEY AUTOINCREMENT, filepath TEXT UNIQUE NOT NULL,
+        last_modified INTEGER, last_scanned INTEGER, entry_count INTEGER DEFAULT 0);
+      CREATE TABLE entries (id INTEGER PRIMARY KEY AUTOINCREMENT, file_id INTEGER, date TEXT,
+        start_time TEXT, end_time TEXT, duration_minutes INTEGER, description TEXT,
+        percentage INTEGER, line_number INTEGER, created_at INTEGER,
+        FOREIGN KEY (file_id) REFERENCES files(id) ON DELETE CASCADE);
+      CREATE TABLE tags (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT UNIQUE NOT NULL);
+      CREATE TABLE entry_tags (entry_id INTEGER, tag_id INTEGER, PRIMARY KEY (entry_id, tag_id));
+      CREATE INDEX idx_entries_date ON entries(date);
+      INSERT INTO files (filepath, entry_count) VALUES ('/notes/old.md', 3);
+      INSERT INTO tags (name) VALUES ('legacy');
+      INSERT INTO entries (file_id, date, start_time, end_time, duration_minutes, description)
+        VALUES (1, '2023-12-31', '23:00', '01:00', 120, 'Late shift'),
+               (1, '2024-02-29', '09:15', '10:45', 90, 'Leap day'),
+               (1, '2024-02-29', '09:15', '10:45', 90, 'Leap day');
+      INSERT INTO entry_tags VALUES (1, 1), (2, 1), (3, 1);"
+    output=$($SUMMA --db="$old" --tag legacy -f csv 2>&1)
+    local version=$(sqlite3 "$old" "SELECT value FROM metadata WHERE key = 'version'" 2>/dev/null)
+    $SUMMA --db="$tmpdir/fresh.db" --db-stats >/dev/null 2>&1
+    local current=$(sqlite3 "$tmpdir/fresh.db" "SELECT value FROM metadata WHERE key = 'version'" 2>/dev/null)
+    if [ -n "$current" ] && [ "$version" = "$current" ] &&
+      echo "$output" | grep -q "^2023-12-31,23:00,01:00,120,Late shift,#legacy" &&
+      [ "$(echo "$output" | grep -c "^2024-02-29,09:15,10:45,90,Leap day")" = "1" ]; then
+      test_pass "Version 1 database migrated and deduplicated"
+    else
+      test_fail "Schema migration from version 1 failed"
+    fi
+  else
+    test_warn "sqlite3 not found, skipping migration check"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 28: Database tuning profiles
+test_db_profiles() {
+  print_test "Database profiles"
+
+  local tmpdir=$(mktemp -d)
+  printf "# 2024-04-01\n0900-1000 Profile check #profile\n" >"$tmpdir/log.md"
+
+  $SUMMA "$tmpdir/log.md" --db="$tmpdir/bulk.db" --db-profile bulk --import >/dev/null 2>&1
+  local output=$($SUMMA --db="$tmpdir/bulk.db" --tag profile 2>&1)
+  if echo "$output" | grep -q "Total entries: 1$"; then
+    test_pass "Bulk profile import readable"
+  else
+    test_fail "Bulk profile import failed"
+  fi
+
+  if command -v sqlite3 >/dev/null 2>&1; then
+    local mode=$(sqlite3 "$tmpdir/bulk.db" "PRAGMA journal_mode" 2>/dev/null)
+    $SUMMA "$tmpdir/log.md" --db="$tmpdir/safe.db" --db-profile safe --import >/dev/null 2>&1
+    local safe_mode=$(sqlite3 "$tmpdir/safe.db" "PRAGMA journal_mode" 2>/dev/null)
+    if [ "$mode" = "wal" ] && [ "$safe_mode" = "delete" ]; then
+      test_pass "Journal mode follows profile"
+    else
+      test_fail "Journal mode not set by profile ($mode, $safe_mode)"
+    fi
+  fi
+
+  # Leaving WAL needs the database to itself: with a server connected,
+  # the safe profile keeps WAL and still answers
+  $SUMMA --db="$tmpdir/bulk.db" --serve "$tmpdir/sock" 2>/dev/null &
+  local server=$!
+  for i in $(seq 50); do
+    [ -S "$tmpdir/sock" ] && break
+    sleep 0.1
+  done
+  output=$($SUMMA --db="$tmpdir/bulk.db" --db-profile safe --db-stats 2>&1 || true)
+  kill "$server" 2>/dev/null
+  wait "$server" 2>/dev/null || true
+  if echo "$output" | grep -q "Total entries: 1$" &&
+     echo "$output" | grep -q "Warning: Keeping journal mode wal"; then
+    test_pass "Safe profile keeps WAL while another connection is open"
+  else
+    test_fail "Safe profile refused a database in use: $(echo "$output" | tr '\n' ' ')"
+  fi
+
+  if ! $SUMMA --db="$tmpdir/bulk.db" --db-profile turbo --db-stats >/dev/null 2>&1; then
+    test_pass "Unknown profile rejected"
+  else
+    test_fail "Unknown profile accepted"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 29: Database queries combine tag and date filters
+test_db_query_filters() {
+  print_test "Database query filters"
+
+  local tmpdir=$(mktemp -d)
+  cat >"$tmpdir/log.md" <<'EOF2'
+# 2024-05-01
+0900-1000 Early work #work
+1000-1100 Early errand #home
+# 2024-05-10
+0900-1030 Middle work #work #review
+# 2024-05-20
+0900-0930 Late work #work
+EOF2
+
+  $SUMMA "$tmpdir/log.md" --db="$tmpdir/q.db" --import >/dev/null 2>&1
+  local output=$($SUMMA --db="$tmpdir/q.db" --tag work --from 2024-05-05 --to 2024-05-31 -f csv 2>&1)
+  if [ "$(echo "$output" | grep -c '^2024-')" = "2" ] &&
+     echo "$output" | grep -q "Middle work,#work;#review," &&
+     ! echo "$output" | grep -q "Early"; then
+    test_pass "Tag and date range combine"
+  else
+    test_fail "Tag and date range not combined: $output"
+  fi
+
+  local from_file=$($SUMMA "$tmpdir/log.md" -f csv 2>&1)
+  local from_db=$($SUMMA --db="$tmpdir/q.db" -f csv 2>&1)
+  if [ "$from_file" = "$from_db" ]; then
+    test_pass "Streamed CSV matches file output"
+  else
+    test_fail "Streamed CSV differs from file output"
+  fi
+
+  output=$($SUMMA --db="$tmpdir/q.db" --tag nosuchtag -f csv 2>&1)
+  if echo "$output" | grep -q "No entries found in database"; then
+    test_pass "Empty query reported"
+  else
+    test_fail "Empty query not reported"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 30: Database summaries are aggregated in SQL and match file output
+test_db_summaries() {
+  print_test "Database summaries"
+
+  local tmpdir=$(mktemp -d)
+  cat >"$tmpdir/log.md" <<'EOF2'
+# 2024-01-02
+0900-1000 New year planning #plan
+# 2024-12-30
+0900-1100 Year end review #review #plan
+# 2024-12-31
+1000-1030 Wrap up #review
+# 2025-01-02
+0900-1000 Kickoff #plan
+EOF2
+
+  $SUMMA "$tmpdir/log.md" --db="$tmpdir/s.db" --import >/dev/null 2>&1
+  local mismatched=""
+  for opt in "" --daily --weekly --monthly "--tag plan" "--tag plan --weekly"; do
+    if [ "$($SUMMA "$tmpdir/log.md" $opt 2>&1)" != "$($SUMMA --db="$tmpdir/s.db" $opt 2>&1)" ]; then
+      mismatched="$mismatched '$opt'"
+    fi
+  done
+  if [ -z "$mismatched" ]; then
+    test_pass "Database summaries match file summaries"
+  else
+    test_fail "Database summaries differ for:$mismatched"
+  fi
+
+  local weekly=$($SUMMA --db="$tmpdir/s.db" --weekly 2>&1)
+  if echo "$weekly" | grep -q "Total weeks: 3" &&
+     echo "$weekly" | grep -q "2024 Week 01 (2024-12-30 to 2024-12-31)"; then
+    test_pass "Weeks split at year end"
+  else
+    test_fail "Year-end week grouped incorrectly"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 31: Report rollups follow writes and can be rebuilt
+test_db_rollups() {
+  print_test "Database report rollups"
+
+  if ! command -v sqlite3 >/dev/null 2>&1; then
+    test_warn "sqlite3 not available, skipping rollup checks"
+    return
+  fi
+
+  local tmpdir=$(mktemp -d)
+  printf "# 2024-03-01\n0900-1000 One #a\n# 2024-03-02\n0900-1100 Two #a #b\n" >"$tmpdir/log.md"
+  $SUMMA "$tmpdir/log.md" --db="$tmpdir/r.db" --import >/dev/null 2>&1
+  local expected=$($SUMMA --db="$tmpdir/r.db" --daily 2>&1)
+
+  sqlite3 "$tmpdir/r.db" "PRAGMA foreign_keys = ON; DELETE FROM entries WHERE day = (SELECT MAX(day) FROM entries);"
+  local output=$($SUMMA --db="$tmpdir/r.db" --tag b 2>&1)
+  if $SUMMA --db="$tmpdir/r.db" --daily 2>&1 | grep -q "Total days: 1" &&
+     echo "$output" | grep -q "No entries found in database"; then
+    test_pass "Rollups follow deleted entries"
+  else
+    test_fail "Rollups not updated on delete"
+  fi
+
+  $SUMMA "$tmpdir/log.md" --db="$tmpdir/r.db" --import >/dev/null 2>&1
+  sqlite3 "$tmpdir/r.db" "DELETE FROM daily_totals; DELETE FROM daily_tag_totals;"
+  $SUMMA --db="$tmpdir/r.db" --db-rebuild-rollups >/dev/null 2>&1
+  if [ "$($SUMMA --db="$tmpdir/r.db" --daily 2>&1)" = "$expected" ]; then
+    test_pass "Rollups rebuilt from entries"
+  else
+    test_fail "Rollup rebuild did not restore totals"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 32: Full-text search over descriptions
+test_db_search() {
+  print_test "Database full-text search"
+
+  local tmpdir=$(mktemp -d)
+  cat >"$tmpdir/log.md" <<'EOF2'
+# 2024-07-01
+0900-1000 Acme migration kickoff #acme
+1000-1100 Lunch planning #admin
+# 2024-07-08
+0900-1030 Plan the ACME Migration rollback #acme #ops
+1100-1200 Migration of printer drivers #ops
+EOF2
+  $SUMMA "$tmpdir/log.md" --db="$tmpdir/f.db" --import >/dev/null 2>&1
+
+  local output=$($SUMMA --db="$tmpdir/f.db" --search "acme migration" -f csv 2>&1)
+  if [ "$(echo "$output" | grep -c '^2024-')" = "2" ] && ! echo "$output" | grep -q "printer"; then
+    test_pass "All words matched, case-insensitively"
+  else
+    test_fail "Search returned wrong entries: $output"
+  fi
+
+  output=$($SUMMA --db="$tmpdir/f.db" --search migration --tag ops --from 2024-07-05 -f csv 2>&1)
+  if [ "$(echo "$output" | grep -c '^2024-07-08')" = "2" ] && ! echo "$output" | grep -q "kickoff"; then
+    test_pass "Search combines with tag and date filters"
+  else
+    test_fail "Search filters not combined: $output"
+  fi
+
+  if $SUMMA --db="$tmpdir/f.db" --search 'acme-"migration' -f csv >/dev/null 2>&1; then
+    test_pass "Punctuation in search text handled"
+  else
+    test_fail "Search text with punctuation rejected"
+  fi
+
+  if ! $SUMMA "$tmpdir/log.md" --search acme >/dev/null 2>&1; then
+    test_pass "Search without --db rejected"
+  else
+    test_fail "Search without --db accepted"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 33: Re-importing an edited file replaces its changed entries
+test_db_reimport_sync() {
+  print_test "Database re-import of edited files"
+
+  local tmpdir=$(mktemp -d)
+  printf "# 2024-05-01\n0900-1000 Draft #doc\n1000-1100 Review #doc\n1100-1200 Ship #rel\n" >"$tmpdir/log.md"
+  $SUMMA "$tmpdir/log.md" --db="$tmpdir/s.db" --import >/dev/null 2>&1
+
+  # Edit a tag, delete a line and add one; the fresh import is the reference
+  printf "# 2024-05-01\n0900-1000 Draft #spec\n1100-1200 Ship #rel\n1300-1330 Retro #team\n" >"$tmpdir/log.md"
+  $SUMMA "$tmpdir/log.md" --db="$tmpdir/s.db" --import >/dev/null 2>&1
+  $SUMMA "$tmpdir/log.md" --db="$tmpdir/fresh.db" --import >/dev/null 2>&1
+
+  local synced=$($SUMMA --db="$tmpdir/s.db" -f csv 2>&1; $SUMMA --db="$tmpdir/s.db" 2>&1)
+  local fresh=$($SUMMA --db="$tmpdir/fresh.db" -f csv 2>&1; $SUMMA --db="$tmpdir/fresh.db" 2>&1)
+  if [ "$synced" = "$fresh" ] && ! echo "$synced" | grep -q "Review"; then
+    test_pass "Edited and deleted lines replaced"
+  else
+    test_fail "Re-import left stale entries: $synced"
+  fi
+
+  local output=$($SUMMA -v "$tmpdir/log.md" --db="$tmpdir/s.db" --import 2>&1)
+  if echo "$output" | grep -q "unchanged since last import"; then
+    test_pass "Unchanged file skipped"
+  else
+    test_fail "Unchanged file was diffed again"
+  fi
+
+  $SUMMA "$tmpdir/log.md" --db="$tmpdir/s.db" --import --tag team >/dev/null 2>&1
+  if $SUMMA --db="$tmpdir/s.db" 2>&1 | grep -q "Total entries: 3"; then
+    test_pass "Filtered re-import keeps other entries"
+  else
+    test_fail "Filtered re-import dropped entries"
+  fi
+
+  if command -v sqlite3 >/dev/null 2>&1; then
+    local lines=$(sqlite3 "$tmpdir/s.db" "SELECT group_concat(line_number) FROM (SELECT line_number FROM entries ORDER BY line_number)")
+    if [ "$lines" = "2,3,4" ]; then
+      test_pass "Line numbers stored"
+    else
+      test_fail "Wrong line numbers: $lines"
+    fi
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 34: Scan imports parse each file once, on worker threads
+test_db_scan_import() {
+  print_test "Database scan import pipeline"
+
+  local tmpdir=$(mktemp -d)
+  mkdir "$tmpdir/logs"
+  # More files than the import queue holds
+  for i in $(seq -w 1 90); do
+    printf "# 2024-03-%02d\n0900-1000 Standup %s #team\n1000-1130 Build %s #dev\n" \
+      $(( (10#$i - 1) % 28 + 1 )) "$i" "$i" >"$tmpdir/logs/day$i.md"
+  done
+
+  local report=$($SUMMA --scan "$tmpdir/logs" --db="$tmpdir/s.db" --import --daily 2>&1)
+  local expected=$(cat "$tmpdir"/logs/*.md | $SUMMA --daily 2>&1)
+  if [ "$($SUMMA --db="$tmpdir/s.db" --daily 2>&1)" = "$expected" ] &&
+     $SUMMA --db="$tmpdir/s.db" 2>&1 | grep -q "Total entries: 180"; then
+    test_pass "All scanned files imported"
+  else
+    test_fail "Scan import lost entries"
+  fi
+
+  if [ "$(echo "$report" | grep -v "Successfully imported")" = "$($SUMMA --scan "$tmpdir/logs" --daily 2>&1)" ] &&
+     echo "$report" | grep -q "Successfully imported 180 entries"; then
+    test_pass "Report and import share one parse"
+  else
+    test_fail "Report differs when importing"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 35: Backups are copied in steps and renamed into place when complete
+test_db_backup() {
+  print_test "Database incremental backup"
+
+  local tmpdir=$(mktemp -d)
+  for i in $(seq 1 40); do
+    printf "# 2024-04-%02d\n0900-1000 Standup %s #team\n1000-1200 Build %s #dev\n" \
+      $(( (i - 1) % 28 + 1 )) "$i" "$i"
+  done >"$tmpdir/log.md"
+  $SUMMA --db="$tmpdir/s.db" --import "$tmpdir/log.md" >/dev/null 2>&1
+
+  local expected=$($SUMMA --db="$tmpdir/s.db" --daily 2>&1)
+  $SUMMA --db="$tmpdir/s.db" --db-backup "$tmpdir/step.db" --db-backup-step 1 >/dev/null 2>&1
+  if [ "$($SUMMA --db="$tmpdir/step.db" --daily 2>&1)" = "$expected" ] &&
+     [ ! -e "$tmpdir/step.db.partial" ]; then
+    test_pass "Stepped backup matches the source"
+  else
+    test_fail "Stepped backup differs from the source"
+  fi
+
+  $SUMMA --db="$tmpdir/s.db" --db-backup "$tmpdir/compact.db" --db-backup-compact >/dev/null 2>&1
+  if [ "$($SUMMA --db="$tmpdir/compact.db" --daily 2>&1)" = "$expected" ]; then
+    test_pass "Compacted backup matches the source"
+  else
+    test_fail "Compacted backup differs from the source"
+  fi
+
+  if $SUMMA --db="$tmpdir/s.db" --db-backup "$tmpdir/b.db" --db-backup-step 0 >/dev/null 2>&1; then
+    test_fail "Accepted a zero backup step"
+  else
+    test_pass "Rejects a zero backup step"
+  fi
+
+  # Backup steps skip the busy handler: a rollback-journal source that a
+  # writer keeps locked fails the backup after the profile's busy timeout
+  if command -v python3 >/dev/null 2>&1; then
+    $SUMMA --db="$tmpdir/safe.db" --db-profile safe --import "$tmpdir/log.md" >/dev/null 2>&1
+    python3 -c "
+import sqlite3, sys
+db = sqlite3.connect(sys.argv[1])
+db.execute('CREATE TABLE pad(b)')
+db.executemany('INSERT INTO pad VALUES (randomblob(3500))', [()] * 500)
+db.commit()" "$tmpdir/safe.db"
+    timeout 200 $SUMMA --db="$tmpdir/safe.db" --db-profile safe \
+      --db-backup "$tmpdir/locked.db" --db-backup-step 1 >/dev/null 2>"$tmpdir/err" &
+    local backup=$!
+    for i in $(seq 50); do
+      [ -e "$tmpdir/locked.db.partial" ] && break
+      sleep 0.1
+    done
+    python3 -c "
+import sqlite3, sys, time
+db = sqlite3.connect(sys.argv[1], isolation_level=None)
+db.execute('BEGIN EXCLUSIVE')
+time.sleep(300)" "$tmpdir/safe.db" &
+    local writer=$!
+    local status=0
+    wait "$backup" || status=$?
+    kill "$writer" 2>/dev/null || true
+    wait "$writer" 2>/dev/null || true
+    if [ "$status" -eq 1 ] && grep -q "source still locked" "$tmpdir/err" &&
+       [ ! -e "$tmpdir/locked.db" ] && [ ! -e "$tmpdir/locked.db.partial" ]; then
+      test_pass "Gives up on a source that stays locked"
+    else
+      test_fail "Backup of a locked source did not fail cleanly (exit $status)"
+    fi
+  else
+    test_warn "python3 not available, skipping locked backup check"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 36: Statistics count each entry once, however many tags it has
+test_db_stats() {
+  print_test "Database statistics"
+
+  local tmpdir=$(mktemp -d)
+  printf "# 2024-05-01\n0900-1000 Review #dev #team #qa\n1000-1030 Email\n# 2024-05-03\n1300-1500 Build #dev\n" \
+    >"$tmpdir/log.md"
+  $SUMMA --db="$tmpdir/s.db" --import "$tmpdir/log.md" >/dev/null 2>&1
+
+  local stats=$($SUMMA --db="$tmpdir/s.db" --db-stats 2>&1)
+  if echo "$stats" | grep -q "Total entries: 3" &&
+     echo "$stats" | grep -q "Total time: 3h 30m" &&
+     echo "$stats" | grep -q "Total tags: 3" &&
+     echo "$stats" | grep -q "Date range: 2024-05-01 to 2024-05-03"; then
+    test_pass "Statistics match the imported entries"
+  else
+    test_fail "Statistics are off: $(echo "$stats" | tr '\n' ' ')"
+  fi
+
+  # Removing entries on re-import updates the totals
+  printf "# 2024-05-01\n1000-1030 Email\n" >"$tmpdir/log.md"
+  $SUMMA --db="$tmpdir/s.db" --import "$tmpdir/log.md" >/dev/null 2>&1
+  stats=$($SUMMA --db="$tmpdir/s.db" --db-stats 2>&1)
+  if echo "$stats" | grep -q "Total entries: 1" &&
+     echo "$stats" | grep -q "Total tags: 0" &&
+     echo "$stats" | grep -q "Date range: 2024-05-01 to 2024-05-01"; then
+    test_pass "Statistics follow deletions"
+  else
+    test_fail "Statistics stale after re-import: $(echo "$stats" | tr '\n' ' ')"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 37: The query server answers framed requests like the command line
+test_serve() {
+  print_test "Query server"
+
+  if ! command -v python3 >/dev/null 2>&1; then
+    test_warn "python3 not available, skipping query server checks"
+    return
+  fi
+
+  local tmpdir=$(mktemp -d)
+  printf "# 2024-06-03\n0900-1000 Standup #team\n1000-1200 Build #dev\n# 2024-06-04\n0900-1030 Review #dev\n" \
+    >"$tmpdir/a.md"
+  $SUMMA --db="$tmpdir/s.db" --import "$tmpdir/a.md" >/dev/null 2>&1
+
+  (umask 000 && exec $SUMMA --db="$tmpdir/s.db" --serve "$tmpdir/sock" 2>/dev/null) &
+  local server=$!
+  for i in $(seq 50); do
+    [ -S "$tmpdir/sock" ] && break
+    sleep 0.1
+  done
+
+  if [ "$(stat -c %a "$tmpdir/sock" 2>/dev/null)" == "600" ]; then
+    test_pass "Socket is private to its owner"
+  else
+    test_fail "Socket mode is $(stat -c %a "$tmpdir/sock" 2>/dev/null), not 600"
+  fi
+
+  # Each argument is one request; options within it are separated by '|'
+  ask() {
+    python3 - "$tmpdir/sock" "$@" <<'PYEOF'
+import socket, struct, sys
+sock = socket.socket(socket.AF_UNIX)
+sock.connect(sys.argv[1])
+requests = [r.split("|") if r else [] for r in sys.argv[2:]]
+frames = b""
+for options in requests:
+    payload = b"".join(o.encode() + b"\0" for o in options)
+    frames += struct.pack(">I", len(payload)) + payload
+sock.sendall(frames)
+stream = sock.makefile("rb")
+for _ in requests:
+    length, = struct.unpack(">I", stream.read(4))
+    sys.stdout.write(stream.read(length).decode())
+PYEOF
+  }
+
+  # Two requests sent back to back on one connection
+  local daily=$($SUMMA --db="$tmpdir/s.db" --daily 2>&1)
+  local csv=$($SUMMA --db="$tmpdir/s.db" --tag dev -f csv 2>&1)
+  if [ "$(ask "--daily" "--tag=dev|-f|csv" 2>&1)" = "$daily"$'\n'"$csv" ]; then
+    test_pass "Replies match the command line reports"
+  else
+    test_fail "Server replies differ from the command line"
+  fi
+
+  # Cached replies are dropped once another process imports
+  ask "--db-stats" >/dev/null 2>&1
+  printf "# 2024-06-05\n0900-1000 Plan #team\n" >"$tmpdir/b.md"
+  $SUMMA --db="$tmpdir/s.db" --import "$tmpdir/b.md" >/dev/null 2>&1
+  local stats=$(ask "--db-stats" 2>&1)
+  if echo "$stats" | grep -q "Total entries: 4"; then
+    test_pass "Server sees entries imported by other processes"
+  else
+    test_fail "Server answered from a stale cache"
+  fi
+
+  local error=$(ask "--import" 2>&1)
+  if echo "$error" | grep -q "Error: Unsupported option '--import'"; then
+    test_pass "Unsupported request options are reported"
+  else
+    test_fail "Unsupported request option not reported"
+  fi
+
+  kill "$server" 2>/dev/null
+  wait "$server" 2>/dev/null || true
+  if [ ! -e "$tmpdir/sock" ]; then
+    test_pass "Socket removed on shutdown"
+  else
+    test_fail "Socket left behind on shutdown"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 38: Reports over several databases merge them like one
+test_db_federated() {
+  print_test "Federated database reports"
+
+  local tmpdir=$(mktemp -d)
+  printf "# 2024-07-01\n0900-1000 Standup #team\n1000-1200 Build #dev\n# 2024-07-02\n0900-1030 Review #dev\n" \
+    >"$tmpdir/a.md"
+  printf "# 2024-07-02\n1400-1500 Support #ops\n# 2024-07-08\n0900-0945 Planning #team\n" \
+    >"$tmpdir/b.md"
+  $SUMMA --db="$tmpdir/a.db" --import "$tmpdir/a.md" >/dev/null 2>&1
+  $SUMMA --db="$tmpdir/b.db" --import "$tmpdir/b.md" >/dev/null 2>&1
+  $SUMMA --db="$tmpdir/all.db" --import "$tmpdir/a.md" >/dev/null 2>&1
+  $SUMMA --db="$tmpdir/all.db" --import "$tmpdir/b.md" >/dev/null 2>&1
+
+  local both=$($SUMMA --db="$tmpdir/a.db" --db="$tmpdir/b.db" --daily 2>&1)
+  local one=$($SUMMA --db="$tmpdir/all.db" --daily 2>&1)
+  if [ "$both" == "$one" ]; then
+    test_pass "Daily report merges days shared by both databases"
+  else
+    test_fail "Merged daily report differs from a single database"
+  fi
+
+  both=$($SUMMA --db="$tmpdir/a.db" --db="$tmpdir/b.db" --monthly 2>&1)
+  one=$($SUMMA --db="$tmpdir/all.db" --monthly 2>&1)
+  if [ "$both" == "$one" ]; then
+    test_pass "Monthly report counts a shared day once"
+  else
+    test_fail "Merged monthly report differs from a single database"
+  fi
+
+  local csv=$($SUMMA --db="$tmpdir/a.db" --db="$tmpdir/b.db" -f csv 2>&1)
+  if echo "$csv" | head -1 | grep -q "^Database,Date" &&
+     echo "$csv" | grep -q "^$tmpdir/b.db,2024-07-02,14:00"; then
+    test_pass "CSV rows name their database"
+  else
+    test_fail "CSV lacks the database column: $(echo "$csv" | head -2 | tr '\n' ' ')"
+  fi
+
+  local text=$($SUMMA --db="$tmpdir/a.db" --db="$tmpdir/b.db" 2>&1)
+  if echo "$text" | grep -q "Time by database" &&
+     echo "$text" | grep -q "b.db *:  1h 45m (2 entries)"; then
+    test_pass "Tag report shows each database's share"
+  else
+    test_fail "Tag report lacks per-database totals"
+  fi
+
+  if ! $SUMMA --db="$tmpdir/a.db" --db="$tmpdir/b.db" --import "$tmpdir/a.md" >/dev/null 2>&1; then
+    test_pass "Rejects importing into several databases"
+  else
+    test_fail "Imported with several databases"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 39: --top keeps only the biggest tags, from files and the database
+test_top_tags() {
+  print_test "Top tags"
+
+  local tmpdir=$(mktemp -d)
+  printf "# 2024-08-01\n0900-1200 Build #dev\n1200-1210 Chat #social\n1210-1220 Chat #social\n1220-1230 Chat #social\n1300-1500 Review #qa\n1500-1530 Sync #team\n" \
+    >"$tmpdir/log.md"
+  $SUMMA --db="$tmpdir/s.db" --import "$tmpdir/log.md" >/dev/null 2>&1
+
+  local output=$($SUMMA --top 2 "$tmpdir/log.md" 2>&1)
+  local tags=$(echo "$output" | grep "^  #" | awk '{print $1}' | tr '\n' ' ')
+  if [ "$tags" == "#dev #qa " ] && echo "$output" | grep -q "Total tracked time: 6h 00m"; then
+    test_pass "Shows the tags with the most time"
+  else
+    test_fail "Wrong top tags: $tags"
+  fi
+
+  tags=$($SUMMA --top 1 --sort-tags count "$tmpdir/log.md" 2>&1 | grep "^  #" | awk '{print $1}')
+  if [ "$tags" == "#social" ]; then
+    test_pass "Ranks by entries with --sort-tags count"
+  else
+    test_fail "Wrong top tag by count: $tags"
+  fi
+
+  local from_file=$($SUMMA --top 3 "$tmpdir/log.md" 2>&1)
+  local from_db=$($SUMMA --db="$tmpdir/s.db" --top 3 2>&1)
+  if [ "$from_file" == "$from_db" ]; then
+    test_pass "Database report matches the file report"
+  else
+    test_fail "Database top tags differ from the file"
+  fi
+
+  if ! $SUMMA --top 0 "$tmpdir/log.md" >/dev/null 2>&1; then
+    test_pass "Rejects a zero tag count"
+  else
+    test_fail "Accepted --top 0"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 40: Co-occurrence counts the time each pair of tags shares
+test_cooccurrence() {
+  print_test "Tag co-occurrence"
+
+  local tmpdir=$(mktemp -d)
+  printf "# 2024-09-02\n0900-1000 Call #client #meeting\n1000-1100 Work #client #dev #client\n1100-1130 Sync #meeting #client #team\n1200-1300 Solo #dev\n" \
+    >"$tmpdir/log.md"
+  $SUMMA --db="$tmpdir/s.db" --import "$tmpdir/log.md" >/dev/null 2>&1
+
+  local output=$($SUMMA --cooccurrence "$tmpdir/log.md" 2>&1)
+  if echo "$output" | grep -q "#client + #meeting *:  1h 30m (2 entries)" &&
+     echo "$output" | grep -q "#client + #dev *:  1h 00m (1 entries)" &&
+     echo "$output" | grep -q "Entries with several tags: 3"; then
+    test_pass "Pairs add up shared time, counting a repeated tag once"
+  else
+    test_fail "Wrong pair totals: $(echo "$output" | tr '\n' ' ')"
+  fi
+
+  local csv=$($SUMMA --cooccurrence --top 1 -f csv "$tmpdir/log.md" 2>&1)
+  if [ "$csv" == $'Tag_A,Tag_B,Duration_Minutes,Entries\n#client,#meeting,90,2' ]; then
+    test_pass "CSV lists the top pair"
+  else
+    test_fail "Wrong CSV pairs: $(echo "$csv" | tr '\n' ' ')"
+  fi
+
+  if $SUMMA --cooccurrence -f json "$tmpdir/log.md" 2>&1 | grep -q '"tags": \["#meeting", "#team"\]'; then
+    test_pass "JSON names both tags of a pair"
+  else
+    test_fail "JSON pairs missing"
+  fi
+
+  local from_file=$($SUMMA --cooccurrence --sort-tags count "$tmpdir/log.md" 2>&1)
+  local from_db=$($SUMMA --db="$tmpdir/s.db" --cooccurrence --sort-tags count 2>&1)
+  if [ "$from_file" == "$from_db" ]; then
+    test_pass "Database report matches the file report"
+  else
+    test_fail "Database pairs differ from the file"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 41: Minute bitmaps count overlapping time once and find gaps
+test_minute_bitmaps() {
+  print_test "Overlaps and gaps"
+
+  local tmpdir=$(mktemp -d)
+  printf "# 2024-10-07\n0900-1000 Standup #team\n0930-1030 Call #client\n0945-1000 Ping #ops\n1200-1300 Build #dev\n2300-0100 Deploy #ops\n# 2024-10-08\n0030-0200 Monitor #ops\n0900-0905 Sync #team\n" \
+    >"$tmpdir/log.md"
+  $SUMMA --db="$tmpdir/s.db" --import "$tmpdir/log.md" >/dev/null 2>&1
+
+  local output=$($SUMMA --dedupe-overlaps "$tmpdir/log.md" 2>&1)
+  if echo "$output" | grep -q "2024-10-07:   3h 30m (5 entries)" &&
+     echo "$output" | grep -q "2024-10-08:   2h 05m (2 entries)" &&
+     echo "$output" | grep -q "counted once: 1h 15m removed"; then
+    test_pass "Overlapping minutes count once, past midnight on the next day"
+  else
+    test_fail "Wrong deduplicated totals: $(echo "$output" | tr '\n' ' ')"
+  fi
+
+  output=$($SUMMA --overlaps -f csv "$tmpdir/log.md" 2>&1)
+  if [ "$output" == $'Date,Start,End,Duration_Minutes\n2024-10-07,09:30,10:00,30\n2024-10-08,00:30,01:00,30' ]; then
+    test_pass "Lists overlapping periods"
+  else
+    test_fail "Wrong overlaps: $(echo "$output" | tr '\n' ' ')"
+  fi
+
+  output=$($SUMMA --gaps "$tmpdir/log.md" 2>&1)
+  if echo "$output" | grep -q "2024-10-07  10:30-12:00   1h 30m" &&
+     echo "$output" | grep -q "2024-10-08  02:00-09:00   7h 00m" &&
+     echo "$output" | grep -q "Total idle: 18h 30m on 2 days"; then
+    test_pass "Lists idle periods between the first and last work of a day"
+  else
+    test_fail "Wrong gaps: $(echo "$output" | tr '\n' ' ')"
+  fi
+
+  local from_file=$($SUMMA --dedupe-overlaps -w "$tmpdir/log.md" 2>&1)
+  local from_db=$($SUMMA --db="$tmpdir/s.db" --dedupe-overlaps -w 2>&1)
+  if [ "$from_file" == "$from_db" ] &&
+     [ "$($SUMMA --gaps "$tmpdir/log.md" 2>&1)" == "$($SUMMA --db="$tmpdir/s.db" --gaps 2>&1)" ]; then
+    test_pass "Database reports match the file reports"
+  else
+    test_fail "Database minute reports differ from the file"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
+# Test 42: Heatmap splits entries across slots and midnight
+test_heatmap() {
+  print_test "Weekday by hour heatmap"
+
+  local tmpdir=$(mktemp -d)
+  printf "# 2024-01-01\n0940-1020 Standup #alpha\n2330-0115 Late #beta\n# 2024-01-07\n2350-0005 Wrap #alpha\n" \
+    >"$tmpdir/log.md"
+  $SUMMA --db="$tmpdir/h.db" --import "$tmpdir/log.md" >/dev/null 2>&1
+
+  local output=$($SUMMA --heatmap -f csv "$tmpdir/log.md" 2>&1)
+  if echo "$output" | grep -qx "00:00,5,60,0,0,0,0,0" &&
+     echo "$output" | grep -qx "01:00,0,15,0,0,0,0,0" &&
+     echo "$output" | grep -qx "09:00,20,0,0,0,0,0,0" &&
+     echo "$output" | grep -qx "10:00,20,0,0,0,0,0,0" &&
+     echo "$output" | grep -qx "23:00,30,0,0,0,0,0,10"; then
+    test_pass "Entries split at hours, past midnight on the next weekday"
+  else
+    test_fail "Wrong heatmap: $(echo "$output" | tr '\n' ' ')"
+  fi
+
+  output=$($SUMMA --heatmap --heatmap-slot 15 --tag alpha "$tmpdir/log.md" 2>&1)
+  if echo "$output" | grep -Eq "^09:45 +15( +0){6}$" &&
+     echo "$output" | grep -Eq "^23:45( +0){6} +10$" &&
+     echo "$output" | grep -q "Total time: 0h 55m"; then
+    test_pass "15-minute slots for one tag"
+  else
+    test_fail "Wrong 15-minute heatmap: $(echo "$output" | tr '\n' ' ')"
+  fi
+
+  local from_file=$($SUMMA --heatmap -f json --heatmap-slot 30 "$tmpdir/log.md" 2>&1)
+  local from_db=$($SUMMA --db="$tmpdir/h.db" --heatmap -f json --heatmap-slot 30 2>&1)
+  if [ "$from_file" == "$from_db" ]; then
+    test_pass "Database heatmap matches the file"
+  else
+    test_fail "Database heatmap differs from the file"
+  fi
+
+  if ! $SUMMA --heatmap --heatmap-slot 20 "$tmpdir/log.md" >/dev/null 2>&1; then
+    test_pass "Rejects slot lengths other than 15, 30 and 60"
+  else
+    test_fail "Accepted a 20-minute slot"
+  fi
+
+  rm -rf "$tmpdir"
+}
+
 # Main test execution
 main() {
   echo -e "${MAGENTA}╔════════════════════════════════════════════════════╗${NC}"
@@ -907,6 +1840,10 @@ main() {
   test_date_inference
   test_file_filtering
   test_scan_aggregation
+  test_compressed_scanning
+  test_batched_scanning
+  test_inode_dedup
+  test_large_file_scanning
 
   print_header "Filtering"
   test_date_filtering
@@ -923,6 +1860,24 @@ main() {
   test_csv_format
   test_json_format
 
+  print_header "Database"
+  test_db_import_dedup
+  test_db_profiles
+  test_db_query_filters
+  test_db_summaries
+  test_db_rollups
+  test_db_search
+  test_db_reimport_sync
+  test_db_scan_import
+  test_db_backup
+  test_db_stats
+  test_serve
+  test_db_federated
+  test_top_tags
+  test_cooccurrence
+  test_minute_bitmaps
+  test_heatmap
+
   print_header "Performance"
   test_performance
 